@@ -1,19 +1,40 @@
 #include "benchmark/benchmark.h"
 #include <kset/kset.h>
+#include <kset/concurrent_kset.h>
+#include <kset/mapped_kset.h>
+#include <kset/frozen_kset.h>
+#include <kset/compressed_kset.h>
+#include <kset/set_ops.h>
+#include <kset/kset_stats.h>
+#include <kset/compact.h>
+#include <kset/kmap.h>
+#include <kset/parallel.h>
+#include <kset/sharded_kset.h>
+#include "perf_counters.h"
 #include <iostream>
 #include <unordered_set>
+#include <unordered_map>
 #include <random>
-#include <ctime>
 
 #include <cstdlib>
 #include <map>
+#include <set>
+#include <iterator>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+//Every benchmark draws its keys from this seed, so that two runs see the same data
+static const uint64_t bench_seed = 42;
 
 class SetFixture : public ::benchmark::Fixture {
 
 public:
 
     SetFixture() : ::benchmark::Fixture(),
-        gen_(time(nullptr)),
+        gen_(bench_seed),
         dis_{0,std::numeric_limits<int64_t>::max()}
     {}
 
@@ -35,18 +56,21 @@ public:
 
 BENCHMARK_DEFINE_F(SetFixture, Lookup)(benchmark::State& state) {
     const int size = static_cast<int>(state.range(0));
+    PerfCounters counters;
     for (auto _ : state) {
         for (int i = 0; i < size; ++i) {
             benchmark::DoNotOptimize(data_.find(dis_(gen_)));
         }
     }
     state.SetItemsProcessed(state.iterations() * size);
+    counters.report(state, state.iterations() * size);
 }
 
 BENCHMARK_REGISTER_F(SetFixture, Lookup)->RangeMultiplier(2)->Range(1000000, 32000000);
 
 BENCHMARK_DEFINE_F(SetFixture, Successor)(benchmark::State& state) {
     const int size = static_cast<int>(state.range(0));
+    PerfCounters counters;
     for (auto _ : state) {
         for (int i = 0; i < size; ++i) {
             int64_t randval = dis_(gen_);
@@ -58,16 +82,62 @@ BENCHMARK_DEFINE_F(SetFixture, Successor)(benchmark::State& state) {
         }
     }
     state.SetItemsProcessed(state.iterations() * size);
+    counters.report(state, state.iterations() * size);
 }
 
 BENCHMARK_REGISTER_F(SetFixture, Successor)->RangeMultiplier(2)->Range(1000000, 32000000);
 
+//"Next value >= x" for probes drawn from the whole key space, which are almost never in the set
+BENCHMARK_DEFINE_F(SetFixture, NextGeq)(benchmark::State& state) {
+    const int size = static_cast<int>(state.range(0));
+    std::vector<int64_t> probes(size);
+    for (auto& probe : probes) {
+        probe = dis_(gen_);
+    }
+    PerfCounters counters;
+    for (auto _ : state) {
+        for (int64_t probe : probes) {
+            benchmark::DoNotOptimize(data_.lower_bound(probe));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+    counters.report(state, state.iterations() * size);
+}
+
+BENCHMARK_REGISTER_F(SetFixture, NextGeq)->RangeMultiplier(2)->Range(1000000, 32000000);
+
+//Sum up the values in windows of the key space that hold ~100 values each
+BENCHMARK_DEFINE_F(SetFixture, RangeScan)(benchmark::State& state) {
+    const int size = static_cast<int>(state.range(0));
+    const int64_t width = std::numeric_limits<int64_t>::max() / size * 100;
+    std::vector<int64_t> starts(size / 100);
+    for (auto& start : starts) {
+        start = dis_(gen_) % (std::numeric_limits<int64_t>::max() - width);
+    }
+    int64_t visited = 0;
+    PerfCounters counters;
+    for (auto _ : state) {
+        for (int64_t lo : starts) {
+            int64_t sum = 0;
+            for (auto itr = data_.lower_bound(lo); itr != data_.end() && *itr < lo + width; ++itr) {
+                sum += *itr;
+                visited++;
+            }
+            benchmark::DoNotOptimize(sum);
+        }
+    }
+    state.SetItemsProcessed(visited);
+    counters.report(state, visited);
+}
+
+BENCHMARK_REGISTER_F(SetFixture, RangeScan)->RangeMultiplier(2)->Range(1000000, 32000000);
+
 //////////////////////////////////////////////////////////////////////////////////////////
 
 class KSetFixture : public ::benchmark::Fixture {
 public:
     KSetFixture() : ::benchmark::Fixture(),
-        gen_(time(nullptr)),
+        gen_(bench_seed),
         dis_{0,std::numeric_limits<int64_t>::max()}
     {}
 
@@ -91,18 +161,21 @@ public:
 
 BENCHMARK_DEFINE_F(KSetFixture, Lookup)(benchmark::State& state) {
   const int size = static_cast<int>(state.range(0));
+  PerfCounters counters;
   for (auto _ : state) {
     for (int i = 0; i < size; ++i) {
       benchmark::DoNotOptimize(find(data_, dis_(gen_)));
     }
   }
   state.SetItemsProcessed(state.iterations() * size);
+  counters.report(state, state.iterations() * size);
 }
 
 BENCHMARK_REGISTER_F(KSetFixture, Lookup)->RangeMultiplier(2)->Range(1000000, 32000000);
 
 BENCHMARK_DEFINE_F(KSetFixture, Successor)(benchmark::State& state) {
     const int size = static_cast<int>(state.range(0));
+    PerfCounters counters;
     for (auto _ : state) {
         for (int i = 0; i < size; ++i) {
             int64_t randval = dis_(gen_);
@@ -117,10 +190,1130 @@ BENCHMARK_DEFINE_F(KSetFixture, Successor)(benchmark::State& state) {
         }
     }
     state.SetItemsProcessed(state.iterations() * size);
+    counters.report(state, state.iterations() * size);
 }
 
 BENCHMARK_REGISTER_F(KSetFixture, Successor)->RangeMultiplier(2)->Range(1000000, 32000000);
 
+//Same lookups as above but with the keys drawn up front, so that the single and batched
+//variants below can be compared without the RNG in the timed loop
+BENCHMARK_DEFINE_F(KSetFixture, LookupLoop)(benchmark::State& state) {
+    const int size = static_cast<int>(state.range(0));
+    std::vector<int64_t> keys(size);
+    for (auto& key : keys) {
+        key = dis_(gen_);
+    }
+    PerfCounters counters;
+    for (auto _ : state) {
+        for (int64_t key : keys) {
+            benchmark::DoNotOptimize(find(data_, key));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+    counters.report(state, state.iterations() * size);
+}
+
+BENCHMARK_REGISTER_F(KSetFixture, LookupLoop)->RangeMultiplier(2)->Range(1000000, 32000000);
+
+BENCHMARK_DEFINE_F(KSetFixture, LookupBatch)(benchmark::State& state) {
+    const int size = static_cast<int>(state.range(0));
+    const size_t batch = 256;
+    std::vector<int64_t> keys(size);
+    for (auto& key : keys) {
+        key = dis_(gen_);
+    }
+    std::vector<Kset::FindResult> results(batch);
+    PerfCounters counters;
+    for (auto _ : state) {
+        for (size_t i = 0; i < keys.size(); i += batch) {
+            size_t n = std::min(batch, keys.size() - i);
+            Kset::find_batch(data_, keys.data() + i, n, results.data());
+            benchmark::DoNotOptimize(results.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+    counters.report(state, state.iterations() * size);
+}
+
+BENCHMARK_REGISTER_F(KSetFixture, LookupBatch)->RangeMultiplier(2)->Range(1000000, 32000000);
+
+//The same lookups with each Node::find kernel. The second arg is the kernel
+BENCHMARK_DEFINE_F(KSetFixture, LookupKernel)(benchmark::State& state) {
+    const int size = static_cast<int>(state.range(0));
+    const auto kernel = static_cast<Kset::Node::FindKernel>(state.range(1));
+    if(!Kset::Node::supports(kernel)) {
+        state.SkipWithError("kernel not supported by this CPU");
+        return;
+    }
+    std::vector<int64_t> keys(size);
+    for (auto& key : keys) {
+        key = dis_(gen_);
+    }
+
+    const Kset::Node::FindKernel best = Kset::Node::findKernel();
+    Kset::Node::setFindKernel(kernel);
+    PerfCounters counters;
+    for (auto _ : state) {
+        for (int64_t key : keys) {
+            benchmark::DoNotOptimize(find(data_, key));
+        }
+    }
+    Kset::Node::setFindKernel(best);
+    state.SetItemsProcessed(state.iterations() * size);
+    counters.report(state, state.iterations() * size);
+}
+
+BENCHMARK_REGISTER_F(KSetFixture, LookupKernel)->ArgsProduct({
+    benchmark::CreateRange(1000000, 32000000, 2),
+    {static_cast<int64_t>(Kset::Node::FindKernel::scalar),
+     static_cast<int64_t>(Kset::Node::FindKernel::avx2),
+     static_cast<int64_t>(Kset::Node::FindKernel::avx512)}});
+
+BENCHMARK_DEFINE_F(KSetFixture, NextGeq)(benchmark::State& state) {
+    const int size = static_cast<int>(state.range(0));
+    std::vector<int64_t> probes(size);
+    for (auto& probe : probes) {
+        probe = dis_(gen_);
+    }
+    PerfCounters counters;
+    for (auto _ : state) {
+        for (int64_t probe : probes) {
+            benchmark::DoNotOptimize(Kset::next_geq(data_, probe));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+    counters.report(state, state.iterations() * size);
+}
+
+BENCHMARK_REGISTER_F(KSetFixture, NextGeq)->RangeMultiplier(2)->Range(1000000, 32000000);
+
+BENCHMARK_DEFINE_F(KSetFixture, RangeScan)(benchmark::State& state) {
+    const int size = static_cast<int>(state.range(0));
+    const int64_t width = std::numeric_limits<int64_t>::max() / size * 100;
+    std::vector<int64_t> starts(size / 100);
+    for (auto& start : starts) {
+        start = dis_(gen_) % (std::numeric_limits<int64_t>::max() - width);
+    }
+    int64_t visited = 0;
+    PerfCounters counters;
+    for (auto _ : state) {
+        for (int64_t lo : starts) {
+            int64_t sum = 0;
+            Kset::for_each_in_range(data_, lo, lo + width, [&sum, &visited](int64_t val) {
+                sum += val;
+                visited++;
+            });
+            benchmark::DoNotOptimize(sum);
+        }
+    }
+    state.SetItemsProcessed(visited);
+    counters.report(state, visited);
+}
+
+BENCHMARK_REGISTER_F(KSetFixture, RangeScan)->RangeMultiplier(2)->Range(1000000, 32000000);
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/// Sorted inserts. Plain insert() degenerates into a chain that is N/Node::capacity levels deep, so it
+/// only gets small sizes. insert_balanced() keeps the depth logarithmic
+
+static void KsetSequentialInsert(benchmark::State& state, bool balanced) {
+    const int size = static_cast<int>(state.range(0));
+    size_t depth{0};
+    for (auto _ : state) {
+        Kset::Node* root = Kset::make_tree();
+        for (int i = 0; i < size; ++i) {
+            if(balanced) {
+                Kset::insert_balanced(root, i);
+            } else {
+                Kset::insert(root, i);
+            }
+        }
+        state.PauseTiming();
+        depth = Kset::stats(root).depth();
+        delete root;
+        state.ResumeTiming();
+    }
+    state.counters["depth"] = depth;
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+BENCHMARK_CAPTURE(KsetSequentialInsert, unbalanced, false)->RangeMultiplier(4)->Range(1024, 65536)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(KsetSequentialInsert, balanced, true)->RangeMultiplier(4)->Range(1024, 32000000)->Unit(benchmark::kMillisecond);
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/// Building a tree out of a sorted snapshot: bulk_load() vs inserting one value at a time
+
+static std::vector<int64_t> randomKeys(int size, int seed);
+
+static std::vector<int64_t> sortedRandomKeys(int size) {
+    std::mt19937_64 gen(bench_seed);
+    std::uniform_int_distribution<int64_t> dis{0,std::numeric_limits<int64_t>::max()};
+    std::vector<int64_t> keys(size);
+    for (auto& key : keys) {
+        key = dis(gen);
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+//Plain insert() would build an N/Node::capacity deep chain out of sorted input, so it is left out
+static void KsetLoadSorted(benchmark::State& state, bool bulk) {
+    const std::vector<int64_t> keys = sortedRandomKeys(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        Kset::Node* root{nullptr};
+        if(bulk) {
+            root = Kset::bulk_load(keys.data(), keys.data() + keys.size());
+        } else {
+            root = Kset::make_tree();
+            for (int64_t key : keys) {
+                Kset::insert_balanced(root, key);
+            }
+        }
+        state.PauseTiming();
+        delete root;
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+    state.SetBytesProcessed(state.iterations() * keys.size() * sizeof(int64_t));
+}
+
+BENCHMARK_CAPTURE(KsetLoadSorted, bulk_load, true)->RangeMultiplier(2)->Range(1000000, 32000000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(KsetLoadSorted, insert_balanced, false)->RangeMultiplier(2)->Range(1000000, 32000000)->Unit(benchmark::kMillisecond);
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/// Ingesting a batch of range(0) unsorted values into a tree of 1M values: insert_batch()
+/// against insert() one value at a time. The tree is rebuilt (untimed) for every batch
+
+static void KsetIngestBatch(benchmark::State& state, bool batched) {
+    const std::vector<int64_t> preload = sortedRandomKeys(1000000);
+    const std::vector<int64_t> batch = randomKeys(static_cast<int>(state.range(0)), bench_seed + 1);
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::unique_ptr<Kset::Node> root{Kset::bulk_load(preload.data(), preload.data() + preload.size())};
+        state.ResumeTiming();
+        if(batched) {
+            benchmark::DoNotOptimize(Kset::insert_batch(root.get(), batch.data(), batch.size()));
+        } else {
+            for (int64_t key : batch) {
+                Kset::insert(root.get(), key);
+            }
+        }
+        state.PauseTiming();
+        root.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * batch.size());
+}
+
+BENCHMARK_CAPTURE(KsetIngestBatch, insert_batch, true)->RangeMultiplier(10)->Range(10000, 1000000)->Iterations(10)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(KsetIngestBatch, insert, false)->RangeMultiplier(10)->Range(10000, 1000000)->Iterations(10)->Unit(benchmark::kMillisecond);
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/// Building a tree of range(0) values on range(1) threads: parallel_bulk_load() out of sorted
+/// input and parallel_build() out of unsorted input with duplicates. Compare with KsetLoadSorted
+
+static void threadCounts(benchmark::internal::Benchmark* b) {
+    const int maxThreads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    for (int size : {4000000, 32000000}) {
+        for (int threads = 1; threads < maxThreads; threads *= 2) {
+            b->Args({size, threads});
+        }
+        b->Args({size, maxThreads});
+    }
+}
+
+static void KsetParallelLoad(benchmark::State& state, bool sorted) {
+    const int size = static_cast<int>(state.range(0));
+    const unsigned threads = static_cast<unsigned>(state.range(1));
+    const std::vector<int64_t> keys = sorted ? sortedRandomKeys(size) : randomKeys(size, bench_seed);
+    for (auto _ : state) {
+        Kset::Node* root = sorted ? Kset::parallel_bulk_load(keys.data(), keys.data() + keys.size(), threads)
+                                  : Kset::parallel_build(keys.data(), keys.size(), threads);
+        state.PauseTiming();
+        delete root;
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+BENCHMARK_CAPTURE(KsetParallelLoad, sorted, true)->Apply(threadCounts)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(KsetParallelLoad, unsorted, false)->Apply(threadCounts)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/// Summing the values of a tree of range(0) random values on range(1) threads with
+/// parallel_reduce(), over the whole tree or over the middle half of the keys. One thread
+/// is a plain Iterator scan plus the cost of splitting the tree
+
+static void KsetParallelSum(benchmark::State& state, bool wholeTree) {
+    const int size = static_cast<int>(state.range(0));
+    const unsigned threads = static_cast<unsigned>(state.range(1));
+    std::vector<int64_t> keys = randomKeys(size, bench_seed);
+    std::unique_ptr<Kset::Node> root{Kset::parallel_build(keys.data(), keys.size())};
+    std::sort(keys.begin(), keys.end());
+    const int64_t first = wholeTree ? std::numeric_limits<int64_t>::min() : keys[keys.size() / 4];
+    const int64_t last = wholeTree ? std::numeric_limits<int64_t>::max() : keys[keys.size() * 3 / 4] - 1;
+    auto add = [](uint64_t acc, int64_t v) { return acc + uint64_t(v); };
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Kset::parallel_reduce_between(root.get(), first, last, uint64_t{0}, add, add, threads));
+    }
+    state.SetItemsProcessed(state.iterations() * (wholeTree ? keys.size() : keys.size() / 2));
+}
+
+BENCHMARK_CAPTURE(KsetParallelSum, whole, true)->Apply(threadCounts)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(KsetParallelSum, middle_half, false)->Apply(threadCounts)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/// Memory and shape of trees built in different ways, for capacity planning. The time is that
+/// of stats() itself, the interesting part are the counters
+
+enum class BuildKind { insert_random, insert_balanced_random, insert_balanced_sorted, bulk_load };
+
+static Kset::Node* buildTree(BuildKind kind, int size) {
+    std::vector<int64_t> keys = sortedRandomKeys(size);
+    if(kind == BuildKind::bulk_load) {
+        return Kset::bulk_load(keys.data(), keys.data() + keys.size());
+    }
+    if(kind != BuildKind::insert_balanced_sorted) {
+        std::shuffle(keys.begin(), keys.end(), std::mt19937_64(bench_seed));
+    }
+    Kset::Node* root = Kset::make_tree();
+    for (int64_t key : keys) {
+        if(kind == BuildKind::insert_random) {
+            Kset::insert(root, key);
+        } else {
+            Kset::insert_balanced(root, key);
+        }
+    }
+    return root;
+}
+
+static void statsCounters(benchmark::State& state, const Kset::TreeStats& s) {
+    state.counters["node_lines"] = Kset::Node::node_lines;
+    state.counters["values"] = s.numValues;
+    state.counters["nodes"] = s.numNodes;
+    state.counters["empty_nodes"] = s.numEmptyNodes;
+    state.counters["allocated_bytes"] = benchmark::Counter(s.allocatedBytes, benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+    state.counters["reserved_bytes"] = benchmark::Counter(s.reservedBytes, benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+    state.counters["bytes_per_value"] = s.bytesPerValue();
+    state.counters["fill"] = s.fill();
+    state.counters["depth"] = s.depth();
+    for(size_t l = 0; l < s.depth(); l++) {
+        state.counters["fill_L" + std::to_string(l)] = s.levels[l].fill();
+        if(s.levels[l].leaves) {
+            state.counters["leaves_L" + std::to_string(l)] = s.levels[l].leaves;
+        }
+    }
+}
+
+static void KsetShape(benchmark::State& state, BuildKind kind) {
+    std::unique_ptr<Kset::Node> root{buildTree(kind, static_cast<int>(state.range(0)))};
+    Kset::TreeStats s;
+    for (auto _ : state) {
+        s = Kset::stats(root.get());
+        benchmark::DoNotOptimize(s);
+    }
+    statsCounters(state, s);
+}
+
+BENCHMARK_CAPTURE(KsetShape, insert_random, BuildKind::insert_random)->RangeMultiplier(4)->Range(1000000, 16000000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(KsetShape, insert_balanced_random, BuildKind::insert_balanced_random)->RangeMultiplier(4)->Range(1000000, 16000000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(KsetShape, insert_balanced_sorted, BuildKind::insert_balanced_sorted)->RangeMultiplier(4)->Range(1000000, 16000000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(KsetShape, bulk_load, BuildKind::bulk_load)->RangeMultiplier(4)->Range(1000000, 16000000)->Unit(benchmark::kMillisecond);
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/// Compaction. Lookups of present keys on a tree aged by random inserts and erases, as it is
+/// and after compact(), and the cost of compacting it in slices of 10k values
+
+static Kset::Node* agedTree(int size, std::vector<int64_t>& live) {
+    std::vector<int64_t> keys = sortedRandomKeys(size);
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64(size));
+    Kset::Node* root = Kset::make_tree();
+    for (int64_t key : keys) {
+        Kset::insert(root, key);
+    }
+    for (size_t i = 0; i < keys.size(); i++) {
+        if(i % 3 == 0) {
+            Kset::erase(root, keys[i]);
+        } else {
+            live.push_back(keys[i]);
+        }
+    }
+    return root;
+}
+
+static void KsetCompactedLookup(benchmark::State& state, bool compacted) {
+    std::vector<int64_t> live;
+    std::unique_ptr<Kset::Node> root{agedTree(static_cast<int>(state.range(0)), live)};
+    if(compacted) {
+        root.reset(Kset::compact(root.get()));
+    }
+    std::mt19937_64 gen(bench_seed);
+    std::uniform_int_distribution<size_t> pick(0, live.size() - 1);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Kset::find(root.get(), live[pick(gen)]));
+    }
+    state.SetItemsProcessed(state.iterations());
+    Kset::TreeStats s = Kset::stats(root.get());
+    state.counters["bytes_per_value"] = s.bytesPerValue();
+    state.counters["depth"] = s.depth();
+}
+
+BENCHMARK_CAPTURE(KsetCompactedLookup, aged, false)->RangeMultiplier(4)->Range(1000000, 32000000);
+BENCHMARK_CAPTURE(KsetCompactedLookup, compacted, true)->RangeMultiplier(4)->Range(1000000, 32000000);
+
+static void KsetCompact(benchmark::State& state) {
+    constexpr size_t slice = 10000;
+    std::vector<int64_t> live;
+    std::unique_ptr<Kset::Node> root{agedTree(static_cast<int>(state.range(0)), live)};
+    double maxSlice{0};
+    for (auto _ : state) {
+        Kset::Compactor compactor(root.get());
+        bool done{false};
+        while(!done) {
+            auto start = std::chrono::steady_clock::now();
+            done = compactor.step(slice);
+            maxSlice = std::max(maxSlice, std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        }
+        state.PauseTiming();
+        delete compactor.release();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * live.size());
+    state.counters["max_slice_us"] = maxSlice;
+}
+
+BENCHMARK(KsetCompact)->RangeMultiplier(4)->Range(1000000, 32000000)->Unit(benchmark::kMillisecond);
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/// Startup from a file written by save(): mapping it and running the first lookup, against
+/// rebuilding the tree with insert(). Then the cost of lookups on the mapped file
+
+static std::string savedTree(int size) {
+    const std::string path = "/tmp/kset_bench_" + std::to_string(size) + ".kset";
+    std::mt19937_64 gen(size);
+    std::uniform_int_distribution<int64_t> dis{0,std::numeric_limits<int64_t>::max()};
+    std::unique_ptr<Kset::Node> root(Kset::make_tree());
+    for (int i = 0; i < size; ++i) {
+        Kset::insert(root.get(), dis(gen));
+    }
+    Kset::save(root.get(), path);
+    return path;
+}
+
+static void KsetStartup(benchmark::State& state, bool mapped) {
+    const int size = static_cast<int>(state.range(0));
+    const std::string path = savedTree(size);
+    std::mt19937_64 gen(size);
+    std::uniform_int_distribution<int64_t> dis{0,std::numeric_limits<int64_t>::max()};
+    std::vector<int64_t> keys(size);
+    for (auto& key : keys) {
+        key = dis(gen);
+    }
+
+    for (auto _ : state) {
+        if(mapped) {
+            Kset::MappedKset set(path);
+            benchmark::DoNotOptimize(set.find(keys[0]));
+        } else {
+            std::unique_ptr<Kset::Node> root(Kset::make_tree());
+            for (int64_t key : keys) {
+                Kset::insert(root.get(), key);
+            }
+            benchmark::DoNotOptimize(Kset::find(root.get(), keys[0]));
+            state.PauseTiming();
+            root.reset();
+            state.ResumeTiming();
+        }
+    }
+    std::remove(path.c_str());
+}
+
+BENCHMARK_CAPTURE(KsetStartup, mapped, true)->RangeMultiplier(4)->Range(1000000, 16000000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(KsetStartup, insert, false)->RangeMultiplier(4)->Range(1000000, 16000000)->Unit(benchmark::kMillisecond);
+
+//Same as LookupLoop, on a mapped copy of the tree
+BENCHMARK_DEFINE_F(KSetFixture, MappedLookup)(benchmark::State& state) {
+    const int size = static_cast<int>(state.range(0));
+    const std::string path = "/tmp/kset_bench_lookup.kset";
+    Kset::save(data_, path);
+    Kset::MappedKset set(path);
+    std::vector<int64_t> keys(size);
+    for (auto& key : keys) {
+        key = dis_(gen_);
+    }
+    PerfCounters counters;
+    for (auto _ : state) {
+        for (int64_t key : keys) {
+            benchmark::DoNotOptimize(set.find(key));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+    counters.report(state, state.iterations() * size);
+    std::remove(path.c_str());
+}
+
+BENCHMARK_REGISTER_F(KSetFixture, MappedLookup)->RangeMultiplier(2)->Range(1000000, 32000000);
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/// The same lookups (and next_geq) on a FrozenKset snapshot of the tree. The counters give
+/// the memory taken per value by the tree and by the snapshot
+
+static void frozenCounters(benchmark::State& state, const Kset::Node* root, const Kset::FrozenKset& frozen) {
+    state.counters["tree_bytes_per_key"] = Kset::stats(root).bytesPerValue();
+    state.counters["frozen_bytes_per_key"] = double(frozen.bytes()) / frozen.size();
+}
+
+BENCHMARK_DEFINE_F(KSetFixture, FrozenLookup)(benchmark::State& state) {
+    const int size = static_cast<int>(state.range(0));
+    const Kset::FrozenKset frozen = Kset::freeze(data_);
+    std::vector<int64_t> keys(size);
+    for (auto& key : keys) {
+        key = dis_(gen_);
+    }
+    PerfCounters counters;
+    for (auto _ : state) {
+        for (int64_t key : keys) {
+            benchmark::DoNotOptimize(frozen.find(key));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+    counters.report(state, state.iterations() * size);
+    frozenCounters(state, data_, frozen);
+}
+
+BENCHMARK_REGISTER_F(KSetFixture, FrozenLookup)->RangeMultiplier(2)->Range(1000000, 32000000);
+
+BENCHMARK_DEFINE_F(KSetFixture, FrozenNextGeq)(benchmark::State& state) {
+    const int size = static_cast<int>(state.range(0));
+    const Kset::FrozenKset frozen = Kset::freeze(data_);
+    std::vector<int64_t> keys(size);
+    for (auto& key : keys) {
+        key = dis_(gen_);
+    }
+    PerfCounters counters;
+    for (auto _ : state) {
+        for (int64_t key : keys) {
+            benchmark::DoNotOptimize(frozen.next_geq(key));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+    counters.report(state, state.iterations() * size);
+    frozenCounters(state, data_, frozen);
+}
+
+BENCHMARK_REGISTER_F(KSetFixture, FrozenNextGeq)->RangeMultiplier(2)->Range(1000000, 32000000);
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/// Lookups of present keys in a bulk loaded tree, a FrozenKset and a CompressedKset, for keys
+/// spread uniformly over the whole range and for clustered keys: runs of nearby IDs, as an
+/// allocator hands them out, far apart from each other
+
+enum class KeyDist { uniform, clustered };
+enum class Snapshot { tree, frozen, compressed };
+
+static std::vector<int64_t> distributedKeys(KeyDist dist, int size) {
+    if(dist == KeyDist::uniform) {
+        return sortedRandomKeys(size);
+    }
+    std::mt19937_64 gen(bench_seed);
+    std::uniform_int_distribution<int64_t> runLength{1, 500};
+    std::uniform_int_distribution<int64_t> step{1, 16};
+    std::uniform_int_distribution<int64_t> jump{1, int64_t{1} << 40};
+    std::vector<int64_t> keys;
+    keys.reserve(size);
+    int64_t key = 0;
+    while(keys.size() < size_t(size)) {
+        for(int64_t n = runLength(gen); n > 0 && keys.size() < size_t(size); n--) {
+            key += step(gen);
+            keys.push_back(key);
+        }
+        key += jump(gen);
+    }
+    return keys;
+}
+
+static void SnapshotLookup(benchmark::State& state, KeyDist dist, Snapshot snapshot) {
+    const std::vector<int64_t> keys = distributedKeys(dist, static_cast<int>(state.range(0)));
+    std::vector<int64_t> probes(keys);
+    std::shuffle(probes.begin(), probes.end(), std::mt19937_64(bench_seed));
+
+    std::unique_ptr<Kset::Node> root{Kset::bulk_load(keys.data(), keys.data() + keys.size())};
+    const Kset::FrozenKset frozen = Kset::freeze(keys.data(), keys.data() + keys.size());
+    const Kset::CompressedKset compressed = Kset::compress(keys.data(), keys.data() + keys.size());
+    for (auto _ : state) {
+        for (int64_t key : probes) {
+            switch(snapshot) {
+            case Snapshot::tree:
+                benchmark::DoNotOptimize(Kset::find(root.get(), key));
+                break;
+            case Snapshot::frozen:
+                benchmark::DoNotOptimize(frozen.find(key));
+                break;
+            case Snapshot::compressed:
+                benchmark::DoNotOptimize(compressed.find(key));
+                break;
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * probes.size());
+    switch(snapshot) {
+    case Snapshot::tree:
+        state.counters["bytes_per_key"] = Kset::stats(root.get()).bytesPerValue();
+        break;
+    case Snapshot::frozen:
+        state.counters["bytes_per_key"] = double(frozen.bytes()) / frozen.size();
+        break;
+    case Snapshot::compressed:
+        state.counters["bytes_per_key"] = double(compressed.bytes()) / compressed.size();
+        state.counters["keys_per_line"] = double(compressed.size()) / compressed.numLines();
+        break;
+    }
+}
+
+BENCHMARK_CAPTURE(SnapshotLookup, uniform_tree, KeyDist::uniform, Snapshot::tree)->RangeMultiplier(4)->Range(1000000, 16000000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(SnapshotLookup, uniform_frozen, KeyDist::uniform, Snapshot::frozen)->RangeMultiplier(4)->Range(1000000, 16000000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(SnapshotLookup, uniform_compressed, KeyDist::uniform, Snapshot::compressed)->RangeMultiplier(4)->Range(1000000, 16000000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(SnapshotLookup, clustered_tree, KeyDist::clustered, Snapshot::tree)->RangeMultiplier(4)->Range(1000000, 16000000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(SnapshotLookup, clustered_frozen, KeyDist::clustered, Snapshot::frozen)->RangeMultiplier(4)->Range(1000000, 16000000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(SnapshotLookup, clustered_compressed, KeyDist::clustered, Snapshot::compressed)->RangeMultiplier(4)->Range(1000000, 16000000)->Unit(benchmark::kMillisecond);
+
+#ifdef USE_ORDER_STATS
+//////////////////////////////////////////////////////////////////////////////////////////
+/// rank/select/count_range walk one root to leaf path using the per-block subtree counts.
+/// The insert cost of keeping those counts shows up in KsetInsert with and without USE_ORDER_STATS
+
+BENCHMARK_DEFINE_F(KSetFixture, Rank)(benchmark::State& state) {
+  const int size = static_cast<int>(state.range(0));
+  PerfCounters counters;
+  for (auto _ : state) {
+    for (int i = 0; i < size; ++i) {
+      benchmark::DoNotOptimize(Kset::rank(data_, dis_(gen_)));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * size);
+  counters.report(state, state.iterations() * size);
+}
+
+BENCHMARK_REGISTER_F(KSetFixture, Rank)->RangeMultiplier(2)->Range(1000000, 32000000);
+
+BENCHMARK_DEFINE_F(KSetFixture, Select)(benchmark::State& state) {
+  const int size = static_cast<int>(state.range(0));
+  std::uniform_int_distribution<uint64_t> kDis{0, Kset::size(data_) - 1};
+  PerfCounters counters;
+  for (auto _ : state) {
+    for (int i = 0; i < size; ++i) {
+      benchmark::DoNotOptimize(Kset::select(data_, kDis(gen_)));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * size);
+  counters.report(state, state.iterations() * size);
+}
+
+BENCHMARK_REGISTER_F(KSetFixture, Select)->RangeMultiplier(2)->Range(1000000, 32000000);
+
+BENCHMARK_DEFINE_F(KSetFixture, CountRange)(benchmark::State& state) {
+  const int size = static_cast<int>(state.range(0));
+  PerfCounters counters;
+  for (auto _ : state) {
+    for (int i = 0; i < size; ++i) {
+      int64_t a = dis_(gen_);
+      int64_t b = dis_(gen_);
+      benchmark::DoNotOptimize(Kset::count_range(data_, std::min(a, b), std::max(a, b)));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * size);
+  counters.report(state, state.iterations() * size);
+}
+
+BENCHMARK_REGISTER_F(KSetFixture, CountRange)->RangeMultiplier(2)->Range(1000000, 32000000);
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/// Intersecting a set of range(0) values with one that is range(1) times smaller: the galloping
+/// merge of set_intersection() against a find() in the large tree for every value of the small one,
+/// and against std::set_intersection over two std::sets
+
+static void makeIntersectionInputs(benchmark::State& state, Kset::Node*& large, Kset::Node*& small,
+                                   std::set<int64_t>* largeSet = nullptr, std::set<int64_t>* smallSet = nullptr) {
+    const int size = static_cast<int>(state.range(0));
+    std::mt19937_64 gen(size);
+    //A narrow range, so that the sets actually overlap
+    std::uniform_int_distribution<int64_t> dis{0, int64_t(size) * 4};
+    large = Kset::make_tree();
+    small = Kset::make_tree();
+    for (int i = 0; i < size; ++i) {
+        int64_t val = dis(gen);
+        Kset::insert(large, val);
+        if(largeSet) {
+            largeSet->insert(val);
+        }
+        if(i % state.range(1) == 0) {
+            val = dis(gen);
+            Kset::insert(small, val);
+            if(smallSet) {
+                smallSet->insert(val);
+            }
+        }
+    }
+}
+
+static void KsetIntersect(benchmark::State& state, bool gallop) {
+    Kset::Node* large{nullptr};
+    Kset::Node* small{nullptr};
+    makeIntersectionInputs(state, large, small);
+    size_t common = 0;
+    for (auto _ : state) {
+        common = 0;
+        if(gallop) {
+            Kset::set_intersection(large, small, [&common](int64_t) { common++; });
+        } else {
+            for (auto itr = Kset::begin(small); itr != Kset::end(small); ++itr) {
+                bool found{false};
+                std::tie(std::ignore,std::ignore,found) = Kset::find(large, *itr);
+                common += found;
+            }
+        }
+        benchmark::DoNotOptimize(common);
+    }
+    state.counters["common"] = common;
+    delete large;
+    delete small;
+}
+
+BENCHMARK_CAPTURE(KsetIntersect, gallop, true)->ArgsProduct({{4000000}, {1, 16, 256}})->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(KsetIntersect, find_each, false)->ArgsProduct({{4000000}, {1, 16, 256}})->Unit(benchmark::kMillisecond);
+
+//Output iterator that only counts what is written to it
+struct CountingOutput {
+    using iterator_category = std::output_iterator_tag;
+    using value_type = void;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = void;
+
+    size_t count = 0;
+
+    CountingOutput& operator*() { return *this; }
+    CountingOutput& operator=(int64_t) { count++; return *this; }
+    CountingOutput& operator++() { return *this; }
+    CountingOutput& operator++(int) { return *this; }
+};
+
+static void SetIntersect(benchmark::State& state) {
+    Kset::Node* large{nullptr};
+    Kset::Node* small{nullptr};
+    std::set<int64_t> largeSet, smallSet;
+    makeIntersectionInputs(state, large, small, &largeSet, &smallSet);
+    delete large;
+    delete small;
+    for (auto _ : state) {
+        CountingOutput out = std::set_intersection(largeSet.begin(), largeSet.end(), smallSet.begin(), smallSet.end(),
+                                                   CountingOutput{});
+        benchmark::DoNotOptimize(out.count);
+    }
+}
+
+BENCHMARK(SetIntersect)->ArgsProduct({{4000000}, {1, 16, 256}})->Unit(benchmark::kMillisecond);
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/// Cost of building and of tearing down a tree. The heap variant gets every child block
+/// from posix_memalign, the arena variants carve them out of a per-tree NodeArena
+
+static Kset::Node* makeRoot(bool useArena, bool hugePages) {
+    return useArena ? Kset::make_tree(hugePages) : new Kset::Node{};
+}
+
+static void KsetInsert(benchmark::State& state, bool useArena, bool hugePages) {
+    const int size = static_cast<int>(state.range(0));
+    std::mt19937_64 gen(bench_seed);
+    std::uniform_int_distribution<int64_t> dis{0,std::numeric_limits<int64_t>::max()};
+    for (auto _ : state) {
+        Kset::Node* root = makeRoot(useArena, hugePages);
+        for (int i = 0; i < size; ++i) {
+            Kset::insert(root, dis(gen));
+        }
+        state.PauseTiming();
+        delete root;
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+BENCHMARK_CAPTURE(KsetInsert, heap, false, false)->RangeMultiplier(2)->Range(1000000, 32000000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(KsetInsert, arena, true, false)->RangeMultiplier(2)->Range(1000000, 32000000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(KsetInsert, arena_hugepages, true, true)->RangeMultiplier(2)->Range(1000000, 32000000)->Unit(benchmark::kMillisecond);
+
+static void KsetTeardown(benchmark::State& state, bool useArena, bool hugePages) {
+    const int size = static_cast<int>(state.range(0));
+    std::mt19937_64 gen(bench_seed);
+    std::uniform_int_distribution<int64_t> dis{0,std::numeric_limits<int64_t>::max()};
+    for (auto _ : state) {
+        state.PauseTiming();
+        Kset::Node* root = makeRoot(useArena, hugePages);
+        for (int i = 0; i < size; ++i) {
+            Kset::insert(root, dis(gen));
+        }
+        state.ResumeTiming();
+        delete root;
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+//The timed region is tiny compared to the build, so pin the iterations or we would rebuild the tree forever
+BENCHMARK_CAPTURE(KsetTeardown, heap, false, false)->RangeMultiplier(2)->Range(1000000, 32000000)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(KsetTeardown, arena, true, false)->RangeMultiplier(2)->Range(1000000, 32000000)->Iterations(1)->Unit(benchmark::kMillisecond);
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/// Lookups from 1..all cores while one writer keeps inserting random values. ConcurrentKset
+/// readers go lock free, the baseline takes a global mutex around a plain tree
+
+static const int concurrent_set_size = 4000000;
+static const int concurrent_batch = 1000;
+
+static Kset::ConcurrentKset& sharedConcurrentSet() {
+    static Kset::ConcurrentKset* set = []() {
+        auto* set = new Kset::ConcurrentKset();
+        std::mt19937_64 gen(bench_seed);
+        std::uniform_int_distribution<int64_t> dis{0,std::numeric_limits<int64_t>::max()};
+        for (int i = 0; i < concurrent_set_size; ++i) {
+            set->insert(dis(gen));
+        }
+        return set;
+    }();
+    return *set;
+}
+
+struct MutexKset {
+    std::mutex mutex;
+    Kset::Node* root = Kset::make_tree();
+};
+
+static MutexKset& sharedMutexSet() {
+    static MutexKset* set = []() {
+        auto* set = new MutexKset();
+        std::mt19937_64 gen(bench_seed);
+        std::uniform_int_distribution<int64_t> dis{0,std::numeric_limits<int64_t>::max()};
+        for (int i = 0; i < concurrent_set_size; ++i) {
+            Kset::insert(set->root, dis(gen));
+        }
+        return set;
+    }();
+    return *set;
+}
+
+template<class InsertFn>
+class BackgroundWriter {
+public:
+    explicit BackgroundWriter(InsertFn insertFn) : insertFn_(insertFn) {}
+
+    void start() {
+        stop_ = false;
+        thread_ = std::thread([this]() {
+            std::mt19937_64 gen(bench_seed);
+            std::uniform_int_distribution<int64_t> dis{0,std::numeric_limits<int64_t>::max()};
+            while(!stop_.load(std::memory_order_relaxed)) {
+                insertFn_(dis(gen));
+            }
+        });
+    }
+
+    void stop() {
+        stop_ = true;
+        thread_.join();
+    }
+
+private:
+    InsertFn insertFn_;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+};
+
+template<class InsertFn>
+static BackgroundWriter<InsertFn>* makeWriter(InsertFn insertFn) {
+    return new BackgroundWriter<InsertFn>(insertFn);
+}
+
+static std::vector<int64_t> randomKeys(int size, int seed) {
+    std::mt19937_64 gen(seed);
+    std::uniform_int_distribution<int64_t> dis{0,std::numeric_limits<int64_t>::max()};
+    std::vector<int64_t> keys(size);
+    for (auto& key : keys) {
+        key = dis(gen);
+    }
+    return keys;
+}
+
+static void ConcurrentReaders(benchmark::State& state) {
+    Kset::ConcurrentKset& set = sharedConcurrentSet();
+    static auto* writer = makeWriter([&set](int64_t val) { set.insert(val); });
+    if(state.thread_index() == 0) {
+        writer->start();
+    }
+
+    Kset::ConcurrentKset::Reader reader(set);
+    const std::vector<int64_t> keys = randomKeys(concurrent_batch, state.thread_index());
+    for (auto _ : state) {
+        for (int64_t key : keys) {
+            benchmark::DoNotOptimize(reader.find(key));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * concurrent_batch);
+
+    if(state.thread_index() == 0) {
+        writer->stop();
+    }
+}
+
+BENCHMARK(ConcurrentReaders)->ThreadRange(1, std::max(1u, std::thread::hardware_concurrency()))->UseRealTime();
+
+static void MutexReaders(benchmark::State& state) {
+    MutexKset& set = sharedMutexSet();
+    static auto* writer = makeWriter([&set](int64_t val) {
+        std::lock_guard<std::mutex> lock(set.mutex);
+        Kset::insert(set.root, val);
+    });
+    if(state.thread_index() == 0) {
+        writer->start();
+    }
+
+    const std::vector<int64_t> keys = randomKeys(concurrent_batch, state.thread_index());
+    for (auto _ : state) {
+        for (int64_t key : keys) {
+            std::lock_guard<std::mutex> lock(set.mutex);
+            benchmark::DoNotOptimize(Kset::find(set.root, key));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * concurrent_batch);
+
+    if(state.thread_index() == 0) {
+        writer->stop();
+    }
+}
+
+BENCHMARK(MutexReaders)->ThreadRange(1, std::max(1u, std::thread::hardware_concurrency()))->UseRealTime();
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/// Random inserts from 1..all cores into one set that starts out with concurrent_insert_preload
+/// values. Each thread has its own ConcurrentKset::Writer. The baseline takes a global mutex
+
+static const int concurrent_insert_preload = 1000000;
+
+static std::unique_ptr<Kset::ConcurrentKset> insertSet;
+
+static void setupConcurrentInsert(const benchmark::State&) {
+    insertSet.reset(new Kset::ConcurrentKset());
+    for (int64_t key : randomKeys(concurrent_insert_preload, 1234)) {
+        insertSet->insert(key);
+    }
+}
+
+static void teardownConcurrentInsert(const benchmark::State&) {
+    insertSet.reset();
+}
+
+static void ConcurrentInsert(benchmark::State& state) {
+    Kset::ConcurrentKset::Writer writer(*insertSet);
+    std::mt19937_64 gen(state.thread_index() + 1);
+    std::uniform_int_distribution<int64_t> dis{0,std::numeric_limits<int64_t>::max()};
+    for (auto _ : state) {
+        for (int i = 0; i < concurrent_batch; ++i) {
+            benchmark::DoNotOptimize(writer.insert(dis(gen)));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * concurrent_batch);
+}
+
+BENCHMARK(ConcurrentInsert)->Setup(setupConcurrentInsert)->Teardown(teardownConcurrentInsert)
+    ->ThreadRange(1, std::max(1u, std::thread::hardware_concurrency()))->UseRealTime();
+
+static std::unique_ptr<MutexKset> mutexInsertSet;
+
+static void setupMutexInsert(const benchmark::State&) {
+    mutexInsertSet.reset(new MutexKset());
+    for (int64_t key : randomKeys(concurrent_insert_preload, 1234)) {
+        Kset::insert(mutexInsertSet->root, key);
+    }
+}
+
+static void teardownMutexInsert(const benchmark::State&) {
+    delete mutexInsertSet->root;
+    mutexInsertSet.reset();
+}
+
+static void MutexInsert(benchmark::State& state) {
+    std::mt19937_64 gen(state.thread_index() + 1);
+    std::uniform_int_distribution<int64_t> dis{0,std::numeric_limits<int64_t>::max()};
+    for (auto _ : state) {
+        for (int i = 0; i < concurrent_batch; ++i) {
+            int64_t key = dis(gen);
+            std::lock_guard<std::mutex> lock(mutexInsertSet->mutex);
+            benchmark::DoNotOptimize(Kset::insert(mutexInsertSet->root, key));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * concurrent_batch);
+}
+
+BENCHMARK(MutexInsert)->Setup(setupMutexInsert)->Teardown(teardownMutexInsert)
+    ->ThreadRange(1, std::max(1u, std::thread::hardware_concurrency()))->UseRealTime();
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/// The same random inserts into a ShardedKset of 2^sharded_bits shards, one value at a time or
+/// concurrent_batch values per insert_batch() (which takes every shard's lock once). The keys
+/// are all positive, so with Partition::high_bits they only go to half the shards
+
+static const unsigned sharded_bits = 6;
+
+static std::unique_ptr<Kset::ShardedKset> shardedInsertSet;
+
+template<Kset::ShardedKset::Partition partition>
+static void setupShardedInsert(const benchmark::State&) {
+    shardedInsertSet.reset(new Kset::ShardedKset(sharded_bits, partition));
+    const std::vector<int64_t> preload = randomKeys(concurrent_insert_preload, 1234);
+    shardedInsertSet->insert_batch(preload.data(), preload.size());
+}
+
+static void teardownShardedInsert(const benchmark::State&) {
+    shardedInsertSet.reset();
+}
+
+static void ShardedInsert(benchmark::State& state, bool batched) {
+    std::mt19937_64 gen(state.thread_index() + 1);
+    std::uniform_int_distribution<int64_t> dis{0,std::numeric_limits<int64_t>::max()};
+    std::vector<int64_t> batch(concurrent_batch);
+    for (auto _ : state) {
+        for (int64_t& key : batch) {
+            key = dis(gen);
+        }
+        if (batched) {
+            benchmark::DoNotOptimize(shardedInsertSet->insert_batch(batch.data(), batch.size()));
+        } else {
+            for (int64_t key : batch) {
+                benchmark::DoNotOptimize(shardedInsertSet->insert(key));
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * concurrent_batch);
+}
+
+BENCHMARK_CAPTURE(ShardedInsert, hash, false)
+    ->Setup(setupShardedInsert<Kset::ShardedKset::Partition::hash>)->Teardown(teardownShardedInsert)
+    ->ThreadRange(1, std::max(1u, std::thread::hardware_concurrency()))->UseRealTime();
+BENCHMARK_CAPTURE(ShardedInsert, hash_batch, true)
+    ->Setup(setupShardedInsert<Kset::ShardedKset::Partition::hash>)->Teardown(teardownShardedInsert)
+    ->ThreadRange(1, std::max(1u, std::thread::hardware_concurrency()))->UseRealTime();
+BENCHMARK_CAPTURE(ShardedInsert, high_bits_batch, true)
+    ->Setup(setupShardedInsert<Kset::ShardedKset::Partition::high_bits>)->Teardown(teardownShardedInsert)
+    ->ThreadRange(1, std::max(1u, std::thread::hardware_concurrency()))->UseRealTime();
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/// Sequential IDs (interleaved across the threads) one at a time, which under
+/// Partition::high_bits all go to the same shard. Single inserts use insert_balanced(), so
+/// the shard stays shallow instead of growing into a chain
+
+static std::atomic<int64_t> nextShardedId{0};
+
+static void ShardedInsertSequential(benchmark::State& state) {
+    for (auto _ : state) {
+        int64_t first = nextShardedId.fetch_add(concurrent_batch);
+        for (int64_t id = first; id < first + concurrent_batch; ++id) {
+            benchmark::DoNotOptimize(shardedInsertSet->insert(id));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * concurrent_batch);
+}
+
+BENCHMARK(ShardedInsertSequential)
+    ->Setup(setupShardedInsert<Kset::ShardedKset::Partition::high_bits>)->Teardown(teardownShardedInsert)
+    ->ThreadRange(1, std::max(1u, std::thread::hardware_concurrency()))->UseRealTime();
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/// int64 -> int64 maps: KMap, std::map, and a Kset for the order next to a std::unordered_map
+/// for the payloads (which takes two lookups). Random inserts, then lookups of present keys
+
+struct KMapUnderTest {
+    Kset::KMap map;
+
+    void insert(int64_t key, int64_t payload) {
+        map.insert_or_assign(key, payload);
+    }
+
+    int64_t find(int64_t key) const {
+        return std::get<0>(map.find(key));
+    }
+};
+
+struct StdMapUnderTest {
+    std::map<int64_t, int64_t> map;
+
+    void insert(int64_t key, int64_t payload) {
+        map[key] = payload;
+    }
+
+    int64_t find(int64_t key) const {
+        auto itr = map.find(key);
+        return itr == map.end() ? -1 : itr->second;
+    }
+};
+
+struct KsetHashUnderTest {
+    std::unique_ptr<Kset::Node> root{Kset::make_tree()};
+    std::unordered_map<int64_t, int64_t> payloads;
+
+    void insert(int64_t key, int64_t payload) {
+        Kset::insert(root.get(), key);
+        payloads[key] = payload;
+    }
+
+    int64_t find(int64_t key) const {
+        if(!std::get<2>(Kset::find(root.get(), key))) {
+            return -1;
+        }
+        return payloads.find(key)->second;
+    }
+};
+
+template<class Map>
+static void MapInsert(benchmark::State& state) {
+    const std::vector<int64_t> keys = randomKeys(static_cast<int>(state.range(0)), bench_seed);
+    for (auto _ : state) {
+        std::unique_ptr<Map> map{new Map};
+        for (size_t i = 0; i < keys.size(); i++) {
+            map->insert(keys[i], static_cast<int64_t>(i));
+        }
+        state.PauseTiming();
+        map.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+template<class Map>
+static void MapLookup(benchmark::State& state) {
+    const std::vector<int64_t> keys = randomKeys(static_cast<int>(state.range(0)), bench_seed);
+    Map map;
+    for (size_t i = 0; i < keys.size(); i++) {
+        map.insert(keys[i], static_cast<int64_t>(i));
+    }
+    std::vector<int64_t> probes(keys);
+    std::shuffle(probes.begin(), probes.end(), std::mt19937_64(bench_seed));
+    PerfCounters counters;
+    for (auto _ : state) {
+        for (int64_t probe : probes) {
+            benchmark::DoNotOptimize(map.find(probe));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * probes.size());
+    counters.report(state, state.iterations() * probes.size());
+}
+
+BENCHMARK_TEMPLATE(MapInsert, KMapUnderTest)->RangeMultiplier(4)->Range(1000000, 16000000)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(MapInsert, StdMapUnderTest)->RangeMultiplier(4)->Range(1000000, 16000000)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(MapInsert, KsetHashUnderTest)->RangeMultiplier(4)->Range(1000000, 16000000)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(MapLookup, KMapUnderTest)->RangeMultiplier(4)->Range(1000000, 16000000)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(MapLookup, StdMapUnderTest)->RangeMultiplier(4)->Range(1000000, 16000000)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(MapLookup, KsetHashUnderTest)->RangeMultiplier(4)->Range(1000000, 16000000)->Unit(benchmark::kMillisecond);
 
 ////////////////////////////////////////////////////////////////////////////////////////////
 
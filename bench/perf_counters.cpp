@@ -0,0 +1,83 @@
+#include "perf_counters.h"
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+
+namespace {
+
+struct Event {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+};
+
+constexpr uint64_t cacheMisses(uint64_t cache) {
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+const Event events[] = {
+    {"l1d_miss", PERF_TYPE_HW_CACHE, cacheMisses(PERF_COUNT_HW_CACHE_L1D)},
+    {"llc_miss", PERF_TYPE_HW_CACHE, cacheMisses(PERF_COUNT_HW_CACHE_LL)},
+    {"dtlb_miss", PERF_TYPE_HW_CACHE, cacheMisses(PERF_COUNT_HW_CACHE_DTLB)},
+    {"branch_miss", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+};
+
+int openEvent(const Event& event) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event.type;
+    attr.config = event.config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    //This thread, on whichever cpu it runs
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+}
+
+PerfCounters::PerfCounters() {
+    static_assert(sizeof(events) / sizeof(events[0]) == num_events, "one fd per event");
+    for(int i = 0; i < num_events; i++) {
+        fds_[i] = openEvent(events[i]);
+    }
+    for(int fd : fds_) {
+        if(fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+PerfCounters::~PerfCounters() {
+    for(int fd : fds_) {
+        if(fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+void PerfCounters::report(benchmark::State& state, int64_t ops) {
+    for(int fd : fds_) {
+        if(fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    if(ops <= 0) {
+        return;
+    }
+    for(int i = 0; i < num_events; i++) {
+        //value, time enabled, time running
+        uint64_t values[3];
+        if(fds_[i] < 0 || read(fds_[i], values, sizeof(values)) != sizeof(values) || values[2] == 0) {
+            continue;
+        }
+        double count = double(values[0]) * double(values[1]) / double(values[2]);
+        state.counters[events[i].name] = count / ops;
+    }
+}
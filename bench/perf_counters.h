@@ -0,0 +1,37 @@
+#pragma once
+
+#include "benchmark/benchmark.h"
+#include <cstdint>
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/// Hardware counters for the benchmarks, read through perf_event_open(2).
+///
+/// A PerfCounters starts counting for the calling thread (user space only) when it is made, and
+/// report() stops and adds the counts over a number of operations to a benchmark's counters:
+///   l1d_miss, llc_miss, dtlb_miss, branch_miss, instructions: per operation
+/// Events that the kernel or the CPU cannot count (no PMU in a VM, perf_event_paranoid too high, ...)
+/// are left out, so the benchmarks still run anywhere. When the kernel has to multiplex the
+/// counters, the counts are scaled up by the share of time each one was actually counting.
+///
+/// Setup is included in whatever the counters see unless it is done before the PerfCounters is made:
+///
+///     PerfCounters counters;
+///     for (auto _ : state) { ... }
+///     counters.report(state, state.iterations() * size);
+
+class PerfCounters {
+  public:
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    ///Stop counting and add the counts divided by ops to state.counters
+    void report(benchmark::State& state, int64_t ops);
+
+  private:
+    static constexpr int num_events = 5;
+
+    int fds_[num_events];
+};
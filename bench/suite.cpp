@@ -0,0 +1,569 @@
+#include "benchmark/benchmark.h"
+#include <kset/kset.h>
+#include <kset/kset_stats.h>
+#include "perf_counters.h"
+#include <set>
+#include <unordered_set>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <memory>
+#include <malloc.h>
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/// The Suite/ benchmarks: the same workloads run against a Kset and the usual alternatives
+/// (std::set, a sorted std::vector and std::unordered_set), for comparing them with each other.
+///
+/// Everything a benchmark needs is generated up front from fixed seeds, so that the timed loops
+/// only do the operations themselves and two runs see exactly the same keys and queries. Besides
+/// the throughput, every benchmark reports
+///   p50_ns, p99_ns, p999_ns: latency percentiles of single operations. These come from a separate
+///                            pass after the timed loop, which times each operation on its own
+///                            (minus what reading the clock costs)
+///   bytes_per_elem:          memory taken up by the structure over the number of elements in it.
+///                            For the std containers, this is what malloc hands out for them
+/// The Lookup and Scan benchmarks also report hardware counters per operation (see perf_counters.h)
+///
+/// The keys inserted are always even. A lookup miss is a key next to one that is present, which
+/// makes it as expensive as a hit (it has to go all the way down as well)
+
+namespace {
+
+constexpr uint64_t suite_seed = 0x5eed;
+
+///Queries cycle through an array of this many, so that generating them is not part of the timing
+constexpr size_t num_queries = size_t{1} << 20;
+
+///Operations timed one at a time for the percentiles
+constexpr size_t num_samples = size_t{1} << 17;
+
+enum class Keys { random, sequential, zipf, clustered };
+
+const char* keysName(Keys kind) {
+    switch(kind) {
+    case Keys::random: return "random";
+    case Keys::sequential: return "sequential";
+    case Keys::zipf: return "zipf";
+    case Keys::clustered: return "clustered";
+    }
+    return "";
+}
+
+///Zipfian ranks in [0,n), rank 0 being the most frequent, with the method of Gray et al,
+///"Quickly generating billion-record synthetic databases" (as in YCSB)
+class Zipf {
+  public:
+    Zipf(uint64_t n, double theta)
+        : n_(n),
+          theta_(theta),
+          alpha_(1 / (1 - theta)),
+          zetan_(zeta(n, theta)),
+          eta_((1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta(2, theta) / zetan_))
+    {}
+
+    uint64_t operator()(std::mt19937_64& gen) {
+        double u = std::uniform_real_distribution<double>(0, 1)(gen);
+        double uz = u * zetan_;
+        if(uz < 1) {
+            return 0;
+        }
+        if(uz < 1 + std::pow(0.5, theta_)) {
+            return 1;
+        }
+        return std::min<uint64_t>(n_ - 1, static_cast<uint64_t>(n_ * std::pow(eta_ * u - eta_ + 1, alpha_)));
+    }
+
+  private:
+    static double zeta(uint64_t n, double theta) {
+        double sum{0};
+        for(uint64_t i = 1; i <= n; i++) {
+            sum += 1 / std::pow(double(i), theta);
+        }
+        return sum;
+    }
+
+    uint64_t n_;
+    double theta_;
+    double alpha_;
+    double zetan_;
+    double eta_;
+};
+
+///n keys to insert, in the order they are to be inserted. Zipfian keys repeat (the hot ones a lot)
+std::vector<int64_t> makeKeys(Keys kind, size_t n) {
+    std::mt19937_64 gen(suite_seed);
+    std::vector<int64_t> keys;
+    keys.reserve(n);
+    switch(kind) {
+    case Keys::random:
+        for(size_t i = 0; i < n; i++) {
+            keys.push_back(static_cast<int64_t>(gen() >> 2) * 2);
+        }
+        break;
+    case Keys::sequential:
+        for(size_t i = 0; i < n; i++) {
+            keys.push_back(static_cast<int64_t>(i) * 2);
+        }
+        break;
+    case Keys::zipf: {
+        //Scatter the ranks over the key space, so that the hot keys are not next to each other
+        Zipf zipf(n, 0.99);
+        for(size_t i = 0; i < n; i++) {
+            keys.push_back(static_cast<int64_t>((zipf(gen) * 0x9E3779B97F4A7C15ull) >> 2) * 2);
+        }
+        break;
+    }
+    case Keys::clustered:
+        //Runs of up to 256 keys a few apart, starting at random places
+        while(keys.size() < n) {
+            int64_t key = static_cast<int64_t>(gen() >> 3) * 2;
+            for(size_t run = 1 + gen() % 256; run && keys.size() < n; run--) {
+                keys.push_back(key);
+                key += 2 * (1 + gen() % 32);
+            }
+        }
+        break;
+    }
+    return keys;
+}
+
+///num_queries keys picked at random among keys, or the odd neighbours of those
+std::vector<int64_t> makeQueries(const std::vector<int64_t>& keys, bool hit) {
+    std::mt19937_64 gen(suite_seed + 1);
+    std::uniform_int_distribution<size_t> pick(0, keys.size() - 1);
+    std::vector<int64_t> queries(num_queries);
+    for(int64_t& query : queries) {
+        query = keys[pick(gen)] + (hit ? 0 : 1);
+    }
+    return queries;
+}
+
+///Times single operations for the percentiles
+class Latencies {
+  public:
+    Latencies() {
+        samples_.reserve(num_samples);
+        //What two reads of the clock cost on their own
+        std::vector<double> empty;
+        for(int i = 0; i < 1000; i++) {
+            auto start = Clock::now();
+            empty.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count());
+        }
+        std::nth_element(empty.begin(), empty.begin() + empty.size() / 2, empty.end());
+        overhead_ = empty[empty.size() / 2];
+    }
+
+    template<class Op>
+    void time(Op op) {
+        auto start = Clock::now();
+        op();
+        samples_.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count() - overhead_);
+    }
+
+    void report(benchmark::State& state) {
+        if(samples_.empty()) {
+            return;
+        }
+        std::sort(samples_.begin(), samples_.end());
+        state.counters["p50_ns"] = percentile(0.5);
+        state.counters["p99_ns"] = percentile(0.99);
+        state.counters["p999_ns"] = percentile(0.999);
+    }
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    double percentile(double p) const {
+        return std::max(0.0, samples_[std::min(samples_.size() - 1, static_cast<size_t>(p * samples_.size()))]);
+    }
+
+    std::vector<double> samples_;
+    double overhead_{0};
+};
+
+///Adds up what malloc really hands out for a std container (including its own header) in *bytes
+template<class T>
+struct CountingAllocator {
+    using value_type = T;
+
+    explicit CountingAllocator(size_t* bytes)
+        : bytes(bytes)
+    {}
+
+    template<class U>
+    CountingAllocator(const CountingAllocator<U>& other)
+        : bytes(other.bytes)
+    {}
+
+    T* allocate(size_t n) {
+        T* p = std::allocator<T>().allocate(n);
+        *bytes += malloc_usable_size(p) + sizeof(size_t);
+        return p;
+    }
+
+    void deallocate(T* p, size_t n) {
+        *bytes -= malloc_usable_size(p) + sizeof(size_t);
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template<class U>
+    bool operator==(const CountingAllocator<U>& other) const {
+        return bytes == other.bytes;
+    }
+
+    template<class U>
+    bool operator!=(const CountingAllocator<U>& other) const {
+        return bytes != other.bytes;
+    }
+
+    size_t* bytes;
+};
+
+//The structures under test. Each takes the keys with insert() and answers contains(), erase() and
+//scan(from, n), the sum of the first n keys >= from. Those that cannot answer something efficiently
+//(a sorted vector taking inserts, or an unordered set scanning) say so and are left out of it
+
+struct KsetStructure {
+    static constexpr const char* name = "Kset";
+    static constexpr bool dynamic = true;
+    static constexpr bool ordered = true;
+
+    Kset::Node* root{Kset::make_tree()};
+
+    ~KsetStructure() {
+        delete root;
+    }
+
+    void insert(int64_t key) {
+        Kset::insert(root, key);
+    }
+
+    bool erase(int64_t key) {
+        return Kset::erase(root, key);
+    }
+
+    bool contains(int64_t key) {
+        return std::get<2>(Kset::find(root, key));
+    }
+
+    int64_t scan(int64_t from, size_t n) {
+        int64_t sum{0};
+        for(Kset::Iterator itr = Kset::lower_bound(root, from); n && itr != Kset::end(root); ++itr, n--) {
+            sum += *itr;
+        }
+        return sum;
+    }
+
+    double bytesPerElem() const {
+        return Kset::stats(root).bytesPerValue();
+    }
+};
+
+struct KsetBalancedStructure : KsetStructure {
+    static constexpr const char* name = "KsetBalanced";
+
+    void insert(int64_t key) {
+        Kset::insert_balanced(root, key);
+    }
+};
+
+struct SetStructure {
+    static constexpr const char* name = "std::set";
+    static constexpr bool dynamic = true;
+    static constexpr bool ordered = true;
+
+    size_t bytes{0};
+    std::set<int64_t, std::less<int64_t>, CountingAllocator<int64_t>> set{CountingAllocator<int64_t>(&bytes)};
+
+    void insert(int64_t key) {
+        set.insert(key);
+    }
+
+    bool erase(int64_t key) {
+        return set.erase(key);
+    }
+
+    bool contains(int64_t key) {
+        return set.find(key) != set.end();
+    }
+
+    int64_t scan(int64_t from, size_t n) {
+        int64_t sum{0};
+        for(auto itr = set.lower_bound(from); n && itr != set.end(); ++itr, n--) {
+            sum += *itr;
+        }
+        return sum;
+    }
+
+    double bytesPerElem() const {
+        return double(bytes) / set.size();
+    }
+};
+
+struct UnorderedSetStructure {
+    static constexpr const char* name = "std::unordered_set";
+    static constexpr bool dynamic = true;
+    static constexpr bool ordered = false;
+
+    size_t bytes{0};
+    std::unordered_set<int64_t, std::hash<int64_t>, std::equal_to<int64_t>, CountingAllocator<int64_t>> set{
+        0, std::hash<int64_t>(), std::equal_to<int64_t>(), CountingAllocator<int64_t>(&bytes)};
+
+    void insert(int64_t key) {
+        set.insert(key);
+    }
+
+    bool erase(int64_t key) {
+        return set.erase(key);
+    }
+
+    bool contains(int64_t key) {
+        return set.find(key) != set.end();
+    }
+
+    int64_t scan(int64_t, size_t) {
+        return 0;
+    }
+
+    double bytesPerElem() const {
+        return double(bytes) / set.size();
+    }
+};
+
+///Built once with a sort, so it only takes part in the read only benchmarks
+struct SortedVectorStructure {
+    static constexpr const char* name = "sorted_vector";
+    static constexpr bool dynamic = false;
+    static constexpr bool ordered = true;
+
+    std::vector<int64_t> vec;
+
+    void insert(int64_t key) {
+        vec.push_back(key);
+    }
+
+    void seal() {
+        std::sort(vec.begin(), vec.end());
+        vec.erase(std::unique(vec.begin(), vec.end()), vec.end());
+        vec.shrink_to_fit();
+    }
+
+    bool erase(int64_t) {
+        return false;
+    }
+
+    bool contains(int64_t key) {
+        return std::binary_search(vec.begin(), vec.end(), key);
+    }
+
+    int64_t scan(int64_t from, size_t n) {
+        int64_t sum{0};
+        for(auto itr = std::lower_bound(vec.begin(), vec.end(), from); n && itr != vec.end(); ++itr, n--) {
+            sum += *itr;
+        }
+        return sum;
+    }
+
+    double bytesPerElem() const {
+        return double(vec.capacity() * sizeof(int64_t)) / vec.size();
+    }
+};
+
+template<class S>
+void seal(S&) {}
+
+void seal(SortedVectorStructure& s) {
+    s.seal();
+}
+
+template<class S>
+void fill(S& s, const std::vector<int64_t>& keys, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+        s.insert(keys[i]);
+    }
+    seal(s);
+}
+
+///Insert all the keys into an empty structure. The percentiles are those of the last num_samples
+///inserts, i.e. those into an almost full structure
+template<class S>
+void SuiteInsert(benchmark::State& state, Keys kind) {
+    const std::vector<int64_t> keys = makeKeys(kind, static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        std::unique_ptr<S> s{new S};
+        fill(*s, keys, keys.size());
+        state.PauseTiming();
+        s.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+
+    S s;
+    const size_t untimed = keys.size() - std::min(keys.size(), num_samples);
+    fill(s, keys, untimed);
+    Latencies latencies;
+    for(size_t i = untimed; i < keys.size(); i++) {
+        latencies.time([&]() { s.insert(keys[i]); });
+    }
+    latencies.report(state);
+    state.counters["bytes_per_elem"] = s.bytesPerElem();
+}
+
+template<class S>
+void SuiteLookup(benchmark::State& state, bool hit) {
+    const std::vector<int64_t> keys = makeKeys(Keys::random, static_cast<size_t>(state.range(0)));
+    const std::vector<int64_t> queries = makeQueries(keys, hit);
+    S s;
+    fill(s, keys, keys.size());
+
+    size_t q{0};
+    PerfCounters counters;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(s.contains(queries[q++ % num_queries]));
+    }
+    state.SetItemsProcessed(state.iterations());
+    counters.report(state, state.iterations());
+
+    Latencies latencies;
+    for(size_t i = 0; i < num_samples; i++) {
+        latencies.time([&]() { benchmark::DoNotOptimize(s.contains(queries[i])); });
+    }
+    latencies.report(state);
+    state.counters["bytes_per_elem"] = s.bytesPerElem();
+}
+
+///The 100 keys from a random place onwards
+template<class S>
+void SuiteScan(benchmark::State& state) {
+    constexpr size_t scan_length = 100;
+    const std::vector<int64_t> keys = makeKeys(Keys::random, static_cast<size_t>(state.range(0)));
+    const std::vector<int64_t> queries = makeQueries(keys, false);
+    S s;
+    fill(s, keys, keys.size());
+
+    size_t q{0};
+    PerfCounters counters;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(s.scan(queries[q++ % num_queries], scan_length));
+    }
+    state.SetItemsProcessed(state.iterations() * scan_length);
+    counters.report(state, state.iterations() * scan_length);
+
+    Latencies latencies;
+    for(size_t i = 0; i < num_samples; i++) {
+        latencies.time([&]() { benchmark::DoNotOptimize(s.scan(queries[i], scan_length)); });
+    }
+    latencies.report(state);
+    state.counters["bytes_per_elem"] = s.bytesPerElem();
+}
+
+///90% lookups (hits), 5% inserts of new keys and 5% erases of keys inserted earlier on, so that the
+///size stays about the same. The stream of operations is generated up front like the queries
+template<class S>
+void SuiteMixed(benchmark::State& state) {
+    enum class Op : uint8_t { find, insert, erase };
+    struct Step {
+        Op op;
+        int64_t key;
+    };
+
+    const std::vector<int64_t> keys = makeKeys(Keys::random, static_cast<size_t>(state.range(0)));
+    const std::vector<int64_t> hits = makeQueries(keys, true);
+    std::vector<Step> steps;
+    steps.reserve(num_queries);
+    std::mt19937_64 gen(suite_seed + 2);
+    std::vector<int64_t> inserted;
+    size_t erased{0};
+    for(size_t i = 0; i < num_queries; i++) {
+        unsigned dice = gen() % 100;
+        if(dice < 5) {
+            //Odd, so never one of keys
+            inserted.push_back(static_cast<int64_t>(gen() >> 2) * 2 + 1);
+            steps.push_back({Op::insert, inserted.back()});
+        } else if(dice < 10 && erased < inserted.size()) {
+            //The oldest insert that has not been erased yet
+            steps.push_back({Op::erase, inserted[erased++]});
+        } else {
+            steps.push_back({Op::find, hits[i]});
+        }
+    }
+
+    auto run = [](S& s, const Step& step) {
+        switch(step.op) {
+        case Op::find:
+            return s.contains(step.key);
+        case Op::insert:
+            s.insert(step.key);
+            return true;
+        case Op::erase:
+            return s.erase(step.key);
+        }
+        return false;
+    };
+
+    S s;
+    fill(s, keys, keys.size());
+    size_t q{0};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(run(s, steps[q++ % num_queries]));
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    Latencies latencies;
+    for(size_t i = 0; i < num_samples; i++) {
+        latencies.time([&]() { benchmark::DoNotOptimize(run(s, steps[q++ % num_queries])); });
+    }
+    latencies.report(state);
+    state.counters["bytes_per_elem"] = s.bytesPerElem();
+}
+
+template<class S>
+void registerStructure(const std::vector<int64_t>& sizes) {
+    auto add = [&sizes](benchmark::internal::Benchmark* b) {
+        for(int64_t size : sizes) {
+            b->Arg(size);
+        }
+    };
+    const std::string prefix = "Suite/";
+    const std::string suffix = std::string("/") + S::name;
+
+    if(S::dynamic) {
+        for(Keys kind : {Keys::random, Keys::sequential, Keys::zipf, Keys::clustered}) {
+            //Plain insert() builds a chain out of sorted input (see KsetLoadSorted)
+            if(std::string(S::name) == KsetStructure::name && kind == Keys::sequential) {
+                continue;
+            }
+            std::string name = prefix + "Insert/" + keysName(kind) + suffix;
+            add(benchmark::RegisterBenchmark(name.c_str(), &SuiteInsert<S>, kind)->Unit(benchmark::kMillisecond));
+        }
+    }
+    for(bool hit : {true, false}) {
+        std::string name = prefix + "Lookup/" + (hit ? "hit" : "miss") + suffix;
+        add(benchmark::RegisterBenchmark(name.c_str(), &SuiteLookup<S>, hit));
+    }
+    if(S::ordered) {
+        std::string name = prefix + "Scan" + suffix;
+        add(benchmark::RegisterBenchmark(name.c_str(), &SuiteScan<S>));
+    }
+    if(S::dynamic) {
+        std::string name = prefix + "Mixed" + suffix;
+        add(benchmark::RegisterBenchmark(name.c_str(), &SuiteMixed<S>));
+    }
+}
+
+bool registerSuite() {
+    const std::vector<int64_t> sizes = {int64_t{1} << 20, int64_t{1} << 24};
+    registerStructure<KsetStructure>(sizes);
+    registerStructure<KsetBalancedStructure>(sizes);
+    registerStructure<SetStructure>(sizes);
+    registerStructure<SortedVectorStructure>(sizes);
+    registerStructure<UnorderedSetStructure>(sizes);
+    return true;
+}
+
+const bool suite_registered = registerSuite();
+
+}
@@ -0,0 +1,99 @@
+#include "compact.h"
+#include "kset.h"
+#include "errors.h"
+#include <limits>
+
+namespace Kset {
+
+Compactor::Compactor(Node* root, bool useHugePages)
+    : next_(begin(root)),
+      root_(make_tree(useHugePages))
+{}
+
+Compactor::~Compactor() {
+    delete root_;
+}
+
+bool Compactor::step(size_t budget) {
+    size_t work{0};
+    while(work < budget && phase_ != Phase::done) {
+        if(phase_ == Phase::collect) {
+            work += collect(budget - work);
+            if(next_ == Iterator{}) {
+                pending_.push_back({root_, 0, vals_.size()});
+                phase_ = Phase::build;
+            }
+        } else {
+            work += build();
+            if(pending_.empty()) {
+                phase_ = Phase::done;
+            }
+        }
+    }
+    return done();
+}
+
+Node* Compactor::release() {
+    ASSERT(done());
+    Node* root = root_;
+    root_ = nullptr;
+    return root;
+}
+
+size_t Compactor::collect(size_t budget) {
+    size_t n{0};
+    for(; n < budget && next_ != Iterator{}; ++next_, n++) {
+        vals_.push_back(*next_);
+    }
+    return n;
+}
+
+///The same packing as bulk_load(): full subtrees from the left and the remainder in the last child. Only
+///here the children are queued instead of filled right away, the first child on top. So the blocks are
+///still allocated in depth first order
+size_t Compactor::build() {
+    const Pending p = pending_.back();
+    pending_.pop_back();
+    if(p.n <= Node::capacity) {
+        for(size_t i = 0; i < p.n; i++) {
+            p.node->append(vals_[p.first + i]);
+        }
+        return p.n;
+    }
+
+    const size_t childCap = packed_child_size(p.n);
+
+    p.node->expand(root_->arena());
+    size_t first = p.first;
+    size_t n = p.n;
+    Pending children[Node::capacity + 1];
+    NodeIdx_t numChildren{0};
+    for(; n > childCap; numChildren++) {
+        children[numChildren] = {p.node->children() + numChildren, first, childCap};
+#ifdef USE_ORDER_STATS
+        p.node->childCounts()[numChildren] = childCap;
+#endif
+        p.node->append(vals_[first + childCap]);
+        first += childCap + 1;
+        n -= childCap + 1;
+    }
+    if(n) {
+        children[numChildren] = {p.node->children() + numChildren, first, n};
+        numChildren++;
+    }
+#ifdef USE_ORDER_STATS
+    p.node->childCounts()[p.node->numValues()] = n;
+#endif
+    while(numChildren) {
+        pending_.push_back(children[--numChildren]);
+    }
+    return p.node->numValues();
+}
+
+Node* compact(Node* root, bool useHugePages) {
+    Compactor compactor(root, useHugePages);
+    while(!compactor.step(std::numeric_limits<size_t>::max())) {}
+    return compactor.release();
+}
+
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "kset_node.h"
+#include "kset_iterator.h"
+
+/**
+ * \ingroup Kset
+ */
+
+namespace Kset {
+
+/**
+ * @brief The Compactor class
+ *
+ * A tree that has seen a long run of random inserts and erases ends up with child blocks scattered all over
+ * its arena, most of them mostly empty (insert() expands a full leaf into a block of capacity+1 nodes of which
+ * it uses one), plus whatever tombstones erase() left behind. A Compactor rebuilds such a tree into a fresh
+ * arena with the same layout as bulk_load(): every node full except along the right spine, no tombstones,
+ * and the child blocks allocated in depth first order, so that every subtree lies in one contiguous stretch
+ * of the arena and a descent keeps moving forward through memory.
+ *
+ * The work is done in bounded slices, so that it can be interleaved with serving lookups from the old tree:
+ *
+ *     Compactor compactor(root);
+ *     while(!compactor.step(10000)) {
+ *         //serve some lookups from root
+ *     }
+ *     std::unique_ptr<Node> compacted{compactor.release()};
+ *
+ * First the live values are copied out of the old tree, then the new tree is filled from that copy, a node
+ * at a time. The old tree must not be changed while this runs (reading it is fine). Changes that come in in
+ * the meantime can be queued and applied to the new tree once it is done.
+ */
+
+class Compactor {
+  public:
+    ///Start compacting the tree rooted at root. Nothing is done till step()
+    explicit Compactor(Node* root, bool useHugePages = false);
+
+    ///Deletes the new tree unless it was released
+    ~Compactor();
+
+    Compactor(const Compactor&) = delete;
+    Compactor& operator=(const Compactor&) = delete;
+
+    ///Do about budget values worth of work. Returns true once the new tree is complete
+    bool step(size_t budget);
+
+    bool done() const {
+        return phase_ == Phase::done;
+    }
+
+    ///Hand over the root of the new tree, which can then be used like one from make_tree(). Must be done()
+    Node* release();
+
+  private:
+    enum class Phase { collect, build, done };
+
+    ///A node of the new tree that is to be filled with the n values of vals_ starting at first
+    struct Pending {
+        Node* node;
+        size_t first;
+        size_t n;
+    };
+
+    ///Copy up to budget live values out of the old tree. Returns the number copied
+    size_t collect(size_t budget);
+
+    ///Fill the next pending node. Returns the number of values placed in it
+    size_t build();
+
+    Phase phase_{Phase::collect};
+    Iterator next_;
+    std::vector<val_t> vals_;
+    std::vector<Pending> pending_;
+    Node* root_{nullptr};
+};
+
+///Compact the tree rooted at root in one go (see Compactor). Returns the root of the new tree,
+///delete it to release the tree
+Node* compact(Node* root, bool useHugePages = false);
+
+}
@@ -0,0 +1,263 @@
+#include "compressed_kset.h"
+#include "kset_iterator.h"
+#include <limits>
+#include <algorithm>
+#include <vector>
+#include <cstring>
+#include <new>
+
+#ifdef USE_SIMD
+#include <immintrin.h>
+#endif
+
+namespace Kset {
+
+using Line = CompressedKset::Line;
+using Encoding = CompressedKset::Encoding;
+
+namespace {
+
+constexpr unsigned max_count_delta16 = 28;
+constexpr unsigned max_count_delta32 = 14;
+constexpr unsigned max_count_plain = 7;
+
+uint64_t distance(val_t from, val_t to) {
+    return static_cast<uint64_t>(to) - static_cast<uint64_t>(from);
+}
+
+///How many of the values in [first,last) fit in a line whose base is *first, if every value is
+///stored as its distance from the base and that must be <= maxDelta
+unsigned fitting(const val_t* first, const val_t* last, uint64_t maxDelta, unsigned maxCount) {
+    const size_t avail = std::min<size_t>(last - first, maxCount);
+    unsigned n = 1;
+    while(n < avail && distance(*first, first[n]) <= maxDelta) {
+        n++;
+    }
+    return n;
+}
+
+///Pick the encoding of the line that starts at *first, as the one that holds the most values
+std::tuple<Encoding, unsigned> planLine(const val_t* first, const val_t* last) {
+    const unsigned n16 = fitting(first, last, std::numeric_limits<uint16_t>::max(), max_count_delta16);
+    const unsigned n32 = fitting(first, last, std::numeric_limits<uint32_t>::max(), max_count_delta32);
+    const unsigned n64 = std::min<size_t>(last - first, max_count_plain);
+    if(n16 >= n32 && n16 >= n64) {
+        return std::make_tuple(Encoding::delta16, n16);
+    }
+    return n32 >= n64 ? std::make_tuple(Encoding::delta32, n32) : std::make_tuple(Encoding::plain, n64);
+}
+
+void fillLine(Line& line, const val_t* vals, Encoding encoding, unsigned count) {
+    //Padding is all ones, which is larger than any delta we compare against
+    std::memset(&line, 0xFF, sizeof(Line));
+    line.base = vals[0];
+    const uint16_t header = static_cast<uint16_t>(encoding) | (count << 2);
+    switch(encoding) {
+    case Encoding::delta16:
+        line.d16[0] = header;
+        for(unsigned i = 1; i < count; i++) {
+            line.d16[i] = distance(vals[0], vals[i]);
+        }
+        break;
+    case Encoding::delta32:
+        line.d32[0] = header;
+        for(unsigned i = 1; i < count; i++) {
+            line.d32[i] = distance(vals[0], vals[i]);
+        }
+        break;
+    case Encoding::plain:
+        //Here the padding has to be larger than any value instead
+        std::fill(line.d64, line.d64 + max_count_plain, std::numeric_limits<val_t>::max());
+        line.d64[0] = header;
+        std::copy(vals + 1, vals + count, line.d64 + 1);
+        break;
+    }
+}
+
+///The number of values in line that are < val
+
+unsigned rankScalar(const Line& line, val_t val) {
+    if(val <= line.base) {
+        return 0;
+    }
+    const uint64_t d = distance(line.base, val);
+    unsigned rank = 1;
+    switch(line.encoding()) {
+    case Encoding::delta16:
+        if(d > std::numeric_limits<uint16_t>::max()) {
+            return line.count();
+        }
+        for(unsigned i = 1; i < line.count(); i++) {
+            rank += line.d16[i] < d;
+        }
+        break;
+    case Encoding::delta32:
+        if(d > std::numeric_limits<uint32_t>::max()) {
+            return line.count();
+        }
+        for(unsigned i = 1; i < line.count(); i++) {
+            rank += line.d32[i] < d;
+        }
+        break;
+    case Encoding::plain:
+        for(unsigned i = 1; i < line.count(); i++) {
+            rank += line.d64[i] < val;
+        }
+        break;
+    }
+    return rank;
+}
+
+#ifdef USE_SIMD
+
+//See the find kernels in kset_node.cpp for why these carry target attributes. The deltas are unsigned and AVX2 only
+//has signed compares, so x < d is done as min(x, d-1) == x, while plain values are compared as they are. The whole
+//line is compared, and the lanes of the base and of the header are masked out of the result. The AVX-512 kernel of
+//Node::find() has no counterpart here, a line is only two AVX2 loads anyway
+
+__attribute__((target("avx2")))
+unsigned rankAvx2(const Line& line, val_t val) {
+    if(val <= line.base) {
+        return 0;
+    }
+    const uint64_t d = distance(line.base, val);
+    const __m256i* p = reinterpret_cast<const __m256i*>(&line);
+    const __m256i lo = _mm256_load_si256(p);
+    const __m256i hi = _mm256_load_si256(p + 1);
+    switch(line.encoding()) {
+    case Encoding::delta16: {
+        if(d > std::numeric_limits<uint16_t>::max()) {
+            return line.count();
+        }
+        const __m256i limit = _mm256_set1_epi16(static_cast<int16_t>(d - 1));
+        const uint32_t ltLo = _mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_min_epu16(lo, limit), lo));
+        const uint32_t ltHi = _mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_min_epu16(hi, limit), hi));
+        //2 bits per lane. Lanes 0-3 are the base and lane 4 the header
+        return 1 + (__builtin_popcount(ltLo & ~0x3FFu) + __builtin_popcount(ltHi)) / 2;
+    }
+    case Encoding::delta32: {
+        if(d > std::numeric_limits<uint32_t>::max()) {
+            return line.count();
+        }
+        const __m256i limit = _mm256_set1_epi32(static_cast<int32_t>(d - 1));
+        const uint32_t ltLo = _mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_min_epu32(lo, limit), lo));
+        const uint32_t ltHi = _mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_min_epu32(hi, limit), hi));
+        //4 bits per lane. Lanes 0-1 are the base and lane 2 the header
+        return 1 + (__builtin_popcount(ltLo & ~0xFFFu) + __builtin_popcount(ltHi)) / 4;
+    }
+    case Encoding::plain: {
+        const __m256i target = _mm256_set1_epi64x(val);
+        const unsigned ltLo = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(target, lo)));
+        const unsigned ltHi = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(target, hi)));
+        //1 bit per lane. Lane 0 is the base, which we know is < val, and lane 1 the header
+        return __builtin_popcount(ltLo & ~0x2u) + __builtin_popcount(ltHi);
+    }
+    }
+    return rankScalar(line, val);
+}
+
+#endif
+
+}
+
+val_t Line::at(unsigned idx) const {
+    if(idx == 0) {
+        return base;
+    }
+    switch(encoding()) {
+    case Encoding::delta16:
+        return static_cast<val_t>(static_cast<uint64_t>(base) + d16[idx]);
+    case Encoding::delta32:
+        return static_cast<val_t>(static_cast<uint64_t>(base) + d32[idx]);
+    case Encoding::plain:
+        break;
+    }
+    return d64[idx];
+}
+
+CompressedKset::CompressedKset(Line* lines, size_t numLines, size_t size, FrozenKset&& index)
+    : lines_(lines),
+      numLines_(numLines),
+      size_(size),
+      index_(std::move(index))
+{}
+
+template<unsigned (*Rank)(const Line&, val_t)>
+static std::tuple<size_t, unsigned> lowerBound(const Line* lines, size_t numLines, const FrozenKset& index, val_t val) {
+    if(numLines == 0) {
+        return std::make_tuple(0, 0);
+    }
+    //The line of val is the last one whose base is <= val, or the first line if there is none
+    const size_t atMost = val == std::numeric_limits<val_t>::max() ? index.size() : index.rank(val + 1);
+    size_t line = atMost ? atMost - 1 : 0;
+    unsigned idx = Rank(lines[line], val);
+    if(idx == lines[line].count()) {
+        line++;
+        idx = 0;
+    }
+    return std::make_tuple(line, idx);
+}
+
+std::tuple<size_t, unsigned> CompressedKset::lowerBound(val_t val) const {
+#ifdef USE_SIMD
+    //Follow whatever kernel Node::find() has been set to
+    if(Node::findKernel() != Node::FindKernel::scalar) {
+        return Kset::lowerBound<&rankAvx2>(lines_.get(), numLines_, index_, val);
+    }
+#endif
+    return Kset::lowerBound<&rankScalar>(lines_.get(), numLines_, index_, val);
+}
+
+std::tuple<val_t, bool> CompressedKset::successor(val_t val) const {
+    size_t line{0};
+    unsigned idx{0};
+    std::tie(line,idx) = lowerBound(val);
+    if(line < numLines_ && lines_[line].at(idx) == val) {
+        if(++idx == lines_[line].count()) {
+            line++;
+            idx = 0;
+        }
+    }
+    return line < numLines_ ? std::make_tuple(lines_[line].at(idx), true) : std::make_tuple(val_t{-1}, false);
+}
+
+size_t CompressedKset::numLines(Encoding encoding) const {
+    return std::count_if(lines_.get(), lines_.get() + numLines_,
+                         [encoding](const Line& line) { return line.encoding() == encoding; });
+}
+
+CompressedKset compress(const val_t* first, const val_t* last) {
+    ASSERT(std::is_sorted(first, last));
+    //Plan the lines once to know how many to allocate, and then again while filling them
+    size_t numLines = 0;
+    for(const val_t* p = first; p != last; numLines++) {
+        p += std::get<1>(planLine(p, last));
+    }
+
+    void* mem{nullptr};
+    if(numLines && posix_memalign(&mem, 64, numLines * sizeof(Line)) != 0) {
+        throw std::bad_alloc();
+    }
+    Line* lines = static_cast<Line*>(mem);
+    std::vector<val_t> bases;
+    bases.reserve(numLines);
+    size_t line = 0;
+    for(const val_t* p = first; p != last; line++) {
+        Encoding encoding;
+        unsigned count{0};
+        std::tie(encoding,count) = planLine(p, last);
+        fillLine(*new (lines + line) Line, p, encoding, count);
+        bases.push_back(*p);
+        p += count;
+    }
+    return CompressedKset(lines, numLines, last - first, freeze(bases.data(), bases.data() + bases.size()));
+}
+
+CompressedKset compress(const Node* root) {
+    //Iterator does not modify the tree
+    Node* tree = const_cast<Node*>(root);
+    std::vector<val_t> vals(begin(tree), end(tree));
+    return compress(vals.data(), vals.data() + vals.size());
+}
+
+}
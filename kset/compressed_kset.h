@@ -0,0 +1,140 @@
+#pragma once
+
+#include <memory>
+#include <tuple>
+#include <cstdlib>
+#include "kset_node.h"
+#include "frozen_kset.h"
+
+/**
+ * \ingroup Kset
+ */
+
+namespace Kset {
+
+/**
+ * @brief The CompressedKset class
+ *
+ * An immutable snapshot of a Kset, like FrozenKset, for sets whose values are clustered (IDs that an allocator
+ * hands out close to each other, addresses, timestamps). Both a Node and a FrozenKset leaf spend 8 bytes on every
+ * value. Here a leaf is a cache line that holds one full 64 bit base value followed by the differences of the
+ * next values from it, as 16 or as 32 bit numbers when they fit:
+ *
+ * x----8----x---2---x---2---x---2---x-- ... --x---2---x
+ * |  base   | header| delta1| delta2|         |delta27|      (Encoding::delta16, up to 28 values)
+ * x---------x-------x-------x-------x-- ... --x-------x
+ *
+ * With 32 bit deltas the header takes up the first 4 byte slot (up to 14 values), and when even those do not fit
+ * the line holds plain values with the header in the first 8 byte slot (up to 7 values). The header is the same
+ * 16 bits in all three cases: the encoding in the low 2 bits and the number of values above them. Which encoding a
+ * line gets is decided line by line while packing, as whichever holds the most of the next values. Unused slots
+ * are padded with all ones so that the SIMD kernels can compare the whole line without looking at the count.
+ *
+ * Finding the line of a value is a lookup in a FrozenKset of the line bases, which is about 1/28th of the
+ * size of the set for well clustered values. So besides taking less memory, a lookup also touches fewer lines.
+ * For uniformly spread values every line falls back to plain values and this takes a bit more than a FrozenKset.
+ */
+
+class CompressedKset {
+  public:
+    enum class Encoding : uint16_t { delta16 = 0, delta32 = 1, plain = 2 };
+
+    struct alignas(64) Line {
+        val_t base;
+        union {
+            uint16_t d16[28];
+            uint32_t d32[14];
+            val_t d64[7];
+        };
+
+        Encoding encoding() const {
+            return static_cast<Encoding>(d16[0] & 0x3);
+        }
+
+        ///Number of values in the line, including base
+        unsigned count() const {
+            return d16[0] >> 2;
+        }
+
+        val_t at(unsigned idx) const;
+    };
+    static_assert(sizeof(Line) == 64, "a Line is a cache line");
+
+    CompressedKset(CompressedKset&&) = default;
+    CompressedKset& operator=(CompressedKset&&) = default;
+
+    bool find(val_t val) const {
+        size_t line{0};
+        unsigned idx{0};
+        std::tie(line,idx) = lowerBound(val);
+        return line < numLines_ && lines_[line].at(idx) == val;
+    }
+
+    ///Smallest value >= val. Returns {val, true} or {-1, false} if there is none
+    std::tuple<val_t, bool> next_geq(val_t val) const {
+        size_t line{0};
+        unsigned idx{0};
+        std::tie(line,idx) = lowerBound(val);
+        return line < numLines_ ? std::make_tuple(lines_[line].at(idx), true) : std::make_tuple(val_t{-1}, false);
+    }
+
+    ///Smallest value > val. Returns {val, true} or {-1, false} if there is none
+    std::tuple<val_t, bool> successor(val_t val) const;
+
+    ///Call fn(val) for every value, in increasing order
+    template<class Fn>
+    void for_each(Fn fn) const {
+        for(size_t line = 0; line < numLines_; line++) {
+            for(unsigned idx = 0; idx < lines_[line].count(); idx++) {
+                fn(lines_[line].at(idx));
+            }
+        }
+    }
+
+    ///Number of values
+    size_t size() const {
+        return size_;
+    }
+
+    ///Number of leaf lines
+    size_t numLines() const {
+        return numLines_;
+    }
+
+    ///Number of leaf lines with each Encoding
+    size_t numLines(Encoding encoding) const;
+
+    ///Bytes taken up by the leaf lines and the index over them
+    size_t bytes() const {
+        return numLines_ * sizeof(Line) + index_.bytes();
+    }
+
+  private:
+    friend CompressedKset compress(const val_t* first, const val_t* last);
+
+    CompressedKset(Line* lines, size_t numLines, size_t size, FrozenKset&& index);
+
+    ///Position (line, index in the line) of the first value >= val. Line is numLines() if there is none
+    std::tuple<size_t, unsigned> lowerBound(val_t val) const;
+
+    struct Free {
+        void operator()(Line* p) const {
+            std::free(p);
+        }
+    };
+
+    std::unique_ptr<Line[], Free> lines_;
+    size_t numLines_{0};
+    size_t size_{0};
+
+    ///The base of every line
+    FrozenKset index_;
+};
+
+///Build a CompressedKset out of the strictly increasing values in [first,last)
+CompressedKset compress(const val_t* first, const val_t* last);
+
+///Build a CompressedKset out of the live values of the tree under root
+CompressedKset compress(const Node* root);
+
+}
@@ -0,0 +1,253 @@
+#include "concurrent_kset.h"
+#include "node_arena.h"
+#include <cstdlib>
+#include <new>
+
+namespace Kset {
+
+///Retired blocks are given back in batches, which keeps the cost of scanning the reader slots low
+static constexpr size_t reclaim_batch = 64;
+
+///Writers take this many blocks from the arena at a time, so they rarely contend for the arena
+static constexpr size_t spare_batch = 16;
+
+ConcurrentKset::ConcurrentKset(bool useHugePages)
+    : superRoot_(make_tree(useHugePages)),
+      arena_(superRoot_->arena()),
+      epoch_([this](void* block) { arena_->freeBlock(block); })
+{
+    superRoot_->expand(arena_);
+    sharedWriter_.reset(new Writer(*this));
+}
+
+ConcurrentKset::~ConcurrentKset() = default;
+
+void* ConcurrentKset::operator new(size_t size) {
+    void* memptr = nullptr;
+    if(posix_memalign(&memptr, alignof(ConcurrentKset), size) != 0) {
+        throw std::bad_alloc();
+    }
+    return memptr;
+}
+
+void ConcurrentKset::operator delete(void* p) {
+    free(p);
+}
+
+bool ConcurrentKset::insert(val_t val) {
+    std::lock_guard<std::mutex> lock(sharedWriterMutex_);
+    return sharedWriter_->insert(val);
+}
+
+bool ConcurrentKset::erase(val_t val) {
+    std::lock_guard<std::mutex> lock(sharedWriterMutex_);
+    return sharedWriter_->erase(val);
+}
+
+ConcurrentKset::Writer::Writer(ConcurrentKset& set)
+    : set_(set),
+      slot_(set.epoch_.registerReader())
+{}
+
+ConcurrentKset::Writer::~Writer() {
+    if(!spare_.empty()) {
+        std::lock_guard<std::mutex> lock(set_.arenaMutex_);
+        for(void* block : spare_) {
+            set_.arena_->freeBlock(block);
+        }
+    }
+    set_.epoch_.unregisterReader(slot_);
+}
+
+bool ConcurrentKset::Writer::insert(val_t val) {
+    Outcome outcome{Outcome::retry};
+    {
+        Pin pin(set_.epoch_, slot_);
+        while((outcome = tryInsert(val)) == Outcome::retry) {}
+    }
+    maybeReclaim();
+    return outcome == Outcome::changed;
+}
+
+bool ConcurrentKset::Writer::erase(val_t val) {
+    Pin pin(set_.epoch_, slot_);
+    Outcome outcome{Outcome::retry};
+    while((outcome = tryErase(val)) == Outcome::retry) {}
+    return outcome == Outcome::changed;
+}
+
+ConcurrentKset::Writer::Outcome ConcurrentKset::Writer::tryInsert(val_t val) {
+    Node* node{nullptr};
+    NodeIdx_t idx{invalid_idx};
+    bool found{false};
+    std::tie(node,idx,found) = Kset::find(set_.root(), val);
+    if(found) {
+        return Outcome::unchanged;
+    }
+
+    if(idx < node->numValues() && node->at(idx) == val) {
+        //A tombstone. The values of a node never change while it is reachable, only its tombstones do
+        if(!node->lock()) {
+            return Outcome::retry;
+        }
+        bool dead = !node->isLive(idx);
+        if(dead) {
+            node->revive(idx);
+        }
+        node->unlock();
+        return dead ? Outcome::changed : Outcome::retry;
+    }
+
+    if(!node->isFull() || node->hasTombstones()) {
+        return insertCopyOnWrite(node, val);
+    }
+
+    //node is a full leaf. Nobody can see the new block till it is published
+    if(!node->lock()) {
+        return Outcome::retry;
+    }
+    if(node->children() || node->hasTombstones()) {
+        node->unlock();
+        return Outcome::retry;
+    }
+    Node* block = Node::initBlock(allocBlock(), node);
+    block[idx].insert(val);
+    node->publishChildren(block);
+    node->unlock();
+    return Outcome::changed;
+}
+
+ConcurrentKset::Writer::Outcome ConcurrentKset::Writer::tryErase(val_t val) {
+    Node* node{nullptr};
+    NodeIdx_t idx{invalid_idx};
+    bool found{false};
+    std::tie(node,idx,found) = Kset::find(set_.root(), val);
+    if(!found) {
+        return Outcome::unchanged;
+    }
+
+    if(!node->lock()) {
+        return Outcome::retry;
+    }
+    bool live = node->isLive(idx);
+    if(live) {
+        node->kill(idx);
+    }
+    node->unlock();
+    return live ? Outcome::changed : Outcome::retry;
+}
+
+ConcurrentKset::Writer::Outcome ConcurrentKset::Writer::insertCopyOnWrite(Node* leaf, val_t val) {
+    //leaf may have been reached through a parent that has since been copied, in which case the lock fails
+    Node* parent = leaf->parent();
+    if(!parent->lock()) {
+        return Outcome::retry;
+    }
+    Node* oldBlock = parent->children();
+    if(leaf < oldBlock || leaf > oldBlock + Node::capacity) {
+        //leaf itself has been copied
+        parent->unlock();
+        return Outcome::retry;
+    }
+
+    //We copy the children_ words of the whole block, so none of them may change under us. A block is
+    //only replaced with its parent locked, so these nodes cannot be obsolete
+    for(NodeIdx_t i = 0; i <= Node::capacity; i++) {
+        bool locked = oldBlock[i].lock();
+        ASSERT(locked);
+        (void)locked;
+    }
+
+    //leaf may have grown a child block since we looked (its values cannot have changed). And if parent is
+    //itself a fresh copy, whoever made it may still be pointing our block at it. The copies we are about to
+    //make would then keep a ptr to the old, obsolete parent for good
+    const NodeIdx_t idx = static_cast<NodeIdx_t>(leaf - oldBlock);
+    bool adopted{true};
+    for(NodeIdx_t i = 0; i <= Node::capacity; i++) {
+        adopted = adopted && oldBlock[i].parent() == parent;
+    }
+    if(!adopted || leaf->children() || (leaf->isFull() && !leaf->hasTombstones())) {
+        for(NodeIdx_t i = 0; i <= Node::capacity; i++) {
+            oldBlock[i].unlock();
+        }
+        parent->unlock();
+        return Outcome::retry;
+    }
+
+    Node* block = parent->cloneChildren(allocBlock());
+    Node* copy = block + idx;
+    if(copy->isFull()) {
+        copy->purgeTombstones();
+    }
+    bool inserted{false};
+    std::tie(std::ignore,inserted) = copy->insert(val);
+    ASSERT(inserted);
+
+    //A reader climbing up from a grandchild may land in either copy. Both are consistent
+    for(NodeIdx_t i = 0; i <= Node::capacity; i++) {
+        block[i].adoptChildren();
+    }
+    parent->publishChildren(block);
+
+    //Writers waiting for the old nodes give up once they see this
+    for(NodeIdx_t i = 0; i <= Node::capacity; i++) {
+        oldBlock[i].markObsolete();
+    }
+    parent->unlock();
+    set_.epoch_.retire(slot_, oldBlock);
+    return Outcome::changed;
+}
+
+void* ConcurrentKset::Writer::allocBlock() {
+    if(spare_.empty()) {
+        std::lock_guard<std::mutex> lock(set_.arenaMutex_);
+        for(size_t i = 0; i < spare_batch; i++) {
+            spare_.push_back(set_.arena_->allocBlock());
+        }
+    }
+    void* block = spare_.back();
+    spare_.pop_back();
+    return block;
+}
+
+void ConcurrentKset::Writer::maybeReclaim() {
+    if(set_.epoch_.numRetired(slot_) >= reclaim_batch) {
+        std::lock_guard<std::mutex> lock(set_.arenaMutex_);
+        set_.epoch_.reclaim(slot_);
+    }
+}
+
+ConcurrentKset::Reader::Reader(ConcurrentKset& set)
+    : set_(set),
+      slot_(set.epoch_.registerReader())
+{}
+
+ConcurrentKset::Reader::~Reader() {
+    set_.epoch_.unregisterReader(slot_);
+}
+
+bool ConcurrentKset::Reader::find(val_t val) const {
+    Pin pin(set_.epoch_, slot_);
+    bool found{false};
+    std::tie(std::ignore,std::ignore,found) = Kset::find(set_.root(), val);
+    return found;
+}
+
+std::tuple<val_t, bool> ConcurrentKset::Reader::next_geq(val_t val) const {
+    Pin pin(set_.epoch_, slot_);
+    Node* node{nullptr};
+    val_t next{-1};
+    std::tie(node,std::ignore,next) = Kset::next_geq(set_.root(), val);
+    return std::make_tuple(next, node != nullptr);
+}
+
+std::tuple<val_t, bool> ConcurrentKset::Reader::successor(val_t val) const {
+    //A single descent, as in MappedKset. Kset::successor() from where next_geq() left us would work out
+    //our idx from the parent's children ptr, which a writer may have pointed at a copy of our block since
+    if(val == std::numeric_limits<val_t>::max()) {
+        return std::make_tuple(val_t{-1}, false);
+    }
+    return next_geq(val + 1);
+}
+
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "kset.h"
+#include "epoch.h"
+
+/**
+ * \ingroup Kset
+ */
+
+namespace Kset {
+
+/**
+ * @brief The ConcurrentKset class
+ *
+ * A Kset shared by many writers and readers, where readers take no locks and execute no atomic
+ * instructions while descending the tree. They only pin the current epoch once per operation.
+ *
+ * Readers must never see a node half way through a change, so writers never shift values around
+ * in a node that readers can reach. Instead:
+ * - Inserting into a leaf that has room builds a modified copy of the leaf's whole child block, points
+ *   the grandchildren at the copies, and then swaps the block in with a single store to the parent's
+ *   children ptr. The old block is retired to an EpochManager and handed back to the arena once no
+ *   reader can still be looking at it.
+ * - Inserting into a full leaf fills in a new child block before publishing it with a single store.
+ * - Erasing (and re-inserting an erased value) flips a tombstone bit, which is a single store too.
+ *
+ * Every change is therefore a single 8 byte store to the children_ word of some node, and a reader sees
+ * the tree either before or after it. This relies on x86_64 not reordering loads with other loads (or
+ * stores with other stores), which the rest of Kset already assumes. Writers grow the tree the way insert()
+ * does, not insert_balanced(), since a split moves values between nodes.
+ *
+ * Since readers never see a torn node, they need no version validation. Writers coordinate with a lock
+ * bit in the children_ word of each node (see Node::lock()), in the style of optimistic lock coupling:
+ * - A writer descends without taking any locks, like a reader does.
+ * - It then locks only the node whose children_ word it is going to change, or, when it replaces a child
+ *   block, the block's parent and the Node::capacity + 1 nodes of the block (whose children_ words it
+ *   copies). Locks are always taken top down and left to right, so writers cannot deadlock.
+ * - Once its block has been replaced, a node is marked obsolete. A writer that finds an obsolete node
+ *   after locking (or a node that has changed shape under it) starts over from the root.
+ * Writers that insert at different leaves therefore never touch the same lock.
+ *
+ * Since block slots must be able to move, the tree hangs off an empty "super root" whose first child
+ * is the actual root.
+ *
+ * Readers only ever descend. The parent ptrs of a block's children point at the copy that replaced it,
+ * so anything that climbs them (Kset::successor(), a Kset::Iterator on a deep path) may land in a block
+ * other than the one it came from while writers are active.
+ */
+
+class ConcurrentKset {
+  public:
+    explicit ConcurrentKset(bool useHugePages = false);
+
+    ///No readers or writers may be active any more
+    ~ConcurrentKset();
+
+    ConcurrentKset(const ConcurrentKset&) = delete;
+    ConcurrentKset& operator=(const ConcurrentKset&) = delete;
+
+    ///The EpochManager's slots are a cache line each, which plain new need not honor as of C++14 (see Node)
+    void* operator new(size_t size);
+    void operator delete(void* p);
+
+    ///Calls from several threads are serialized by a mutex and share one Writer. Threads that write
+    ///concurrently should each hold on to a Writer of their own. Returns true if val was inserted (erased)
+    bool insert(val_t val);
+    bool erase(val_t val);
+
+    /**
+     * @brief The Writer class
+     * A handle through which one thread at a time modifies the set. Any number of Writers may be
+     * active at once. Like a Reader, each Writer owns a slot in the EpochManager
+     */
+    class Writer {
+      public:
+        explicit Writer(ConcurrentKset& set);
+        ~Writer();
+
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        ///Returns true if val was inserted (erased)
+        bool insert(val_t val);
+        bool erase(val_t val);
+
+      private:
+        enum class Outcome {changed, unchanged, retry};
+
+        Outcome tryInsert(val_t val);
+        Outcome tryErase(val_t val);
+
+        ///Swap in a copy of the block of leaf in which val has been inserted into leaf
+        Outcome insertCopyOnWrite(Node* leaf, val_t val);
+
+        ///Raw memory for a block. Blocks are taken from the shared arena a batch at a time
+        void* allocBlock();
+
+        void maybeReclaim();
+
+        ConcurrentKset& set_;
+        unsigned slot_;
+        std::vector<void*> spare_;
+    };
+
+    /**
+     * @brief The Reader class
+     * A handle through which one thread at a time reads the set. Each Reader owns a slot in the
+     * EpochManager, of which there are EpochManager::max_readers
+     */
+    class Reader {
+      public:
+        explicit Reader(ConcurrentKset& set);
+        ~Reader();
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        bool find(val_t val) const;
+
+        ///Smallest value >= val. Returns {val, true} or {-1, false} if there is none
+        std::tuple<val_t, bool> next_geq(val_t val) const;
+
+        ///Smallest value > val. Returns {val, true} or {-1, false} if there is none
+        std::tuple<val_t, bool> successor(val_t val) const;
+
+        ///Call fn(val) for every value in [lo, hi), in increasing order. fn runs while the
+        ///epoch is pinned, so it should not block
+        ///
+        ///Not Kset::for_each_in_range(): on a path deeper than Iterator::max_depth its Iterator climbs
+        ///back up through parent ptrs, and a writer may have swapped in a copy of the block we are in
+        ///since, which the parent now points to instead. So we hold on to the whole path
+        template<class Fn>
+        void for_each_in_range(val_t lo, val_t hi, Fn fn) const {
+            Pin pin(set_.epoch_, slot_);
+            struct Frame {
+                Node* node;
+                NodeIdx_t idx;
+            };
+            std::vector<Frame> path;
+
+            //Down to where lo is or would be. Every frame waits on its child idx and then value idx
+            Node* node = set_.root();
+            while(true) {
+                NodeIdx_t idx{invalid_idx};
+                bool found{false};
+                std::tie(idx,found) = node->find(lo);
+                path.push_back({node, idx});
+                Node* child = node->children() ? node->children() + idx : nullptr;
+                if(found || !child || !child->numValues()) {
+                    break;
+                }
+                node = child;
+            }
+
+            bool enterChild{false};
+            while(!path.empty()) {
+                Frame& frame = path.back();
+                if(enterChild && frame.node->children()) {
+                    Node* child = frame.node->children() + frame.idx;
+                    if(child->numValues()) {
+                        path.push_back({child, 0});
+                        continue;
+                    }
+                }
+                if(frame.idx < frame.node->numValues()) {
+                    if(frame.node->isLive(frame.idx)) {
+                        val_t val = frame.node->at(frame.idx);
+                        if(val >= hi) {
+                            return;
+                        }
+                        fn(val);
+                    }
+                    frame.idx++;
+                    enterChild = true;
+                } else {
+                    path.pop_back();
+                    enterChild = false;
+                }
+            }
+        }
+
+      private:
+        ConcurrentKset& set_;
+        unsigned slot_;
+    };
+
+  private:
+    Node* root() const {
+        return superRoot_.get();
+    }
+
+    ///Keeps the epoch of slot pinned for the duration of an operation
+    struct Pin {
+        Pin(EpochManager& epoch, unsigned slot) : epoch_(epoch), slot_(slot) {
+            epoch_.pin(slot_);
+        }
+        ~Pin() {
+            epoch_.unpin(slot_);
+        }
+        EpochManager& epoch_;
+        unsigned slot_;
+    };
+
+    //Declared first so that the arena outlives the blocks that epoch_ still has to give back to it
+    std::unique_ptr<Node> superRoot_;
+    NodeArena* arena_;
+    ///Held by whoever allocates from or frees to arena_. Blocks are reclaimed with it held too
+    std::mutex arenaMutex_;
+    EpochManager epoch_;
+
+    std::mutex sharedWriterMutex_;
+    std::unique_ptr<Writer> sharedWriter_;
+};
+
+}
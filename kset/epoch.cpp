@@ -0,0 +1,85 @@
+#include "epoch.h"
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+
+namespace Kset {
+
+constexpr unsigned EpochManager::max_readers;
+constexpr uint64_t EpochManager::quiescent;
+
+EpochManager::EpochManager(Deleter deleter)
+    : deleter_(std::move(deleter))
+{}
+
+EpochManager::~EpochManager() {
+    for(const Slot& slot : slots_) {
+        for(const Retired& r : slot.retired) {
+            deleter_(r.ptr);
+        }
+    }
+    for(const Retired& r : orphans_) {
+        deleter_(r.ptr);
+    }
+}
+
+unsigned EpochManager::registerReader() {
+    for(unsigned i = 0; i < max_readers; i++) {
+        bool expected{false};
+        if(slots_[i].inUse.compare_exchange_strong(expected, true)) {
+            return i;
+        }
+    }
+    throw std::runtime_error("too many concurrent readers");
+}
+
+void EpochManager::unregisterReader(unsigned slot) {
+    std::vector<Retired>& retired = slots_[slot].retired;
+    if(!retired.empty()) {
+        std::lock_guard<std::mutex> lock(orphansMutex_);
+        orphans_.insert(orphans_.end(), retired.begin(), retired.end());
+        retired.clear();
+    }
+    slots_[slot].epoch.store(quiescent, std::memory_order_release);
+    slots_[slot].inUse.store(false, std::memory_order_release);
+}
+
+void EpochManager::retire(unsigned slot, void* p) {
+    slots_[slot].retired.push_back({p, global_.load(std::memory_order_relaxed)});
+}
+
+uint64_t EpochManager::oldestPinned() const {
+    uint64_t oldest = std::numeric_limits<uint64_t>::max();
+    for(const Slot& slot : slots_) {
+        uint64_t epoch = slot.epoch.load(std::memory_order_acquire);
+        if(epoch != quiescent) {
+            oldest = std::min(oldest, epoch);
+        }
+    }
+    return oldest;
+}
+
+void EpochManager::reclaim(std::vector<Retired>& retired, uint64_t oldest) {
+    auto stillVisible = std::partition(retired.begin(), retired.end(), [oldest](const Retired& r) {
+        return r.epoch >= oldest;
+    });
+    for(auto itr = stillVisible; itr != retired.end(); ++itr) {
+        deleter_(itr->ptr);
+    }
+    retired.erase(stillVisible, retired.end());
+}
+
+void EpochManager::reclaim(unsigned slot) {
+    //Threads that pin from now on cannot reach anything retired so far
+    global_.fetch_add(1, std::memory_order_seq_cst);
+
+    uint64_t oldest = oldestPinned();
+    reclaim(slots_[slot].retired, oldest);
+
+    std::unique_lock<std::mutex> lock(orphansMutex_, std::try_to_lock);
+    if(lock.owns_lock()) {
+        reclaim(orphans_, oldest);
+    }
+}
+
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <functional>
+#include <mutex>
+
+/**
+ * \ingroup Kset
+ */
+
+namespace Kset {
+
+/**
+ * @brief The EpochManager class
+ *
+ * Epoch based reclamation. A thread pins the current epoch for the duration of an operation. A writer
+ * stamps everything it unlinks with the epoch at which it was unlinked, and frees it only once no thread
+ * is pinned at that epoch or an older one, since only such a thread can still be looking at it.
+ *
+ * Pinning costs one store and a fence per operation. Nothing is paid per node visited. Each slot keeps
+ * its own list of retired pointers, so several writers can retire and reclaim without sharing a lock.
+ */
+
+class EpochManager {
+  public:
+    static constexpr unsigned max_readers = 256;
+
+    using Deleter = std::function<void(void*)>;
+
+    ///deleter is called for everything that gets reclaimed, by the thread that calls reclaim()
+    explicit EpochManager(Deleter deleter);
+
+    ///Reclaims everything that is still retired. No reader may be pinned any more
+    ~EpochManager();
+
+    EpochManager(const EpochManager&) = delete;
+    EpochManager& operator=(const EpochManager&) = delete;
+
+    ///Reserve a slot for a reader (or writer) thread. Throws if all max_readers slots are taken
+    unsigned registerReader();
+
+    ///Whatever the slot retired and could not reclaim yet is left for the other slots to reclaim
+    void unregisterReader(unsigned slot);
+
+    void pin(unsigned slot) {
+        slots_[slot].epoch.store(global_.load(std::memory_order_acquire), std::memory_order_relaxed);
+        //The writer must see our pin before we look at anything it might retire
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void unpin(unsigned slot) {
+        slots_[slot].epoch.store(quiescent, std::memory_order_release);
+    }
+
+    ///p has been unlinked and will be freed once no pinned thread can see it any more
+    void retire(unsigned slot, void* p);
+
+    ///Advance the epoch and free whatever the slot retired (plus what unregistered slots left
+    ///behind) that no pinned thread can still see
+    void reclaim(unsigned slot);
+
+    size_t numRetired(unsigned slot) const {
+        return slots_[slot].retired.size();
+    }
+
+  private:
+    static constexpr uint64_t quiescent = 0;
+
+    struct Retired {
+        void* ptr;
+        uint64_t epoch;
+    };
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch{quiescent};
+        std::atomic<bool> inUse{false};
+        ///Only touched by the thread that owns the slot
+        std::vector<Retired> retired;
+    };
+
+    uint64_t oldestPinned() const;
+
+    ///Free the entries of retired that were retired before oldest, and drop them from retired
+    void reclaim(std::vector<Retired>& retired, uint64_t oldest);
+
+    Deleter deleter_;
+    std::atomic<uint64_t> global_{1};
+    Slot slots_[max_readers];
+
+    ///What unregistered slots left behind
+    std::mutex orphansMutex_;
+    std::vector<Retired> orphans_;
+};
+
+}
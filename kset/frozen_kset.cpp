@@ -0,0 +1,146 @@
+#include "frozen_kset.h"
+#include "kset_iterator.h"
+#include <limits>
+#include <algorithm>
+#include <new>
+
+#ifdef USE_SIMD
+#include <immintrin.h>
+#endif
+
+namespace Kset {
+
+constexpr unsigned FrozenKset::keys_per_node;
+
+namespace {
+
+constexpr unsigned fanout = FrozenKset::keys_per_node + 1;
+
+size_t divUp(size_t a, size_t b) {
+    return (a + b - 1) / b;
+}
+
+///The number of keys in node that are < val. The node's keys are sorted, so this is also the branching point
+
+unsigned rankScalar(const val_t* node, val_t val) {
+    unsigned rank = 0;
+    for(unsigned i = 0; i < FrozenKset::keys_per_node; i++) {
+        rank += node[i] < val;
+    }
+    return rank;
+}
+
+#ifdef USE_SIMD
+
+//See the find kernels in kset_node.cpp for why these carry target attributes
+
+__attribute__((target("avx2")))
+unsigned rankAvx2(const val_t* node, val_t val) {
+    const __m256i target = _mm256_set1_epi64x(val);
+    __m256i lo = _mm256_cmpgt_epi64(target, _mm256_load_si256(reinterpret_cast<const __m256i*>(node)));
+    __m256i hi = _mm256_cmpgt_epi64(target, _mm256_load_si256(reinterpret_cast<const __m256i*>(node + 4)));
+    unsigned mask = _mm256_movemask_pd(_mm256_castsi256_pd(lo)) | (_mm256_movemask_pd(_mm256_castsi256_pd(hi)) << 4);
+    return __builtin_popcount(mask);
+}
+
+__attribute__((target("avx512f")))
+unsigned rankAvx512(const val_t* node, val_t val) {
+    __mmask8 lt = _mm512_cmplt_epi64_mask(_mm512_load_si512(node), _mm512_set1_epi64(val));
+    return __builtin_popcount(lt);
+}
+
+#endif
+
+}
+
+FrozenKset::FrozenKset(size_t size)
+    : size_(size)
+{
+    //Node counts per layer, bottom up, until a layer of a single node
+    std::vector<size_t> layerNodes{std::max<size_t>(1, divUp(size, keys_per_node))};
+    while(layerNodes.back() > 1) {
+        layerNodes.push_back(divUp(layerNodes.back(), fanout));
+    }
+
+    //Stored top down
+    layerOffsets_.resize(layerNodes.size());
+    for(size_t l = layerNodes.size(); l-- > 0;) {
+        layerOffsets_[l] = numKeys_;
+        numKeys_ += layerNodes[l] * keys_per_node;
+    }
+
+    void* mem{nullptr};
+    if(posix_memalign(&mem, 64, numKeys_ * sizeof(val_t)) != 0) {
+        throw std::bad_alloc();
+    }
+    keys_.reset(static_cast<val_t*>(mem));
+    std::fill(keys_.get(), keys_.get() + numKeys_, std::numeric_limits<val_t>::max());
+}
+
+void FrozenKset::buildLayers() {
+    //The smallest value under node b of layer l is the first value of its leftmost leaf, which is leaf b*9^l
+    size_t leavesPerNode = 1;
+    for(size_t l = 1; l < layerOffsets_.size(); l++) {
+        const size_t childLeaves = leavesPerNode;
+        leavesPerNode *= fanout;
+        //Layer l ends where the layer below it starts
+        const size_t numNodes = (layerOffsets_[l-1] - layerOffsets_[l]) / keys_per_node;
+        val_t* layer = keys_.get() + layerOffsets_[l];
+        for(size_t node = 0; node < numNodes; node++) {
+            for(unsigned i = 0; i < keys_per_node; i++) {
+                size_t leaf = (node * fanout + i + 1) * childLeaves;
+                if(leaf * keys_per_node < size_) {
+                    layer[node * keys_per_node + i] = leaves()[leaf * keys_per_node];
+                }
+            }
+        }
+    }
+}
+
+template<unsigned (*Rank)(const val_t*, val_t)>
+size_t FrozenKset::lowerBound(val_t val) const {
+    size_t node = 0;
+    for(size_t l = layerOffsets_.size() - 1; l > 0; l--) {
+        node = node * fanout + Rank(keys_.get() + layerOffsets_[l] + node * keys_per_node, val);
+    }
+    return node * keys_per_node + Rank(values() + node * keys_per_node, val);
+}
+
+size_t FrozenKset::lowerBound(val_t val) const {
+#ifdef USE_SIMD
+    //Follow whatever kernel Node::find() has been set to
+    switch(Node::findKernel()) {
+    case Node::FindKernel::avx512:
+        return lowerBound<&rankAvx512>(val);
+    case Node::FindKernel::avx2:
+        return lowerBound<&rankAvx2>(val);
+    case Node::FindKernel::scalar:
+        break;
+    }
+#endif
+    return lowerBound<&rankScalar>(val);
+}
+
+FrozenKset freeze(const Node* root) {
+    //Iterator does not modify the tree
+    Node* tree = const_cast<Node*>(root);
+    size_t size = 0;
+    for(Iterator itr = begin(tree); itr != end(tree); ++itr) {
+        size++;
+    }
+
+    FrozenKset frozen(size);
+    std::copy(begin(tree), end(tree), frozen.leaves());
+    frozen.buildLayers();
+    return frozen;
+}
+
+FrozenKset freeze(const val_t* first, const val_t* last) {
+    ASSERT(std::is_sorted(first, last));
+    FrozenKset frozen(last - first);
+    std::copy(first, last, frozen.leaves());
+    frozen.buildLayers();
+    return frozen;
+}
+
+}
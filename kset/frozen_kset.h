@@ -0,0 +1,120 @@
+#pragma once
+
+#include <memory>
+#include <tuple>
+#include <vector>
+#include <cstdlib>
+#include "kset_node.h"
+
+/**
+ * \ingroup Kset
+ */
+
+namespace Kset {
+
+/**
+ * @brief The FrozenKset class
+ *
+ * An immutable snapshot of a Kset for sets that are built once and then only queried. A Node spends 16 of its
+ * bytes on the children and parent ptrs, and expand() creates blocks of Node::capacity + 1 nodes that are
+ * mostly empty near the leaves. A FrozenKset has neither: it is a static B+ tree in one contiguous, cache line
+ * aligned array of keys, where every node is a cache line of 8 keys and the position of a child is computed
+ * rather than stored.
+ *
+ * - The leaf layer is just the sorted array of the (live) values, padded with INT64_MAX to a multiple of 8.
+ * - A node of an internal layer has 9 children, which are the consecutive nodes 9k..9k+8 of the layer below.
+ *   Its key i is the smallest value in the subtree of child i+1 (INT64_MAX if there is no such child).
+ * - The layers are stored top down, so the few lines that every lookup touches sit together.
+ *
+ * A lookup does one cache line per layer, counting the keys smaller than the one it looks for, and ends at the
+ * position of the first value >= it in the sorted array. That makes successor() a matter of looking at the next
+ * slot. It takes about 9 bytes per value, against about 35 for a tree built with insert() from random values.
+ */
+
+class FrozenKset {
+  public:
+    static constexpr unsigned keys_per_node = 8;
+
+    FrozenKset(FrozenKset&&) = default;
+    FrozenKset& operator=(FrozenKset&&) = default;
+
+    bool find(val_t val) const {
+        size_t idx = lowerBound(val);
+        return idx < size_ && values()[idx] == val;
+    }
+
+    ///Smallest value >= val. Returns {val, true} or {-1, false} if there is none
+    std::tuple<val_t, bool> next_geq(val_t val) const {
+        size_t idx = lowerBound(val);
+        return idx < size_ ? std::make_tuple(values()[idx], true) : std::make_tuple(val_t{-1}, false);
+    }
+
+    ///Smallest value > val. Returns {val, true} or {-1, false} if there is none
+    std::tuple<val_t, bool> successor(val_t val) const {
+        size_t idx = lowerBound(val);
+        if(idx < size_ && values()[idx] == val) {
+            idx++;
+        }
+        return idx < size_ ? std::make_tuple(values()[idx], true) : std::make_tuple(val_t{-1}, false);
+    }
+
+    ///Number of values < val, which is also the position of the first value >= val in values()
+    size_t rank(val_t val) const {
+        return lowerBound(val);
+    }
+
+    ///Number of values
+    size_t size() const {
+        return size_;
+    }
+
+    ///The values in increasing order
+    const val_t* values() const {
+        return keys_.get() + layerOffsets_[0];
+    }
+
+    ///Bytes taken up by all the layers
+    size_t bytes() const {
+        return numKeys_ * sizeof(val_t);
+    }
+
+  private:
+    friend FrozenKset freeze(const Node* root);
+    friend FrozenKset freeze(const val_t* first, const val_t* last);
+
+    ///Lays out the layers for size values. The caller fills in the leaf layer and then calls buildLayers()
+    explicit FrozenKset(size_t size);
+
+    val_t* leaves() {
+        return keys_.get() + layerOffsets_[0];
+    }
+
+    void buildLayers();
+
+    ///Position of the first value >= val in values() (size() if there is none)
+    size_t lowerBound(val_t val) const;
+
+    template<unsigned (*Rank)(const val_t*, val_t)>
+    size_t lowerBound(val_t val) const;
+
+    struct Free {
+        void operator()(val_t* p) const {
+            std::free(p);
+        }
+    };
+
+    std::unique_ptr<val_t[], Free> keys_;
+    size_t numKeys_{0};
+    size_t size_{0};
+
+    ///Where each layer starts in keys_. Layer 0 is the leaf layer and the last one is the root
+    std::vector<size_t> layerOffsets_;
+};
+
+///Build a FrozenKset out of the live values of the tree under root
+FrozenKset freeze(const Node* root);
+
+///Build a FrozenKset out of the strictly increasing values in [first,last)
+FrozenKset freeze(const val_t* first, const val_t* last);
+
+}
@@ -0,0 +1,81 @@
+#include "kmap.h"
+#include "node_arena.h"
+
+namespace Kset {
+
+KMap::KMap(bool useHugePages)
+    : superRoot_(new Node{}),
+      arena_(new NodeArena(useHugePages, NodeArena::huge_page_size, sizeof(Node) * Node::block_nodes))
+{
+    superRoot_->adoptArena(arena_);
+    superRoot_->expand(arena_);
+}
+
+std::tuple<val_t, bool> KMap::find(val_t key) const {
+    Node* node{nullptr};
+    NodeIdx_t idx{invalid_idx};
+    bool found{false};
+    std::tie(node,idx,found) = Kset::find(root(), key);
+    if(!found) {
+        return {-1, false};
+    }
+    return {payload(node, idx), true};
+}
+
+bool KMap::insert_or_assign(val_t key, val_t value) {
+    Node* node{nullptr};
+    NodeIdx_t idx{invalid_idx};
+    bool found{false};
+    std::tie(node,idx,found) = Kset::find(root(), key);
+    if(found) {
+        payload(node, idx) = value;
+        return false;
+    }
+
+    if(idx < node->numValues() && node->at(idx) == key) {
+        //A tombstone for key. Node::insert() revives it in its slot, and the payload slot goes with it
+        node->revive(idx);
+    } else {
+        if(node->isFull() && node->hasTombstones()) {
+            //Reuse the slots of erased keys before growing the tree, as insert() does. The payloads
+            //slide down along with the live keys
+            NodeIdx_t n = 0;
+            for(NodeIdx_t i = 0; i < node->numValues(); i++) {
+                if(node->isLive(i)) {
+                    payload(node, n++) = payload(node, i);
+                }
+            }
+            node->purgeTombstones();
+            idx = std::get<0>(node->find(key));
+        }
+        if(node->isFull()) {
+            node->expand(arena_);
+            node = node->children() + idx;
+            idx = 0;
+        }
+        for(NodeIdx_t i = node->numValues(); i > idx; i--) {
+            payload(node, i) = payload(node, i - 1);
+        }
+        bool inserted{false};
+        std::tie(idx,inserted) = node->insert(key);
+        ASSERT(inserted);
+    }
+    payload(node, idx) = value;
+    size_++;
+    return true;
+}
+
+bool KMap::erase(val_t key) {
+    Node* node{nullptr};
+    NodeIdx_t idx{invalid_idx};
+    bool found{false};
+    //Not Kset::erase(), which would also update the subtree counts that we do not keep
+    std::tie(node,idx,found) = Kset::find(root(), key);
+    if(found) {
+        node->kill(idx);
+        size_--;
+    }
+    return found;
+}
+
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <memory>
+#include <tuple>
+#include "kset.h"
+
+/**
+ * \ingroup Kset
+ */
+
+namespace Kset {
+
+/**
+ * @brief The KMap class
+ *
+ * An ordered map from 64 bit keys to 64 bit payloads, built out of the same Nodes as a Kset. Keeping the
+ * payloads next to the keys would halve the number of keys per search line (and double the depth), so the
+ * keys stay in the Nodes exactly as in a Kset and each Node gets a payload line of its own, which is only
+ * touched once the key has been found:
+ *
+ * childptr--->|Node0|Node1| ... |Node6|Payload0|Payload1| ... |Payload6|
+ *
+ * The payload lines come right after the child block (the NodeArena carves them out as a trailer of every
+ * block), so the payload of the value at idx in node n is slot idx of the line Node::block_nodes nodes past n.
+ * No pointer is needed to find it. As in ConcurrentKset, the tree hangs off an empty super root whose first
+ * child is the actual root, so that every node that holds keys lives in an arena block and has a payload line.
+ *
+ * The tree grows the way insert() grows a Kset, so sorted inserts make for a deep tree here as well.
+ * Erased keys are tombstones, as with erase(), and keep their payload slot till they are reused
+ */
+
+class KMap {
+  public:
+    explicit KMap(bool useHugePages = false);
+
+    KMap(const KMap&) = delete;
+    KMap& operator=(const KMap&) = delete;
+
+    ///Returns {payload, true} or {-1, false} if key is not in the map
+    std::tuple<val_t, bool> find(val_t key) const;
+
+    ///Set the payload of key, adding key if it is not there yet. Returns true if key was added
+    bool insert_or_assign(val_t key, val_t payload);
+
+    ///Returns true if key was present
+    bool erase(val_t key);
+
+    ///Number of keys in the map
+    size_t size() const {
+        return size_;
+    }
+
+    /**
+     * @brief The Iterator class
+     * Forward iterator over the keys in increasing order, along with their payloads
+     */
+    class Iterator {
+      public:
+        ///The end iterator
+        Iterator() = default;
+
+        val_t key() const {
+            return *itr_;
+        }
+
+        val_t payload() const {
+            return KMap::payload(itr_.node(), itr_.idx());
+        }
+
+        Iterator& operator++() {
+            ++itr_;
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return itr_ == other.itr_;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return itr_ != other.itr_;
+        }
+
+      private:
+        friend class KMap;
+
+        explicit Iterator(Kset::Iterator itr)
+            : itr_(itr)
+        {}
+
+        Kset::Iterator itr_;
+    };
+
+    Iterator begin() const {
+        return Iterator(Kset::begin(root()));
+    }
+
+    Iterator end() const {
+        return Iterator{};
+    }
+
+    ///Iterator to the first key >= key
+    Iterator lower_bound(val_t key) const {
+        return Iterator(Kset::lower_bound(root(), key));
+    }
+
+    ///Call fn(key, payload) for every key in [lo, hi), in increasing order
+    template<class Fn>
+    void for_each_in_range(val_t lo, val_t hi, Fn fn) const {
+        for(Iterator itr = lower_bound(lo); itr != end() && itr.key() < hi; ++itr) {
+            fn(itr.key(), itr.payload());
+        }
+    }
+
+    ///The tree of keys, for use with the read only Kset functions (find(), next_geq(), stats() ...).
+    ///It must not be changed other than through the KMap
+    Node* root() const {
+        return superRoot_.get();
+    }
+
+  private:
+    ///The payloads of the values of a node
+    struct alignas(64) PayloadLine {
+        val_t slots[Node::capacity];
+    };
+    static_assert(sizeof(PayloadLine) <= sizeof(Node), "a payload line fits in the space of a Node");
+
+    static val_t& payload(Node* node, NodeIdx_t idx) {
+        return reinterpret_cast<PayloadLine*>(node + Node::block_nodes)->slots[idx];
+    }
+
+    std::unique_ptr<Node> superRoot_;
+    NodeArena* arena_;
+    size_t size_{0};
+};
+
+}
@@ -1,11 +1,37 @@
 #include "kset.h"
+#include "node_arena.h"
 #include "errors.h"
+#include "work_stealing.h"
+#include <vector>
+#include <algorithm>
+#include <numeric>
 
 namespace Kset {
 
-std::tuple<Node*, NodeIdx_t, bool> find(Node* node, val_t val) {
+namespace {
+
+///val was added to (delta 1) or removed from (delta -1) node. Keep the subtree counts of its ancestors right
+void update_counts(Node* node, int64_t delta) {
+#ifdef USE_ORDER_STATS
+    for(Node* parent = node->parent(); parent; node = parent, parent = node->parent()) {
+        parent->childCounts()[node - parent->children()] += delta;
+    }
+#else
+    (void)node;
+    (void)delta;
+#endif
+}
+
+}
+
+Node* make_tree(bool useHugePages) {
+    std::unique_ptr<NodeArena> arena{new NodeArena(useHugePages)};
+    Node* root = new Node{};
+    root->adoptArena(arena.release());
+    return root;
+}
 
-    ASSERT_IMPLIES( (node->numValues() < node->capacity), !node->children() );
+std::tuple<Node*, NodeIdx_t, bool> find(Node* node, val_t val) {
 
     NodeIdx_t idx{invalid_idx};
     bool found{false};
@@ -21,13 +47,56 @@ std::tuple<Node*, NodeIdx_t, bool> find(Node* node, val_t val) {
             return find(descendent, val);
         }
     }
-    return {node,idx,found};
+    //A tombstone for val ends the search too. val cannot be anywhere else in the tree
+    return {node,idx,found && node->isLive(idx)};
 }
 
-std::tuple<Node*, NodeIdx_t, bool> insert(Node* node, val_t val)  {
+void find_batch(Node* root, const val_t* keys, size_t n, FindResult* results) {
+    //Enough to cover the memory latency with the work of the other queries without
+    //overflowing the line fill buffers
+    constexpr size_t group_size = 16;
+
+    struct Query {
+        Node* node;
+        size_t i;
+    };
+
+    Query inflight[group_size];
+    size_t next = 0;
+    size_t active = 0;
+    for(; active < group_size && next < n; active++) {
+        inflight[active] = {root, next++};
+    }
+
+    while(active) {
+        for(size_t s = 0; s < active;) {
+            Query& q = inflight[s];
+            NodeIdx_t idx{invalid_idx};
+            bool found{false};
+            std::tie(idx,found) = q.node->find(keys[q.i]);
 
-    ASSERT_IMPLIES( (node->numValues() < node->capacity), !node->children() );
+            if(!found && q.node->children()) {
+                q.node = q.node->children() + idx;
+                __builtin_prefetch(q.node);
+                s++;
+                continue;
+            }
+
+            results[q.i] = FindResult{q.node, idx, found && q.node->isLive(idx)};
+            if(next < n) {
+                q = {root, next++};
+                s++;
+            } else {
+                //Nothing left to start. Move the last query into this slot and process it right away
+                q = inflight[--active];
+            }
+        }
+    }
+}
+
+std::tuple<Node*, NodeIdx_t, bool> insert(Node* node, val_t val)  {
 
+    NodeArena* arena = node->arena();
     NodeIdx_t idx{invalid_idx};
     bool inserted{false};
     bool found{false};
@@ -35,59 +104,693 @@ std::tuple<Node*, NodeIdx_t, bool> insert(Node* node, val_t val)  {
     std::tie(node,idx,found) = find(node,val);
 
     if(!found) {
+        //If val is a tombstone then node->insert() just revives it
         std::tie(idx,inserted) = node->insert(val);
+        if(!inserted && node->hasTombstones()) {
+            //node is a full leaf. Reuse the slots of erased values before growing the tree
+            node->purgeTombstones();
+            std::tie(idx,inserted) = node->insert(val);
+        }
         if(!inserted) {
-            node->expand();
+            node->expand(arena);
             node = node->children() + idx;
             std::tie(idx,inserted) = node->insert(val);
         }
         ASSERT(inserted);
+        update_counts(node, 1);
     }
     return {node,idx,inserted};
 }
 
-std::tuple<Node*,NodeIdx_t,val_t> find_min(Node* node) {
+namespace {
 
-    ASSERT(node->numValues() > 0);
+///A leaf that is full only because of tombstones can make room without splitting
+bool hasRoom(Node* node) {
+    if(node->isFull() && !node->children() && node->hasTombstones()) {
+        node->purgeTombstones();
+    }
+    return !node->isFull();
+}
 
-    while(node->children() && node->children()->numValues()) {
-        node = node->children();
+///Where to split a full node that val is about to go into. Usually in the middle, but when val
+///lands past either end of the node (as it does for sorted or clustered inserts) we split unevenly
+///so that the node left behind stays (nearly) full. An internal node needs at least one value on
+///either side so that both halves have children to descend into
+NodeIdx_t split_point(const Node* node, val_t val) {
+    const NodeIdx_t slack = node->children() ? 1 : 0;
+    if(val > node->at(Node::capacity - 1)) {
+        return Node::capacity - 1 - slack;
     }
+    if(val < node->at(0)) {
+        return slack;
+    }
+    return Node::capacity / 2;
+}
+
+///Max number of values that a tree of each height can hold when all its nodes are full
+struct SubtreeCapacity {
+    static constexpr int max_height = 22;
+    size_t caps[max_height + 1];
+
+    SubtreeCapacity() {
+        caps[0] = 0;
+        //Wide nodes overflow size_t long before max_height
+        const size_t limit = std::numeric_limits<size_t>::max();
+        for(int h = 1; h <= max_height; h++) {
+            caps[h] = caps[h-1] > (limit - Node::capacity) / (Node::capacity + 1) ? limit : caps[h-1] * (Node::capacity + 1) + Node::capacity;
+        }
+    }
+};
+
+const SubtreeCapacity subtree_capacity;
 
-    return {node, 0, node->at(0)};
 }
 
-std::tuple<Node*,NodeIdx_t,val_t> successor(Node* node, NodeIdx_t loc) {
+size_t packed_child_size(size_t n) {
+    ASSERT(n > Node::capacity);
+    int height = 1;
+    while(subtree_capacity.caps[height] < n) {
+        ASSERT(height < SubtreeCapacity::max_height);
+        height++;
+    }
+    return subtree_capacity.caps[height-1];
+}
 
-    ASSERT(node->numValues() > loc);
+namespace {
 
-    //First look in the potential child node
-    if(node->children()) {
-        Node* potentialDescendent = node->children() + loc + 1;
-        if(potentialDescendent->numValues() > 0) {
-            return find_min(potentialDescendent);
+///Fill node with the next n values of the input. Full subtrees are packed from the left and the
+///remainder goes into the last child, so only the right spine can be partially filled
+void fill_packed(Node* node, const val_t*& next, size_t n, NodeArena* arena) {
+    if(n <= Node::capacity) {
+        for(size_t i = 0; i < n; i++) {
+            node->append(*next++);
         }
+        return;
+    }
+
+    const size_t childCap = packed_child_size(n);
+
+    node->expand(arena);
+    for(NodeIdx_t i = 0; n > childCap; i++) {
+        fill_packed(node->children() + i, next, childCap, arena);
+#ifdef USE_ORDER_STATS
+        node->childCounts()[i] = childCap;
+#endif
+        node->append(*next++);
+        n -= childCap + 1;
     }
+#ifdef USE_ORDER_STATS
+    node->childCounts()[node->numValues()] = n;
+#endif
+    fill_packed(node->children() + node->numValues(), next, n, arena);
+}
+
+const std::tuple<Node*,NodeIdx_t,val_t> not_found{nullptr, invalid_idx, -1};
 
-    //Next look in the same node
-    if(node->numValues() > loc+1) {
-        return {node, loc+1, node->at(loc+1)};
+std::tuple<Node*,NodeIdx_t,val_t> first_live(Node* node);
+
+///In order, the positions to the right of child childIdx of node are
+///child childIdx, val childIdx, child childIdx+1, val childIdx+1 ...
+///Return the first live value among these
+std::tuple<Node*,NodeIdx_t,val_t> first_live_from(Node* node, NodeIdx_t childIdx) {
+    Node* children = node->children();
+    for(NodeIdx_t i = childIdx; i <= node->numValues(); i++) {
+        if(children && children[i].numValues()) {
+            auto res = first_live(children + i);
+            if(std::get<0>(res)) {
+                return res;
+            }
+        }
+        if(i < node->numValues() && node->isLive(i)) {
+            return {node, i, node->at(i)};
+        }
+    }
+    return not_found;
+}
+
+///Without tombstones this is simply a walk down the leftmost children
+std::tuple<Node*,NodeIdx_t,val_t> first_live(Node* node) {
+    return first_live_from(node, 0);
+}
+
+std::tuple<Node*,NodeIdx_t,val_t> last_live(Node* node);
+
+///Mirror image of first_live_from(). The positions to the left of child childIdx are
+///val childIdx-1, child childIdx-1, val childIdx-2 ... child 0
+std::tuple<Node*,NodeIdx_t,val_t> last_live_before(Node* node, NodeIdx_t childIdx) {
+    Node* children = node->children();
+    for(NodeIdx_t i = childIdx; i > 0; i--) {
+        if(node->isLive(i-1)) {
+            return {node, i-1, node->at(i-1)};
+        }
+        if(children && children[i-1].numValues()) {
+            auto res = last_live(children + i - 1);
+            if(std::get<0>(res)) {
+                return res;
+            }
+        }
+    }
+    return not_found;
+}
+
+std::tuple<Node*,NodeIdx_t,val_t> last_live(Node* node) {
+    Node* children = node->children();
+    NodeIdx_t n = node->numValues();
+    if(children && children[n].numValues()) {
+        auto res = last_live(children + n);
+        if(std::get<0>(res)) {
+            return res;
+        }
+    }
+    return last_live_before(node, n);
+}
+
+///The general versions of next_geq()/prev_leq(), used once a tombstone gets in the way of the fast path.
+///Without tombstones they too touch one node per level, but they do so on the way back up as well
+std::tuple<Node*,NodeIdx_t,val_t> next_geq_slow(Node* node, val_t val) {
+    NodeIdx_t idx{invalid_idx};
+    bool found{false};
+    std::tie(idx,found) = node->find(val);
+    if(found && node->isLive(idx)) {
+        return {node, idx, val};
+    }
+
+    //Everything in child idx is smaller than val if val is right here (as a tombstone)
+    Node* children = node->children();
+    if(!found && children && children[idx].numValues()) {
+        auto res = next_geq_slow(children + idx, val);
+        if(std::get<0>(res)) {
+            return res;
+        }
+    }
+    if(!found && idx < node->numValues() && node->isLive(idx)) {
+        return {node, idx, node->at(idx)};
+    }
+    return first_live_from(node, idx+1);
+}
+
+std::tuple<Node*,NodeIdx_t,val_t> prev_leq_slow(Node* node, val_t val) {
+    NodeIdx_t idx{invalid_idx};
+    bool found{false};
+    std::tie(idx,found) = node->find(val);
+    if(found && node->isLive(idx)) {
+        return {node, idx, val};
+    }
+
+    Node* children = node->children();
+    if(children && children[idx].numValues()) {
+        auto res = prev_leq_slow(children + idx, val);
+        if(std::get<0>(res)) {
+            return res;
+        }
+    }
+    return last_live_before(node, idx);
+}
+
+}
+
+Node* bulk_load(const val_t* first, const val_t* last, bool useHugePages) {
+    ASSERT(first <= last);
+    Node* root = make_tree(useHugePages);
+    fill_packed(root, first, static_cast<size_t>(last - first), root->arena());
+    ASSERT(first == last);
+    return root;
+}
+
+namespace {
+
+///LSD radix sort of keys[0..n), a byte at a time. The sign bit is flipped so that negative values sort first.
+///Passes over bytes that all keys share (the top ones, for keys drawn from a narrow range) are skipped
+void radix_sort(val_t* keys, size_t n) {
+    constexpr size_t small_batch = 256;
+    if(n < small_batch) {
+        std::sort(keys, keys + n);
+        return;
+    }
+
+    auto digit = [](val_t key, unsigned shift) {
+        return ((static_cast<uint64_t>(key) ^ (uint64_t{1} << 63)) >> shift) & 0xFF;
+    };
+    std::vector<val_t> scratch(n);
+    val_t* from = keys;
+    val_t* to = scratch.data();
+    for(unsigned shift = 0; shift < 64; shift += 8) {
+        size_t offsets[256] = {};
+        for(size_t i = 0; i < n; i++) {
+            offsets[digit(from[i], shift)]++;
+        }
+        if(offsets[digit(from[0], shift)] == n) {
+            continue;
+        }
+        size_t sum = 0;
+        for(size_t& offset : offsets) {
+            size_t count = offset;
+            offset = sum;
+            sum += count;
+        }
+        for(size_t i = 0; i < n; i++) {
+            to[offsets[digit(from[i], shift)]++] = from[i];
+        }
+        std::swap(from, to);
+    }
+    if(from != keys) {
+        std::copy(from, from + n, keys);
+    }
+}
+
+}
+
+size_t insert_batch(Node* root, const val_t* keys, size_t n) {
+    std::vector<val_t> sorted(keys, keys + n);
+    radix_sort(sorted.data(), sorted.size());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    //The path down to the node we are at. Each frame knows the bound that all values in its subtree are
+    //below (the root has none). The keys come in increasing order, so we only ever have to climb until the
+    //next key is below the bound, instead of starting over from the root
+    struct Frame {
+        Node* node;
+        val_t bound;
+        bool bounded;
+    };
+    std::vector<Frame> path;
+    path.reserve(64);
+    path.push_back({root, 0, false});
+
+    NodeArena* arena = root->arena();
+    size_t inserted{0};
+    for(size_t i = 0; i < sorted.size();) {
+        const val_t val = sorted[i];
+        while(path.back().bounded && val >= path.back().bound) {
+            path.pop_back();
+        }
+        const Frame frame = path.back();
+        Node* node = frame.node;
+
+        NodeIdx_t idx{invalid_idx};
+        bool found{false};
+        std::tie(idx,found) = node->find(val);
+        if(found) {
+            if(!node->isLive(idx)) {
+                node->revive(idx);
+                update_counts(node, 1);
+                inserted++;
+            }
+            i++;
+            continue;
+        }
+
+        //Where the subtree at idx (or the values that go there) ends
+        const bool last = idx == node->numValues();
+        const val_t bound = last ? frame.bound : node->at(idx);
+        const bool bounded = last ? frame.bounded : true;
+
+        if(node->children()) {
+            path.push_back({node->children() + idx, bound, bounded});
+            continue;
+        }
+        if(node->isFull() && node->hasTombstones()) {
+            node->purgeTombstones();
+            continue;
+        }
+        if(!node->isFull()) {
+            node->insert(val);
+            update_counts(node, 1);
+            inserted++;
+            i++;
+            continue;
+        }
+
+        //A full leaf. All the keys up to the bound go into one packed subtree below it, so a run of keys
+        //that lands in the same place builds a shallow subtree (with its blocks allocated in depth first
+        //order) instead of a chain
+        const size_t end = bounded ? std::lower_bound(sorted.begin() + i, sorted.end(), bound) - sorted.begin() : sorted.size();
+        node->expand(arena);
+        Node* child = node->children() + idx;
+        const val_t* next = sorted.data() + i;
+        fill_packed(child, next, end - i, arena);
+        update_counts(child, static_cast<int64_t>(end - i));
+        inserted += end - i;
+        i = end;
+    }
+    return inserted;
+}
+
+namespace {
+
+///Subtrees smaller than this are never worth a task of their own
+constexpr size_t min_grain = 4096;
+
+///fill_packed(), except that subtrees of at most grain values are left to tasks, which build them with the
+///arena of whichever worker runs them. The shape of the tree is exactly what fill_packed() would build
+void fill_packed_parallel(Node* node, const val_t*& next, size_t n, NodeArena* arena, size_t grain,
+                          WorkStealing& pool, std::vector<std::unique_ptr<NodeArena>>& arenas, unsigned& spread) {
+    if(n <= grain) {
+        const val_t* first = next;
+        pool.spawn(spread++ % pool.numWorkers(), [node, first, n, &arenas](unsigned worker) {
+            const val_t* from = first;
+            fill_packed(node, from, n, arenas[worker].get());
+        });
+        next += n;
+        return;
+    }
+
+    const size_t childCap = packed_child_size(n);
+
+    node->expand(arena);
+    for(NodeIdx_t i = 0; n > childCap; i++) {
+        fill_packed_parallel(node->children() + i, next, childCap, arena, grain, pool, arenas, spread);
+#ifdef USE_ORDER_STATS
+        node->childCounts()[i] = childCap;
+#endif
+        node->append(*next++);
+        n -= childCap + 1;
+    }
+#ifdef USE_ORDER_STATS
+    node->childCounts()[node->numValues()] = n;
+#endif
+    fill_packed_parallel(node->children() + node->numValues(), next, n, arena, grain, pool, arenas, spread);
+}
+
+}
+
+Node* parallel_bulk_load(const val_t* first, const val_t* last, unsigned numThreads, bool useHugePages) {
+    ASSERT(first <= last);
+    std::unique_ptr<Node> root{make_tree(useHugePages)};
+    WorkStealing pool(numThreads);
+    std::vector<std::unique_ptr<NodeArena>> arenas;
+    for(unsigned i = 0; i < pool.numWorkers(); i++) {
+        arenas.emplace_back(new NodeArena(useHugePages));
+    }
+
+    //A few subtrees per worker, so that stealing can even out the differences between them
+    const size_t n = static_cast<size_t>(last - first);
+    const size_t grain = std::max(min_grain, n / (pool.numWorkers() * 8));
+    unsigned spread{0};
+    fill_packed_parallel(root.get(), first, n, root->arena(), grain, pool, arenas, spread);
+    ASSERT(first == last);
+    pool.run();
+
+    for(auto& arena : arenas) {
+        root->arena()->absorb(*arena);
+    }
+    return root.release();
+}
+
+Node* parallel_build(const val_t* keys, size_t n, unsigned numThreads, bool useHugePages) {
+    const unsigned workers = WorkStealing::workersFor(numThreads);
+    if(n < min_grain * 2 || workers == 1) {
+        std::vector<val_t> sorted(keys, keys + n);
+        radix_sort(sorted.data(), sorted.size());
+        sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+        return parallel_bulk_load(sorted.data(), sorted.data() + sorted.size(), numThreads, useHugePages);
+    }
+    WorkStealing pool(workers);
+
+    //Sample sort. Splitters from an evenly spaced sample cut the key space into buckets of about the
+    //same size, a few per worker (but no fewer than min_grain keys each, so that many threads on a small
+    //input still leave room for the sample)
+    constexpr size_t oversample = 32;
+    const size_t numBuckets = std::max(size_t{1}, std::min(size_t{workers} * 4, n / min_grain));
+    const size_t stride = std::max(size_t{1}, n / (numBuckets * oversample));
+    std::vector<val_t> sample;
+    for(size_t i = 0; i < numBuckets * oversample; i++) {
+        sample.push_back(keys[i * stride]);
+    }
+    std::sort(sample.begin(), sample.end());
+    std::vector<val_t> splitters;
+    for(size_t b = 1; b < numBuckets; b++) {
+        splitters.push_back(sample[b * oversample]);
+    }
+    auto bucketOf = [&splitters](val_t key) {
+        return static_cast<size_t>(std::upper_bound(splitters.begin(), splitters.end(), key) - splitters.begin());
+    };
+
+    //Every worker counts the keys of its chunk of the input per bucket and then scatters them. The
+    //chunks go into each bucket in order, so every key has its place decided up front
+    const size_t chunk = (n + workers - 1) / workers;
+    std::vector<std::vector<size_t>> offsets(workers, std::vector<size_t>(numBuckets, 0));
+    for(unsigned c = 0; c < workers; c++) {
+        pool.spawn(c, [c, chunk, n, keys, &offsets, &bucketOf](unsigned) {
+            for(size_t i = c * chunk; i < std::min(n, (c + 1) * chunk); i++) {
+                offsets[c][bucketOf(keys[i])]++;
+            }
+        });
+    }
+    pool.run();
+
+    std::vector<size_t> bucketStart(numBuckets + 1, 0);
+    size_t sum{0};
+    for(size_t b = 0; b < numBuckets; b++) {
+        bucketStart[b] = sum;
+        for(unsigned c = 0; c < workers; c++) {
+            size_t count = offsets[c][b];
+            offsets[c][b] = sum;
+            sum += count;
+        }
+    }
+    bucketStart[numBuckets] = sum;
+
+    std::vector<val_t> buckets(n);
+    for(unsigned c = 0; c < workers; c++) {
+        pool.spawn(c, [c, chunk, n, keys, &offsets, &bucketOf, &buckets](unsigned) {
+            std::vector<size_t>& next = offsets[c];
+            for(size_t i = c * chunk; i < std::min(n, (c + 1) * chunk); i++) {
+                buckets[next[bucketOf(keys[i])]++] = keys[i];
+            }
+        });
+    }
+    pool.run();
+
+    //Sort each bucket and drop its duplicates. Equal keys always land in the same bucket
+    std::vector<size_t> bucketSize(numBuckets);
+    for(size_t b = 0; b < numBuckets; b++) {
+        pool.spawn(b % workers, [b, &buckets, &bucketStart, &bucketSize](unsigned) {
+            val_t* first = buckets.data() + bucketStart[b];
+            val_t* last = buckets.data() + bucketStart[b+1];
+            radix_sort(first, static_cast<size_t>(last - first));
+            bucketSize[b] = static_cast<size_t>(std::unique(first, last) - first);
+        });
+    }
+    pool.run();
+
+    //Close the gaps left by the duplicates
+    std::vector<val_t> sorted(std::accumulate(bucketSize.begin(), bucketSize.end(), size_t{0}));
+    size_t to{0};
+    for(size_t b = 0; b < numBuckets; b++) {
+        pool.spawn(b % workers, [b, to, &buckets, &bucketStart, &bucketSize, &sorted](unsigned) {
+            std::copy_n(buckets.data() + bucketStart[b], bucketSize[b], sorted.data() + to);
+        });
+        to += bucketSize[b];
+    }
+    pool.run();
+    buckets = std::vector<val_t>();
+
+    return parallel_bulk_load(sorted.data(), sorted.data() + sorted.size(), numThreads, useHugePages);
+}
+
+std::tuple<Node*, NodeIdx_t, bool> insert_balanced(Node* root, val_t val) {
+
+    NodeArena* arena = root->arena();
+    Node* node{nullptr};
+    NodeIdx_t idx{invalid_idx};
+    bool found{false};
+    bool inserted{false};
+
+    std::tie(node,idx,found) = find(root,val);
+    if(found) {
+        return {node,idx,false};
+    }
+    if(idx < node->numValues() && node->at(idx) == val) {
+        //val is a tombstone. node->insert() brings it back to life
+        std::tie(idx,inserted) = node->insert(val);
+        update_counts(node, 1);
+        return {node,idx,inserted};
+    }
+
+    //Descend again, splitting every full node on the way down so that the parent always has
+    //room for the value promoted by a split
+    if(!hasRoom(root)) {
+        root->pushDown(arena);
+        root->splitChild(0, split_point(root->children(), val), arena);
+    }
+
+    node = root;
+    while(node->children()) {
+        std::tie(idx,std::ignore) = node->find(val);
+        Node* child = node->children() + idx;
+        if(!hasRoom(child)) {
+            node->splitChild(idx, split_point(child, val), arena);
+            if(val > node->at(idx)) {
+                idx++;
+            }
+        }
+        node = node->children() + idx;
+    }
+
+    std::tie(idx,inserted) = node->insert(val);
+    ASSERT(inserted);
+    update_counts(node, 1);
+    return {node,idx,inserted};
+}
+
+std::tuple<Node*,NodeIdx_t,val_t> find_min(Node* node) {
+
+    ASSERT(node->numValues() > 0);
+
+    return first_live(node);
+}
+
+std::tuple<Node*,NodeIdx_t,val_t> successor(Node* node, NodeIdx_t loc) {
+
+    ASSERT(node->numValues() > loc);
+
+    //First look in the potential child node and then in the rest of the same node
+    auto res = first_live_from(node, loc+1);
+    if(std::get<0>(res)) {
+        return res;
     }
 
     //will have to go up to the parent. May have to keep going up the chain
-    //till we find an ancestor with a value greater than our val
-    val_t val = node->at(loc);
+    //till we find an ancestor with a live value greater than our val. Since siblings
+    //are contiguous, our position in the parent is just our offset in its child block
     Node* parent = node->parent();
     while(parent) {
-        ASSERT(parent->numValues());
-        for(NodeIdx_t i = 0; i < parent->numValues(); i++) {
-            if(parent->at(i) > val) {
-                return {parent,i,parent->at(i)};
-            }
+        NodeIdx_t childIdx = static_cast<NodeIdx_t>(node - parent->children());
+        if(childIdx < parent->numValues() && parent->isLive(childIdx)) {
+            return {parent, childIdx, parent->at(childIdx)};
+        }
+        res = first_live_from(parent, childIdx+1);
+        if(std::get<0>(res)) {
+            return res;
         }
+        node = parent;
         parent = parent->parent();
     }
-    return {nullptr, invalid_idx, -1};
+    return not_found;
+}
+
+std::tuple<Node*,NodeIdx_t,val_t> next_geq(Node* root, val_t val) {
+    auto best = not_found;
+    Node* node = root;
+    while(node) {
+        NodeIdx_t idx{invalid_idx};
+        bool found{false};
+        std::tie(idx,found) = node->find(val);
+
+        //The value at idx is the smallest one >= val in this node. Anything better must be in child idx
+        if(idx < node->numValues()) {
+            if(!node->isLive(idx)) {
+                return next_geq_slow(root, val);
+            }
+            best = std::make_tuple(node, idx, node->at(idx));
+            if(found) {
+                break;
+            }
+        }
+        Node* child = node->children() ? node->children() + idx : nullptr;
+        node = child && child->numValues() ? child : nullptr;
+    }
+    return best;
 }
 
+std::tuple<Node*,NodeIdx_t,val_t> prev_leq(Node* root, val_t val) {
+    auto best = not_found;
+    Node* node = root;
+    while(node) {
+        NodeIdx_t idx{invalid_idx};
+        bool found{false};
+        std::tie(idx,found) = node->find(val);
+
+        //The value at idx (if found) or else idx-1 is the largest one <= val in this node.
+        //Anything better must be in child idx
+        NodeIdx_t candidate = found ? idx : idx - 1;
+        if(found || idx > 0) {
+            if(!node->isLive(candidate)) {
+                return prev_leq_slow(root, val);
+            }
+            best = std::make_tuple(node, candidate, node->at(candidate));
+            if(found) {
+                break;
+            }
+        }
+        Node* child = node->children() ? node->children() + idx : nullptr;
+        node = child && child->numValues() ? child : nullptr;
+    }
+    return best;
+}
+
+bool erase(Node* root, val_t val) {
+    Node* node{nullptr};
+    NodeIdx_t idx{invalid_idx};
+    bool found{false};
+
+    std::tie(node,idx,found) = find(root,val);
+    if(found) {
+        node->kill(idx);
+        update_counts(node, -1);
+    }
+    return found;
+}
+
+#ifdef USE_ORDER_STATS
+
+uint64_t size(Node* root) {
+    return root->subtreeCount();
+}
+
+uint64_t rank(Node* root, val_t val) {
+    uint64_t rank = 0;
+    Node* node = root;
+    while(node) {
+        NodeIdx_t idx{invalid_idx};
+        bool found{false};
+        std::tie(idx,found) = node->find(val);
+
+        //Everything to the left of val in this node: the values before idx and the children up to idx
+        //(including child idx if val is right here)
+        Node* children = node->children();
+        for(NodeIdx_t i = 0; i < idx; i++) {
+            rank += node->isLive(i) + (children ? node->childCounts()[i] : 0);
+        }
+        if(found) {
+            return rank + (children ? node->childCounts()[idx] : 0);
+        }
+        node = children ? children + idx : nullptr;
+    }
+    return rank;
+}
+
+std::tuple<Node*,NodeIdx_t,val_t> select(Node* root, uint64_t k) {
+    Node* node = root;
+    if(k >= size(root)) {
+        return not_found;
+    }
+    while(true) {
+        Node* children = node->children();
+        NodeIdx_t i = 0;
+        for(;; i++) {
+            uint64_t childCount = children ? node->childCounts()[i] : 0;
+            if(k < childCount) {
+                break;
+            }
+            k -= childCount;
+            ASSERT(i < node->numValues());
+            if(node->isLive(i)) {
+                if(!k) {
+                    return {node, i, node->at(i)};
+                }
+                k--;
+            }
+        }
+        node = children + i;
+    }
+}
+
+uint64_t count_range(Node* root, val_t lo, val_t hi) {
+    return lo < hi ? rank(root, hi) - rank(root, lo) : 0;
+}
+
+#endif
+
 }
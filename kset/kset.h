@@ -4,6 +4,7 @@
 #include <tuple>
 #include <limits>
 #include "kset_node.h"
+#include "kset_iterator.h"
 
 /**
  * \ingroup Kset
@@ -11,21 +12,104 @@
 
 namespace Kset {
 
+///Create an empty tree whose child blocks are allocated from a per-tree NodeArena, optionally backed by
+///huge pages. Deleting the returned root releases the whole tree in one shot
+Node* make_tree(bool useHugePages = false);
+
 ///Find val in tree rooted at root. Returns <position,true> if found else <potentialposition, false> if not found
 std::tuple<Node*, NodeIdx_t, bool> find(Node* root, val_t val);
 
-///Find val in tree rooted at root. Returns position at which val was inserted. Always succeeds
+///Result of a find(): <position,true> if found else <potentialposition, false>
+using FindResult = std::tuple<Node*, NodeIdx_t, bool>;
+
+///Find each of keys[0..n) in tree rooted at root and store what find() would have returned in results[0..n).
+///A single find() is a chain of dependent cache misses, one per level. Here a group of queries is kept in
+///flight and advanced one level at a time in round robin. Each query prefetches its next node and then
+///yields to the others, so that by the time we get back to it the node has (hopefully) arrived.
+///Best used with a few hundred keys at a time
+void find_batch(Node* root, const val_t* keys, size_t n, FindResult* results);
+
+///Find val in tree rooted at root. Returns position at which val was inserted. Always succeeds.
+///root must be the actual root of the tree since only it knows the arena to allocate from
 std::tuple<Node*, NodeIdx_t, bool> insert(Node* root, val_t val);
 
-///Find min element of tree rooted at node. Used mostly by successor
+///Insert the n values in keys (in any order, duplicates allowed) into the tree rooted at root. Returns the
+///number of values that were not there yet. The batch is radix sorted and then merged into the tree in one
+///ordered sweep, which climbs from where the last value went only as far as needed to reach the next one.
+///All the values that land below the same full leaf are packed into one new subtree at once (as bulk_load()
+///does), so unlike inserting them one at a time this does not build chains out of runs of nearby values.
+///root must be the actual root of the tree
+size_t insert_batch(Node* root, const val_t* keys, size_t n);
+
+///Build a new (arena backed) tree out of the strictly increasing values in [first,last).
+///The tree is built bottom up in a single in-order pass over the input: every node is filled
+///completely except along the right spine, and the child blocks are allocated in depth first
+///order so that they lie contiguously in the arena. Delete the returned root to release the tree
+Node* bulk_load(const val_t* first, const val_t* last, bool useHugePages = false);
+
+///How bulk_load() packs n > Node::capacity values under one node: every child but the last holds this many,
+///the number of values in a full subtree one level shorter than the shortest one that holds all n
+size_t packed_child_size(size_t n);
+
+///bulk_load() on numThreads threads (0 for one per hardware thread), building the same tree. The top levels
+///are laid out first, and the subtrees below them (a few per thread, by key range) are then filled in by
+///tasks that the threads steal from each other (see WorkStealing). Each thread carves its subtrees out of a
+///NodeArena of its own, which the tree takes over at the end, so a subtree still lies contiguously in memory
+Node* parallel_bulk_load(const val_t* first, const val_t* last, unsigned numThreads = 0, bool useHugePages = false);
+
+///Build a tree out of the n values in keys, in any order and with duplicates, on numThreads threads. The
+///values are sample sorted in parallel (partitioned into key ranges by splitters from a sample, and each
+///range radix sorted on its own), and then handed to parallel_bulk_load()
+Node* parallel_build(const val_t* keys, size_t n, unsigned numThreads = 0, bool useHugePages = false);
+
+///Same as insert(), but keeps the tree balanced by splitting full nodes (as a B-Tree does) instead
+///of pushing values down into a fresh child block. All leaves stay at the same depth, so the depth
+///is O(log N) even for sorted or clustered inserts, and nodes stay well filled. The root never moves.
+///Trees built this way can still be used with insert(), but that gives up the depth guarantee
+std::tuple<Node*, NodeIdx_t, bool> insert_balanced(Node* root, val_t val);
+
+///Find min element of tree rooted at node. Used mostly by successor. Returns {nullptr,invalid_idx,-1}
+///if every value in the tree has been erased
 std::tuple<Node*, NodeIdx_t, val_t> find_min(Node* node);
 
-///Find successor element
+///Find successor element. Returns {nullptr,invalid_idx,-1} if there is none.
+///To walk over many values, an Iterator (see kset_iterator.h) is cheaper
 std::tuple<Node*, NodeIdx_t, val_t> successor(Node* node, NodeIdx_t loc);
 
-/// Todo
-/// deletion - Best implemented lazily. We have 16 free bits in the children_ ptr and those can be used
-/// to keep track of which elements are alive and which are deleted in a node
+///Smallest live value >= val, or {nullptr,invalid_idx,-1} if there is none. val need not be in the tree.
+///The best candidate so far is remembered on the way down, so this is a single root to leaf descent
+std::tuple<Node*, NodeIdx_t, val_t> next_geq(Node* root, val_t val);
+
+///Largest live value <= val, or {nullptr,invalid_idx,-1} if there is none. Same single descent as next_geq()
+std::tuple<Node*, NodeIdx_t, val_t> prev_leq(Node* root, val_t val);
+
+///Erase val from the tree rooted at root. Returns true if val was present.
+///Deletion is lazy. We only flip the bit for val in the tombstone mask that lives in the 16 free
+///bits of the children_ ptr (or, in 4 line nodes, after the values), so nothing moves in memory. A later insert of the same val revives
+///the slot, and an insert into a full leaf first reclaims the slots of its tombstones
+bool erase(Node* root, val_t val);
+
+#ifdef USE_ORDER_STATS
+
+///Order statistics. With USE_ORDER_STATS every child block also carries the number of live values under each
+///of its nodes (see Node::childCounts()), which insert(), insert_batch(), insert_balanced(), bulk_load() and erase()
+///keep up to date. So these take one node per level instead of a walk over the values. ConcurrentKset does not keep the
+///counts, so they are not available on its trees
+
+///Number of live values in the tree
+uint64_t size(Node* root);
+
+///Number of live values < val
+uint64_t rank(Node* root, val_t val);
+
+///The live value with k live values before it (i.e. k counts from 0). Returns {nullptr,invalid_idx,-1} if there
+///are k or fewer values
+std::tuple<Node*, NodeIdx_t, val_t> select(Node* root, uint64_t k);
+
+///Number of live values in [lo, hi)
+uint64_t count_range(Node* root, val_t lo, val_t hi);
+
+#endif
 
 }
 
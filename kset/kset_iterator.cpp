@@ -0,0 +1,111 @@
+#include "kset_iterator.h"
+
+namespace Kset {
+
+constexpr unsigned Iterator::max_depth;
+
+void Iterator::push(Node* node, NodeIdx_t idx) {
+    frames_[depth_ % max_depth] = {node, idx};
+    depth_++;
+    if(depth_ - oldest_ > max_depth) {
+        oldest_++;
+    }
+}
+
+void Iterator::pop() {
+    Node* child = top().node;
+    depth_--;
+    if(depth_ && depth_ - 1 < oldest_) {
+        //The frame of the parent was dropped. Recover it
+        Node* parent = child->parent();
+        oldest_--;
+        frames_[(depth_ - 1) % max_depth] = {parent, static_cast<NodeIdx_t>(child - parent->children())};
+    }
+}
+
+void Iterator::settle(bool enterChild) {
+    while(depth_) {
+        Frame& frame = top();
+        Node* node = frame.node;
+
+        if(enterChild && node->children()) {
+            Node* child = node->children() + frame.idx;
+            if(child->numValues()) {
+                push(child, 0);
+                continue;
+            }
+        }
+
+        if(frame.idx < node->numValues()) {
+            if(node->isLive(frame.idx)) {
+                return;
+            }
+            frame.idx++;
+            enterChild = true;
+        } else {
+            //Done with this node. The parent continues with the value right after us
+            pop();
+            enterChild = false;
+        }
+    }
+}
+
+void Iterator::descend(val_t val) {
+    while(true) {
+        Frame& frame = top();
+        bool found{false};
+        std::tie(frame.idx,found) = frame.node->find(val);
+
+        //Everything in child idx is smaller than val if val is right here
+        Node* node = frame.node;
+        Node* child = node->children() ? node->children() + frame.idx : nullptr;
+        if(found || !child || !child->numValues()) {
+            break;
+        }
+        push(child, 0);
+    }
+    settle(false);
+}
+
+Iterator& Iterator::seek(val_t val) {
+    if(!depth_ || **this >= val) {
+        return *this;
+    }
+
+    //The first node on our path (from the bottom) with a value >= val still ahead of it holds the target in
+    //its subtree, or is past it only by tombstones. If there is none, the root is the place to look
+    while(depth_ > 1) {
+        const Frame& frame = top();
+        const NodeIdx_t n = frame.node->numValues();
+        if(frame.idx < n && frame.node->at(n - 1) >= val) {
+            break;
+        }
+        pop();
+    }
+    descend(val);
+    return *this;
+}
+
+Iterator begin(Node* root) {
+    Iterator itr;
+    itr.push(root, 0);
+    itr.settle(true);
+    return itr;
+}
+
+Iterator lower_bound(Node* root, val_t val) {
+    Iterator itr;
+    itr.push(root, 0);
+    itr.descend(val);
+    return itr;
+}
+
+Iterator upper_bound(Node* root, val_t val) {
+    Iterator itr = lower_bound(root, val);
+    if(itr != end(root) && *itr == val) {
+        ++itr;
+    }
+    return itr;
+}
+
+}
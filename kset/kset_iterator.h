@@ -0,0 +1,143 @@
+#pragma once
+
+#include <iterator>
+#include "kset_node.h"
+
+/**
+ * \ingroup Kset
+ */
+
+namespace Kset {
+
+/**
+ * @brief The Iterator class
+ *
+ * Forward iterator over the live values of a tree in increasing order.
+ *
+ * successor() has to rediscover where it is from the node alone, so it climbs parent ptrs every time
+ * it runs out of a node. Instead, the Iterator keeps the root to leaf path it has descended on a small
+ * stack of {node, idx} frames, so stepping is amortized O(1) and touches only nodes it needs anyway.
+ *
+ * The stack holds max_depth frames, which covers any balanced tree. A tree built with plain insert() can
+ * be much deeper than that. The oldest frames are then dropped and, when we climb back up to them, they
+ * are recovered from the parent ptr (since siblings are contiguous, our idx in the parent is just our
+ * offset in its child block)
+ */
+
+class Iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = val_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const val_t*;
+    using reference = val_t;
+
+    static constexpr unsigned max_depth = 32;
+
+    ///The end iterator
+    Iterator() = default;
+
+    val_t operator*() const {
+        return top().node->at(top().idx);
+    }
+
+    Iterator& operator++() {
+        top().idx++;
+        settle(true);
+        return *this;
+    }
+
+    Iterator operator++(int) {
+        Iterator prev = *this;
+        ++(*this);
+        return prev;
+    }
+
+    bool operator==(const Iterator& other) const {
+        if(!depth_ || !other.depth_) {
+            return depth_ == other.depth_;
+        }
+        return top().node == other.top().node && top().idx == other.top().idx;
+    }
+
+    bool operator!=(const Iterator& other) const {
+        return !(*this == other);
+    }
+
+    ///Move forward to the first live value >= val (staying put if we are already there). Instead of starting
+    ///over from the root, we only climb as far as the first node on our path that holds a value >= val and
+    ///descend from there, so the cost grows with the log of the distance skipped. This is what lets the set
+    ///operations gallop over the stretches of one tree that have no counterpart in the other
+    Iterator& seek(val_t val);
+
+    ///The location of the current value, as returned by find()
+    Node* node() const {
+        return depth_ ? top().node : nullptr;
+    }
+
+    NodeIdx_t idx() const {
+        return depth_ ? top().idx : invalid_idx;
+    }
+
+  private:
+    friend Iterator begin(Node* root);
+    friend Iterator lower_bound(Node* root, val_t val);
+
+    ///For the frame on top of the stack, everything before child idx has been visited. Each frame below
+    ///it is waiting on its child idx. Moves to the next live value (visiting child idx first if enterChild)
+    void settle(bool enterChild);
+
+    ///Point the top frame at the branching point of val in its node and descend from there to where val
+    ///is or would be. Leaves us at the first live value >= val (if it is in the subtree of the top frame)
+    void descend(val_t val);
+
+    struct Frame {
+        Node* node;
+        NodeIdx_t idx;
+    };
+
+    Frame& top() {
+        return frames_[(depth_ - 1) % max_depth];
+    }
+
+    const Frame& top() const {
+        return frames_[(depth_ - 1) % max_depth];
+    }
+
+    void push(Node* node, NodeIdx_t idx);
+    void pop();
+
+    Frame frames_[max_depth];
+
+    ///Logical depth of the stack and the logical index of the oldest frame we still hold
+    unsigned depth_{0};
+    unsigned oldest_{0};
+};
+
+///Iterator to the smallest live value of the tree rooted at root
+Iterator begin(Node* root);
+
+inline
+Iterator end(Node*) {
+    return Iterator{};
+}
+
+///Iterator to the first live value >= val
+Iterator lower_bound(Node* root, val_t val);
+
+///Iterator to the first live value > val
+Iterator upper_bound(Node* root, val_t val);
+
+///Call fn(val) for every live value in [lo, hi), in increasing order
+template<class Fn>
+void for_each_in_range(Node* root, val_t lo, val_t hi, Fn fn) {
+    for(Iterator itr = lower_bound(root, lo); itr != end(root); ++itr) {
+        val_t val = *itr;
+        if(val >= hi) {
+            break;
+        }
+        fn(val);
+    }
+}
+
+}
@@ -1,11 +1,18 @@
 #include "kset_node.h"
+#include "node_arena.h"
 #include <iostream>
 #include <cstring>
+#include <new>
+#include <algorithm>
+
+#ifdef USE_SIMD
+#include <immintrin.h>
+#endif
 
 namespace Kset {
 
 /// We use posix_memalign to guarantee alignment.
-/// Todo: Use a pool of nodes
+/// Trees created by make_tree() get their child blocks from a NodeArena instead
 void* Node::operator new[](size_t size) {
     void* memptr = nullptr;
     if(int ret = posix_memalign(&memptr, cache_line_size, size) != 0) {
@@ -34,8 +41,355 @@ void Node::operator delete(void* p) {
     free(p);
 }
 
+Node* Node::allocBlock(Node* parent, NodeArena* arena) {
+    if(arena) {
+        return initBlock(arena->allocBlock(), parent);
+    }
+
+    Node* block = new Node[block_nodes]{};
+    for(NodeIdx_t i = 0; i <= capacity; i++) {
+        Node* d = block + i;
+        d->parent_.setPtr(parent);
+    }
+#ifdef USE_ORDER_STATS
+    ::new (block + capacity + 1) BlockCounts{};
+#endif
+    return block;
+}
+
+Node* Node::initBlock(void* mem, Node* parent) {
+    Node* block = static_cast<Node*>(mem);
+    for(NodeIdx_t i = 0; i <= capacity; i++) {
+        ::new (block + i) Node{};
+        block[i].parent_.setPtr(parent);
+    }
+#ifdef USE_ORDER_STATS
+    ::new (block + capacity + 1) BlockCounts{};
+#endif
+    return block;
+}
+
+void Node::expand(NodeArena* arena) {
+    ASSERT(!children());
+    children_.setPtr(allocBlock(this, arena));
+}
+
+Node* Node::cloneChildren(void* mem) const {
+    ASSERT(mem && children());
+    Node* block = static_cast<Node*>(mem);
+    for(NodeIdx_t i = 0; i <= capacity; i++) {
+        ::new (block + i) Node(children()[i]);
+        //Drop the lock and obsolete flags
+        block[i].children_.setData(block[i].children_.getData() & tombstone_mask);
+    }
+#ifdef USE_ORDER_STATS
+    ::new (block + capacity + 1) BlockCounts(*reinterpret_cast<const BlockCounts*>(children() + capacity + 1));
+#endif
+    return block;
+}
+
+void Node::adoptChildren() {
+    if(Node* c = children()) {
+        for(NodeIdx_t i = 0; i <= capacity; i++) {
+            //Released, since a ConcurrentKset writer may climb up to us before we are published
+            c[i].parent_.publishPtr(this);
+        }
+    }
+}
+
+void Node::writeRecord(uint64_t childRecord, uint64_t parentRecord, void* out) const {
+    ASSERT(!(childRecord >> 48) && !(parentRecord >> 48));
+    Node* record = ::new (out) Node{};
+    for(NodeIdx_t i = 0; i < capacity; i++) {
+        record->vals_[i] = vals_[i];
+    }
+    record->children_.setPtr(reinterpret_cast<void*>(childRecord));
+    record->setTombstones(tombstones());
+    record->parent_.setPtr(reinterpret_cast<void*>(parentRecord));
+    record->parent_.setData(numValues());
+}
+
+void Node::clear() {
+    children_ = PackedPtr{};
+    setTombstones(0);
+    for(NodeIdx_t i = 0; i < capacity; i++) {
+        vals_[i] = std::numeric_limits<val_t>::max();
+    }
+    setNumValues(0);
+}
+
+void Node::moveTo(Node* dest) {
+    ASSERT(!dest->numValues() && !dest->children());
+    dest->children_ = children_;
+    dest->setTombstones(tombstones());
+    for(NodeIdx_t i = 0; i < capacity; i++) {
+        dest->vals_[i] = vals_[i];
+    }
+    dest->setNumValues(numValues());
+    dest->adoptChildren();
+    clear();
+}
+
+void Node::pushDown(NodeArena* arena) {
+#ifdef USE_ORDER_STATS
+    const uint64_t count = subtreeCount();
+#endif
+    Node* block = allocBlock(this, arena);
+    moveTo(block);
+    children_.setPtr(block);
+#ifdef USE_ORDER_STATS
+    childCounts()[0] = count;
+#endif
+}
+
+void Node::splitChild(NodeIdx_t idx, NodeIdx_t mid, NodeArena* arena) {
+    ASSERT(!isFull() && children());
+    Node* block = children();
+    Node* left = block + idx;
+    const NodeIdx_t n = left->numValues();
+    ASSERT(left->isFull() && mid < n);
+
+    //Make room for the new sibling right after left
+    for(NodeIdx_t i = numValues(); i > idx; i--) {
+        block[i].moveTo(block + i + 1);
+#ifdef USE_ORDER_STATS
+        childCounts()[i + 1] = childCounts()[i];
+#endif
+    }
+    Node* right = block + idx + 1;
+
+    //The value at mid moves up. It lands at idx since all of left lies between our values at idx-1 and idx
+    bool live = left->isLive(mid);
+    NodeIdx_t promotedIdx{invalid_idx};
+    std::tie(promotedIdx, std::ignore) = insert(left->vals_[mid]);
+    ASSERT(promotedIdx == idx);
+    if(!live) {
+        kill(idx);
+    }
+
+    //The values after mid (and the children around them) move to right
+    Tombstones rightDead = 0;
+    for(NodeIdx_t i = mid + 1; i < n; i++) {
+        right->vals_[i - mid - 1] = left->vals_[i];
+        if(!left->isLive(i)) {
+            rightDead |= Tombstones{1} << (i - mid - 1);
+        }
+    }
+    right->setTombstones(rightDead);
+    right->setNumValues(n - mid - 1);
+
+    if(Node* lc = left->children()) {
+        Node* rc = allocBlock(right, arena);
+        right->children_.setPtr(rc);
+        for(NodeIdx_t i = mid + 1; i <= n; i++) {
+            lc[i].moveTo(rc + i - mid - 1);
+#ifdef USE_ORDER_STATS
+            right->childCounts()[i - mid - 1] = left->childCounts()[i];
+            left->childCounts()[i] = 0;
+#endif
+        }
+    }
+
+    //left keeps the values before mid
+    for(NodeIdx_t i = mid; i < n; i++) {
+        left->vals_[i] = std::numeric_limits<val_t>::max();
+    }
+    left->setTombstones(left->tombstones() & ((Tombstones{1} << mid) - 1));
+    left->setNumValues(mid);
+
+#ifdef USE_ORDER_STATS
+    childCounts()[idx] = left->subtreeCount();
+    childCounts()[idx + 1] = right->subtreeCount();
+#endif
+}
+
+#ifdef USE_ORDER_STATS
+uint64_t Node::subtreeCount() const {
+    uint64_t count = numLive();
+    if(children()) {
+        for(NodeIdx_t i = 0; i <= capacity; i++) {
+            count += childCounts()[i];
+        }
+    }
+    return count;
+}
+#endif
+
+void Node::purgeTombstones() {
+    ASSERT(!children());
+    NodeIdx_t n = 0;
+    for(NodeIdx_t i = 0; i < numValues(); i++) {
+        if(isLive(i)) {
+            vals_[n++] = vals_[i];
+        }
+    }
+    for(NodeIdx_t i = n; i < numValues(); i++) {
+        //Keep the sentinel invariant that the AVX2 find relies on
+        vals_[i] = std::numeric_limits<val_t>::max();
+    }
+    setTombstones(0);
+    setNumValues(n);
+}
+
 Node::~Node() {
-    delete[] children_;
+    if(ownsArena()) {
+        //All descendents live in the arena. Never run their destructors
+        delete arena();
+    } else {
+        delete[] children();
+    }
+}
+
+#ifdef USE_SIMD
+
+/// The SIMD kernels are compiled for their instruction set with target attributes rather than with
+/// -march, so that the rest of the binary still runs on CPUs that lack them. They are only ever
+/// called after the CPU has been checked
+
+__attribute__((target("avx2")))
+std::tuple<NodeIdx_t,bool> Node::findAvx2(const Node* node, val_t val) {
+    //We look at the node 32 bytes at a time till we find the branching point, i.e. the
+    //first value > val. The unused slots hold a sentinel, so we always find one unless
+    //val is the sentinel itself.
+    constexpr unsigned lanes = sizeof(Node) / sizeof(int64_t);
+    constexpr int64_t maxint64 = std::numeric_limits<int64_t>::max();
+    const __m256i* chunks = reinterpret_cast<const __m256i*>(node);
+
+    //Remember that the first 16 bytes are not really values and so we need an
+    //approprite mask to mask them out
+    __m256i targetp = _mm256_set_epi64x(val, val, maxint64, maxint64);
+
+    //The words that are not values (the two ptrs up front, and the tombstones at the end of a 4 line node)
+    //are left out of the loads. ConcurrentKset writers store to them while readers search the node
+    const __m256i firstLanes = _mm256_set_epi64x(-1, -1, 0, 0);
+    const __m256i lastLanes = _mm256_set_epi64x(0, -1, -1, -1);
+
+    //The lane of the first value > val, counting the two ptrs
+    unsigned lane = lanes;
+    for(unsigned c = 0; c < lanes / 4; c++) {
+        const long long* chunk = reinterpret_cast<const long long*>(chunks + c);
+        __m256i vals = c == 0 ? _mm256_maskload_epi64(chunk, firstLanes)
+                     : node_lines == 4 && c == lanes / 4 - 1 ? _mm256_maskload_epi64(chunk, lastLanes)
+                     : _mm256_load_si256(chunks + c);
+
+        //Compare for greater than. We now run into one of the several annoying gaps in the SSE/AVX2 instruction set
+        //Here, we have intrinsics only for > comparison, but not for >=. So we will have to detect the equality later
+        //as seen below.
+        __m256i maskgtp = _mm256_cmpgt_epi64(vals, targetp);
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(maskgtp));
+        if(mask != 0) {
+            lane = c * 4 + __builtin_ctz(mask);
+            break;
+        }
+        targetp = _mm256_set1_epi64x(val);
+    }
+    ASSERT(lane > 1);
+
+    //When looking for max int64, the sentinels compare equal too (and a 4 line node ends with its
+    //tombstones, not a value). Only trust our own values
+    const NodeIdx_t n = node->numValues();
+    NodeIdx_t idx = std::min<unsigned>(lane - 2, n);
+
+    //Since we have compared for > , we need to check for equality. idx is the first location
+    //that is greater than our value. So see if the the value at (idx-1) is equal to val
+    bool found = idx > 0 && node->vals_[idx-1] == val;
+    idx = found ? idx-1 : idx;
+    return {idx,found};
 }
 
+__attribute__((target("avx512f")))
+std::tuple<NodeIdx_t,bool> Node::findAvx512(const Node* node, val_t val) {
+    //A cache line fits in one register, so one masked compare per line finds the branching point.
+    //The first two lanes are the children and parent ptrs and the mask also leaves out the unused
+    //slots, so unlike the AVX2 kernel we do not even depend on the sentinels. The load takes the same
+    //mask, so it never reads the ptrs, which ConcurrentKset writers store to while readers search
+    const NodeIdx_t n = node->numValues();
+    const uint64_t valueLanes = ((uint64_t{1} << n) - 1) << 2;
+    const __m512i target = _mm512_set1_epi64(val);
+    const __m512i* lines = reinterpret_cast<const __m512i*>(node);
+
+    NodeIdx_t idx = n;
+    for(unsigned l = 0; l < node_lines; l++) {
+        const __mmask8 lanes = static_cast<__mmask8>(valueLanes >> (8 * l));
+        __mmask8 ge = _mm512_mask_cmpge_epi64_mask(lanes, _mm512_maskz_load_epi64(lanes, lines + l), target);
+        if(ge) {
+            idx = 8 * l + __builtin_ctz(ge) - 2;
+            break;
+        }
+    }
+    return {idx, idx < n && node->vals_[idx] == val};
+}
+
+#else
+
+std::tuple<NodeIdx_t,bool> Node::findAvx2(const Node* node, val_t val) {
+    return findScalar(node, val);
+}
+
+std::tuple<NodeIdx_t,bool> Node::findAvx512(const Node* node, val_t val) {
+    return findScalar(node, val);
+}
+
+#endif
+
+bool Node::supports(FindKernel kernel) {
+#ifdef USE_SIMD
+    //We may be called from static initializers, before the cpu model has been set up
+    __builtin_cpu_init();
+    switch(kernel) {
+    case FindKernel::avx512:
+        return __builtin_cpu_supports("avx512f");
+    case FindKernel::avx2:
+        return __builtin_cpu_supports("avx2");
+    case FindKernel::scalar:
+        return true;
+    }
+    return false;
+#else
+    return kernel == FindKernel::scalar;
+#endif
+}
+
+Node::FindKernel Node::bestFindKernel() {
+    for(FindKernel kernel : {FindKernel::avx512, FindKernel::avx2}) {
+        if(supports(kernel)) {
+            return kernel;
+        }
+    }
+    return FindKernel::scalar;
+}
+
+/// Starts out with the scalar kernel (constant initialized, so it is safe to use from other
+/// static initializers) and gets switched to the best one below
+Node::FindFn Node::find_fn_ = &Node::findScalar;
+
+Node::FindKernel Node::findKernel() {
+    if(find_fn_ == &Node::findAvx512) {
+        return FindKernel::avx512;
+    }
+    if(find_fn_ == &Node::findAvx2) {
+        return FindKernel::avx2;
+    }
+    return FindKernel::scalar;
+}
+
+void Node::setFindKernel(FindKernel kernel) {
+    if(!supports(kernel)) {
+        return;
+    }
+    switch(kernel) {
+    case FindKernel::avx512:
+        find_fn_ = &Node::findAvx512;
+        break;
+    case FindKernel::avx2:
+        find_fn_ = &Node::findAvx2;
+        break;
+    case FindKernel::scalar:
+        find_fn_ = &Node::findScalar;
+        break;
+    }
+}
+
+static const bool find_kernel_selected = (Node::setFindKernel(Node::bestFindKernel()), true);
+
 }
@@ -7,10 +7,6 @@
 #include "errors.h"
 #include "packed_ptr.h"
 
-#ifdef USE_AVX2
-#include <immintrin.h>
-#endif
-
 /**
  * \defgroup Kset Integer Set designed to minimize memory accesses a.k.a simplified BTree
  *
@@ -65,13 +61,29 @@
  *
  * The main advantage of the above design is to better utilize all memory that we touch (i.e. that gets fetched into cache)
  * An added (relatively small) advantage is that we can use AVX2/AVX512 instructions to find the branching point when
- * searching for a value. We provide a CMake option to enable using AVX2. We can compare 4 64 bit ints at one shot and thus
- * ideally need only 2 comparisons (to cover 64 bytes) to find the branching point (i.e. which child node to descend to)
+ * searching for a value. With AVX2 we can compare 4 64 bit ints at one shot and thus ideally need only 2 comparisons
+ * (to cover 64 bytes) to find the branching point (i.e. which child node to descend to). With AVX-512 a single masked
+ * compare covers the whole cache line. Which of these kernels is used is decided once at startup based on what the
+ * CPU supports (see Node::FindKernel), so a single binary runs everywhere.
+ *
+ * Nodes can also be built 2 or 4 cache lines wide (KSET_NODE_LINES, see the KSET_NODE_LINES option in CMakeLists.txt).
+ * The layout stays the same, with 14 or 29 values after the two ptrs. The adjacent line prefetcher tends to fetch
+ * the second line of a 128 byte node for free, and wider nodes make for a shallower tree. The kernels above just
+ * loop over the extra lines. With 29 values the tombstone mask (see below) no longer fits in the free bits of
+ * childptr, so a 4 line node gives up its last value slot for it.
  *
  **/
 
+#ifndef KSET_NODE_LINES
+#define KSET_NODE_LINES 1
+#endif
+
+static_assert(KSET_NODE_LINES == 1 || KSET_NODE_LINES == 2 || KSET_NODE_LINES == 4, "a Node is 1, 2 or 4 cache lines");
+
 namespace Kset {
 
+class NodeArena;
+
 //todo Use strong typedefs for these
 
 ///The location of a value is given by a pointer to a node and the index within that node
@@ -96,54 +108,246 @@ using val_t = int64_t;
 class alignas(64) Node {
 
   public:
-    ///Number of values that can be stored in one node
-    static constexpr unsigned capacity = 6;
+    ///Cache lines taken up by one node
+    static constexpr unsigned node_lines = KSET_NODE_LINES;
+
+    ///Number of values that can be stored in one node. All but the two ptrs (and, for 4 lines, the tombstones)
+    static constexpr unsigned capacity = node_lines == 4 ? 29 : node_lines * 8 - 2;
+
+#ifdef USE_ORDER_STATS
+    ///Nodes taken up by a child block: the capacity+1 children, followed by their subtree counts
+    static constexpr unsigned block_nodes = capacity + 2;
+#else
+    static constexpr unsigned block_nodes = capacity + 1;
+#endif
 
   private:
     ///In case I get lucky some day and have a supercomputer with a cache line != 64
     static constexpr int cache_line_size = 64;
 
-    ///Pointer to the "next level" of 7 contigous Nodes.
-    Node* children_{nullptr};
+    ///Pointer to the "next level" of capacity+1 contigous Nodes. Unless the node is 4 lines wide, the low bits of
+    ///the top 16 bits are a mask of the values in this node that have been erased (tombstones). See Kset::erase().
+    ///The two highest bits are the lock and obsolete flags that ConcurrentKset writers use
+    PackedPtr children_;
+
+    ///A bit per value slot, set for the slots that hold tombstones
+    using Tombstones = uint64_t;
+    static constexpr bool packed_tombstones = capacity <= 14;
 
-    ///Top 16 bits will hold numValues in the node and lower 48 bits will be the pointer to the parent
+    ///The top 16 bits of children_ are split between the tombstone mask and flags
+    static constexpr uint16_t tombstone_mask = packed_tombstones ? (1u << capacity) - 1 : 0;
+    static constexpr uint16_t locked_flag = 0x8000;
+    static constexpr uint16_t obsolete_flag = 0x4000;
+
+    ///Top 16 bits will hold numValues in the node and lower 48 bits will be the pointer to the parent.
+    ///The root of a tree created by make_tree() has no parent, so it instead points to the NodeArena
+    ///that owns all the child blocks of the tree and sets owns_arena_flag
     PackedPtr parent_;
 
+    ///The top 16 bits of parent_ are split between numValues and flags
+    static constexpr uint16_t num_values_mask = 0x00FF;
+    static constexpr uint16_t owns_arena_flag = 0x8000;
+
     ///Our data
     int64_t vals_[capacity];
 
+#if KSET_NODE_LINES == 4
+    ///Where the tombstone mask goes when it does not fit in children_. Accessed atomically, like children_
+    Tombstones tombstones_{0};
+#endif
+
+    Tombstones tombstones() const {
+#if KSET_NODE_LINES == 4
+        return __atomic_load_n(&tombstones_, __ATOMIC_RELAXED);
+#else
+        return children_.getData() & tombstone_mask;
+#endif
+    }
+
+    void setTombstones(Tombstones dead) {
+#if KSET_NODE_LINES == 4
+        __atomic_store_n(&tombstones_, dead, __ATOMIC_RELAXED);
+#else
+        children_.setData((children_.getData() & ~tombstone_mask) | dead);
+#endif
+    }
+
+#ifdef USE_ORDER_STATS
+    ///The Node sized slot after a child block. Its first word stays 0 so that, should the slot be destroyed
+    ///as part of a heap allocated block of Nodes, it reads as a childless and parentless Node
+    struct BlockCounts {
+        uint64_t unused;
+        uint64_t counts[capacity + 1];
+    };
+    static_assert(sizeof(BlockCounts) <= cache_line_size * node_lines, "the counts must fit in one Node");
+#endif
+
   public:
     Node* children() const {
-        return children_;
+        return children_.getPtr<Node>();
     }
 
     Node* parent() const {
-        return parent_.getPtr<Node>();
+        return ownsArena() ? nullptr : parent_.getPtr<Node>();
+    }
+
+    ///Is this the root of a tree whose child blocks are carved out of a NodeArena
+    bool ownsArena() const {
+        return parent_.getData() & owns_arena_flag;
+    }
+
+    ///The arena that allocates the child blocks of this tree. Only the root knows it.
+    NodeArena* arena() const {
+        return ownsArena() ? parent_.getPtr<NodeArena>() : nullptr;
+    }
+
+    ///Hand over ownership of arena to this (parentless) node. The arena is destroyed along with the node
+    void adoptArena(NodeArena* arena) {
+        ASSERT(!parent_.getPtr<void>() && !children());
+        parent_.setPtr(arena);
+        parent_.setData(parent_.getData() | owns_arena_flag);
     }
 
     ///How many values do we currently have in the node
     uint16_t numValues() const  {
         //We are stealing 16 bits from the parent ptr to store the numValues
-        return parent_.getData();
+        return parent_.getData() & num_values_mask;
     }
 
     void incrementNumValues() {
         parent_.setData(parent_.getData() + 1);
     }
 
+    ///Fast path for building a node from sorted input. val must be greater than all our values
+    void append(val_t val) {
+        ASSERT(!isFull() && (numValues() == 0 || vals_[numValues()-1] < val));
+        vals_[numValues()] = val;
+        incrementNumValues();
+    }
+
+    void setNumValues(uint16_t n) {
+        ASSERT(n <= capacity);
+        parent_.setData((parent_.getData() & ~num_values_mask) | n);
+    }
+
+    ///An erased value stays in its slot as a tombstone. It still acts as the branching point
+    ///for the children on either side of it, but it is no longer a member of the set
+    bool isLive(NodeIdx_t idx) const {
+        return !(tombstones() & (Tombstones{1} << idx));
+    }
+
+    bool hasTombstones() const {
+        return tombstones();
+    }
+
+    void kill(NodeIdx_t idx) {
+        ASSERT(idx < numValues());
+        setTombstones(tombstones() | (Tombstones{1} << idx));
+    }
+
+    void revive(NodeIdx_t idx) {
+        setTombstones(tombstones() & ~(Tombstones{1} << idx));
+    }
+
+    ///Number of values in this node that are not tombstones
+    uint16_t numLive() const {
+        return numValues() - __builtin_popcountll(tombstones());
+    }
+
+#ifdef USE_ORDER_STATS
+    ///With USE_ORDER_STATS, every child block carries the number of live values in the subtree of each of
+    ///its nodes (see Kset::rank()). Node only keeps these right across the changes it makes to the shape of
+    ///the tree (expand(), pushDown(), splitChild()). Whoever adds or removes a value updates the counts of
+    ///the ancestors
+    uint64_t* childCounts() const {
+        ASSERT(children());
+        return reinterpret_cast<BlockCounts*>(children() + capacity + 1)->counts;
+    }
+
+    ///Number of live values in our subtree, from our own values and the counts of our children
+    uint64_t subtreeCount() const;
+#endif
+
+    ///A leaf does not need its tombstones for branching, so they can be dropped by sliding the live
+    ///values down. This is how an insert into a full leaf reuses the slots of erased values
+    void purgeTombstones();
+
     bool isFull() const {
         return numValues() == capacity;
     }
 
-    void expand() {
-        ASSERT(!children_);
-        children_ = new Node[capacity+1]{};
-        for(NodeIdx_t i = 0; i <= capacity; i++) {
-            Node* d = children_ + i;
-            d->parent_.setPtr(this);
+    ///Allocate the block of capacity+1 child nodes. The block comes from arena if we have one, else
+    ///from the heap. Note that only the root knows the arena, so callers need to pass it down
+    void expand(NodeArena* arena = nullptr);
+
+    ///Move the values and children of this node into the first node of a fresh child block, leaving
+    ///this node empty with that block below it. Balanced trees grow in height this way, which keeps
+    ///the root at the same address
+    void pushDown(NodeArena* arena = nullptr);
+
+    ///B-Tree split of the full child at idx around its value at mid. The value at mid moves up into
+    ///this node at idx, and the values after it move (along with their children) into a new sibling
+    ///at idx+1. The siblings after idx shift up by one slot in the child block. This node must not be full
+    void splitChild(NodeIdx_t idx, NodeIdx_t mid, NodeArena* arena = nullptr);
+
+    ///Allocate and construct a child block whose nodes all point back to parent
+    static Node* allocBlock(Node* parent, NodeArena* arena);
+
+    ///Same, but in raw cache line aligned memory that the caller got from a NodeArena
+    static Node* initBlock(void* mem, Node* parent);
+
+    ///Copy on write support for ConcurrentKset, whose readers must never see a node half way through
+    ///a change. A modified copy of a child block is built off to the side and then swapped in.
+
+    ///Copy our child block into mem, raw memory for a block from a NodeArena. The copies share their children
+    ///with the originals and come out unlocked
+    Node* cloneChildren(void* mem) const;
+
+    ///Point our children back at us (after we were cloned)
+    void adoptChildren();
+
+    ///Swap in block as our child block with a single (release) store
+    void publishChildren(Node* block) {
+        children_.publishPtr(block);
+    }
+
+    ///On disk (see MappedKset), a node is stored as a record with exactly our layout, except that the
+    ///children and parent ptrs are replaced by record numbers in the file. Write that record to out
+    void writeRecord(uint64_t childRecord, uint64_t parentRecord, void* out) const;
+
+    ///The record number of our child block (0 if none), if we are such a record
+    uint64_t childRecord() const {
+        return children_.packedWord() & uint64_t(0x0000FFFFFFFFFFFF);
+    }
+
+    ///A ConcurrentKset writer holds the lock of a node while it changes the node's children_ word, i.e.
+    ///its tombstones or its child block. Returns false, without locking, if the node is obsolete
+    bool lock() {
+        for(;;) {
+            uint64_t word = children_.loadWord();
+            uint16_t data = word >> 48;
+            if(data & obsolete_flag) {
+                return false;
+            }
+            if(!(data & locked_flag) && children_.compareExchangeWord(word, word | (uint64_t(locked_flag) << 48))) {
+                return true;
+            }
+            __builtin_ia32_pause();
         }
     }
 
+    void unlock() {
+        ASSERT(children_.getData() & locked_flag);
+        children_.publishData(children_.getData() & ~locked_flag);
+    }
+
+    ///A node is obsolete once the block it lives in has been replaced by a copy. It stays locked for
+    ///good, so that writers who reached it before the swap notice and start over
+    void markObsolete() {
+        ASSERT(children_.getData() & locked_flag);
+        children_.publishData(children_.getData() | obsolete_flag);
+    }
+
     val_t at(NodeIdx_t idx) const {
         ASSERT(idx >= 0 && idx < capacity);
         return vals_[idx];
@@ -151,51 +355,84 @@ class alignas(64) Node {
 
     /// If val already exists or was successfully inserted, returns {idx,true}
     /// else, returns {idx,false} where idx is the location where it should logically
-    /// have been inserted were the node not already full
+    /// have been inserted were the node not already full. If val is present as a
+    /// tombstone, then that slot is brought back to life
     std::tuple<NodeIdx_t,bool> insert(int64_t val) {
         bool found{false};
         NodeIdx_t idx{invalid_idx};
 
         std::tie(idx,found) = find(val);
-        if(!found) {
-            if(!isFull()) {
-                for(NodeIdx_t i = numValues(); i > idx; i--) {
-                    vals_[i] = vals_[i-1];
-                }
-                vals_[idx] = val;
-                incrementNumValues();
-                found = true;
+        if(found) {
+            revive(idx);
+        } else if(!isFull()) {
+            for(NodeIdx_t i = numValues(); i > idx; i--) {
+                vals_[i] = vals_[i-1];
             }
+            vals_[idx] = val;
+
+            //The tombstones at or after idx move up by one along with their values
+            Tombstones dead = tombstones();
+            Tombstones below = dead & ((Tombstones{1} << idx) - 1);
+            setTombstones(below | (((dead >> idx) << (idx + 1)) & ((Tombstones{1} << capacity) - 1)));
+
+            incrementNumValues();
+            found = true;
         }
 
         return {idx, found};
     }
 
-#ifndef USE_AVX2
     /// returns {idx, true} if found else {idx, false} where
     /// idx is the logical position where the val should have been
-    /// were it present in the node
+    /// were it present in the node. Tombstones are matched like any other
+    /// value since they are still needed for branching. Use isLive() to tell them apart
     std::tuple<NodeIdx_t,bool> find(val_t val) const {
-        NodeIdx_t idx = 0;
-        for(idx = 0; idx < numValues() && vals_[idx] < val; idx++);
-        if(idx == numValues() || vals_[idx] != val) {
-            return {idx, false};
-        } else {
-            return {idx,true};
-        }
-    }
+#ifdef USE_SIMD
+        return find_fn_(this, val);
 #else
-    /// Use AVX2 instructions for optimized find
-    /// As described in the design details, the performance gains by
-    /// additionally using SIMD instructions to find the branching point
-    /// are minimal compared to the gains by utilizing all the memory in a cache line
-    std::tuple<NodeIdx_t,bool> find(int64_t val) const;
-
-    /// When using AVX2 find, we will have to rely on a sentinel value in the node. So
-    /// we need a constructor to fill in the sentinel value
-    Node();
+        return findScalar(this, val);
 #endif
+    }
+
+    /// The SIMD kernels compare the whole cache line (including the children and parent
+    /// ptrs, which are masked out) and so rely on a sentinel value in the unused slots.
+    /// So we need a constructor to fill in the sentinel value
+    Node();
+
+    /// The implementations of find(). As described in the design details, the performance gains by
+    /// additionally using SIMD instructions to find the branching point are minimal compared to the
+    /// gains by utilizing all the memory in a cache line, but they are not nothing.
+    enum class FindKernel { scalar, avx2, avx512 };
+
+    /// Can the CPU we are running on use kernel
+    static bool supports(FindKernel kernel);
+
+    /// The best kernel the CPU supports. This is what find() uses unless told otherwise
+    static FindKernel bestFindKernel();
+
+    static FindKernel findKernel();
+
+    /// Switch the kernel used by find(). Not thread safe, so only call this at startup
+    /// (or from tests and benchmarks). Ignored if the CPU does not support kernel
+    static void setFindKernel(FindKernel kernel);
 
+  private:
+    using FindFn = std::tuple<NodeIdx_t,bool> (*)(const Node*, val_t);
+
+    static std::tuple<NodeIdx_t,bool> findScalar(const Node* node, val_t val);
+    static std::tuple<NodeIdx_t,bool> findAvx2(const Node* node, val_t val);
+    static std::tuple<NodeIdx_t,bool> findAvx512(const Node* node, val_t val);
+
+    ///The kernel chosen at startup
+    static FindFn find_fn_;
+
+    ///Move our values, tombstones and children into dest, which must be empty. We are left empty
+    void moveTo(Node* dest);
+
+    ///Drop all values, tombstones and children (without freeing them). The parent is kept
+    void clear();
+
+  public:
     /// We control the memory management for the Node class to ensure that we get memory
     /// aligned on a cache boundary
     void* operator new[](size_t size);
@@ -203,11 +440,12 @@ class alignas(64) Node {
 
     void operator delete(void* p);
     void operator delete[](void* p);
+
+    ///Deletes the child blocks recursively. If this is the root of an arena backed tree, then the
+    ///arena is destroyed instead, which releases all the child blocks in one shot
     ~Node();
 };
 
-#ifdef USE_AVX2
-
 inline
 Node::Node() {
     for(NodeIdx_t i = 0; i < capacity; i++) {
@@ -217,57 +455,16 @@ Node::Node() {
 }
 
 inline
-std::tuple<NodeIdx_t,bool> Node::find(val_t val) const {
-    //We first look in the first 32 bytes. If we dont find the branching point there,
-    //we look in the next 32 bytes.
-
-    bool found{false};
-    NodeIdx_t idx{0};
-    constexpr int64_t maxint64 = std::numeric_limits<int64_t>::max();
-
-    //Load the first 32 bytes
-    __m256i valsp = _mm256_load_si256(reinterpret_cast<const __m256i*>(this));
-
-    //Remember that the first 16 bytes are not really values and so we need an
-    //approprite mask to mask them out
-    __m256i targetp = {maxint64, maxint64,val,val};
-
-    //Compare for greater than. We now run into one of the several annoying gaps in the SSE/AVX2 instruction set
-    //Here, we have intrinsics only for > comparison, but not for >=. So we will have to detect the equality later
-    //as seen below.
-    __m256i maskgtp = _mm256_cmpgt_epi64(valsp,targetp);
-    int mask = _mm256_movemask_epi8(maskgtp);
-
-    if(mask != 0) {
-        //we have found the value/branching point in the first 32 bytes of the cache line
-        unsigned trailingZeroes = __builtin_ctz(static_cast<uint32_t>(mask));
-        unsigned firstQuad = trailingZeroes / 8;
-        ASSERT(firstQuad > 1);
-        idx = firstQuad - 2;
-
-        //Since we have compared for > , we need to check for equality. idx is the first location
-        //that is greater than our value. So see if the the value at (idx-1) is equal to val
-        found = idx > 0 ? vals_[idx-1] == val : false;
-        idx = found ? idx-1 : idx;
+std::tuple<NodeIdx_t,bool> Node::findScalar(const Node* node, val_t val) {
+    NodeIdx_t idx = 0;
+    for(idx = 0; idx < node->numValues() && node->vals_[idx] < val; idx++);
+    if(idx == node->numValues() || node->vals_[idx] != val) {
+        return {idx, false};
     } else {
-        //we need to look in the trailing 32 bytes of the cache line. We basically repeat the above again.
-        valsp = _mm256_load_si256(reinterpret_cast<const __m256i*>(&vals_[2]));
-        targetp = _mm256_set1_epi64x(val);
-        maskgtp = _mm256_cmpgt_epi64(valsp,targetp);
-        int mask = _mm256_movemask_epi8(maskgtp);
-
-        unsigned trailingZeroes = mask ? __builtin_ctz(static_cast<uint32_t>(mask))
-                                       : 32;
-        unsigned firstQuad = (trailingZeroes / 8);
-        idx = firstQuad + 2;
-        found = vals_[idx-1] == val ? true : false;
-        idx = found ? idx -1 : idx;
+        return {idx,true};
     }
-    return {idx,found};
 }
 
-#endif
-
-static_assert(sizeof(Node) == 64, "sizeof(Node) == 64");
+static_assert(sizeof(Node) == 64 * Node::node_lines, "sizeof(Node) == 64 * KSET_NODE_LINES");
 
 }
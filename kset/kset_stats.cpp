@@ -0,0 +1,45 @@
+#include "kset_stats.h"
+#include "node_arena.h"
+
+namespace Kset {
+
+namespace {
+
+void collect(const Node* node, size_t level, TreeStats& stats) {
+    if(stats.levels.size() <= level) {
+        stats.levels.resize(level + 1);
+    }
+    LevelStats& levelStats = stats.levels[level];
+    levelStats.nodes++;
+    levelStats.values += node->numValues();
+
+    stats.numNodes++;
+    stats.numValues += node->numLive();
+    stats.numTombstones += node->numValues() - node->numLive();
+    if(level > 0 && node->numValues() == 0) {
+        stats.numEmptyNodes++;
+    }
+
+    if(!node->children()) {
+        if(node->numValues() > 0) {
+            levelStats.leaves++;
+        }
+        return;
+    }
+    stats.numBlocks++;
+    for(NodeIdx_t i = 0; i <= Node::capacity; i++) {
+        collect(node->children() + i, level + 1, stats);
+    }
+}
+
+}
+
+TreeStats stats(const Node* root) {
+    TreeStats stats;
+    collect(root, 0, stats);
+    stats.allocatedBytes = sizeof(Node) * (1 + stats.numBlocks * Node::block_nodes);
+    stats.reservedBytes = root->arena() ? sizeof(Node) + root->arena()->bytesReserved() : stats.allocatedBytes;
+    return stats;
+}
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "kset_node.h"
+
+/**
+ * \ingroup Kset
+ */
+
+namespace Kset {
+
+///What we find on one level of the tree. Level 0 is the root, level 1 its child block and so on
+struct LevelStats {
+    ///Nodes on this level, including the empty ones
+    uint64_t nodes{0};
+
+    ///Value slots in use on this level, tombstones included
+    uint64_t values{0};
+
+    ///Nodes on this level that hold values but have no children
+    uint64_t leaves{0};
+
+    ///Fraction of the value slots of this level that are in use
+    double fill() const {
+        return nodes ? double(values) / (nodes * Node::capacity) : 0;
+    }
+};
+
+/**
+ * @brief The shape of a tree and the memory it takes up, as reported by stats()
+ *
+ * Every expand() allocates a whole block of capacity+1 nodes, even if only one of them ever gets a value. So a
+ * tree can take up a good deal more memory than its values need, and how much depends on how it was built
+ * (insert(), insert_balanced() or bulk_load()). These numbers are meant for capacity planning
+ */
+struct TreeStats {
+    ///Live values, i.e. the size of the set
+    uint64_t numValues{0};
+
+    ///Erased values that still take up a slot (see erase())
+    uint64_t numTombstones{0};
+
+    ///Nodes in the tree, the root and every node of every child block
+    uint64_t numNodes{0};
+
+    ///Child blocks
+    uint64_t numBlocks{0};
+
+    ///Nodes other than the root that hold no value
+    uint64_t numEmptyNodes{0};
+
+    ///Memory taken up by the root and the child blocks
+    uint64_t allocatedBytes{0};
+
+    ///Memory obtained from the system for the tree. For an arena backed tree this is what the arena has reserved,
+    ///which includes the unused tail of its last slab and any blocks handed back to it. Else the same as allocatedBytes
+    uint64_t reservedBytes{0};
+
+    ///levels[l] describes level l. So the tree is levels.size() deep
+    std::vector<LevelStats> levels;
+
+    double bytesPerValue() const {
+        return numValues ? double(allocatedBytes) / numValues : 0;
+    }
+
+    ///Fraction of all value slots in the tree that are in use
+    double fill() const {
+        return numNodes ? double(numValues + numTombstones) / (numNodes * Node::capacity) : 0;
+    }
+
+    size_t depth() const {
+        return levels.size();
+    }
+};
+
+///Walk the whole tree rooted at root and collect its TreeStats. This touches every node, so it is as expensive as
+///iterating over the tree
+TreeStats stats(const Node* root);
+
+}
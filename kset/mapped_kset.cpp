@@ -0,0 +1,213 @@
+#include "mapped_kset.h"
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <limits>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace Kset {
+
+namespace {
+
+constexpr char file_magic[8] = {'K', 'S', 'E', 'T', 'F', 'I', 'L', 'E'};
+constexpr uint32_t file_version = 1;
+
+///Record 0 of the file
+struct alignas(sizeof(Node)) FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t capacity;
+    uint32_t reserved;
+    uint64_t numRecords;
+};
+
+static_assert(sizeof(FileHeader) == sizeof(Node), "the header must take up exactly one record");
+
+constexpr uint64_t root_record = 1;
+
+[[noreturn]] void throwErrno(const char* what, const std::string& path) {
+    throw std::runtime_error(std::string(what) + " " + path + ": " + std::strerror(errno));
+}
+
+uint64_t countRecords(const Node* node) {
+    uint64_t n = 1;
+    if(const Node* c = node->children()) {
+        for(NodeIdx_t i = 0; i <= Node::capacity; i++) {
+            n += countRecords(c + i);
+        }
+    }
+    return n;
+}
+
+///Child blocks are numbered in depth first order. next is the first unused record
+void writeSubtree(const Node* node, uint64_t num, uint64_t parentNum, char* records, uint64_t& next) {
+    const Node* c = node->children();
+    uint64_t childNum = 0;
+    if(c) {
+        childNum = next;
+        next += Node::capacity + 1;
+    }
+    node->writeRecord(childNum, parentNum, records + num * sizeof(Node));
+    if(c) {
+        for(NodeIdx_t i = 0; i <= Node::capacity; i++) {
+            writeSubtree(c + i, childNum + i, num, records, next);
+        }
+    }
+}
+
+}
+
+void save(const Node* root, const std::string& path) {
+    ASSERT(root);
+    const uint64_t numRecords = 1 + countRecords(root);
+    const size_t length = numRecords * sizeof(Node);
+
+    //Write to the side and rename, so that processes that have the old file mapped are not pulled from under
+    const std::string tmpPath = path + ".tmp";
+    int fd = ::open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        throwErrno("cannot create", tmpPath);
+    }
+    if(::ftruncate(fd, length) != 0) {
+        ::close(fd);
+        throwErrno("cannot resize", tmpPath);
+    }
+    void* mem = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(mem == MAP_FAILED) {
+        throwErrno("cannot map", tmpPath);
+    }
+
+    char* records = static_cast<char*>(mem);
+    FileHeader* header = ::new (records) FileHeader{};
+    std::memcpy(header->magic, file_magic, sizeof(file_magic));
+    header->version = file_version;
+    header->recordSize = sizeof(Node);
+    header->capacity = Node::capacity;
+    header->numRecords = numRecords;
+
+    uint64_t next = root_record + 1;
+    writeSubtree(root, root_record, 0, records, next);
+    ASSERT(next == numRecords);
+
+    bool synced = ::msync(mem, length, MS_SYNC) == 0;
+    ::munmap(mem, length);
+    if(!synced) {
+        throwErrno("cannot write", tmpPath);
+    }
+    if(std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        throwErrno("cannot rename to", path);
+    }
+}
+
+MappedKset::MappedKset(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        throwErrno("cannot open", path);
+    }
+    struct stat st;
+    if(::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throwErrno("cannot stat", path);
+    }
+    length_ = st.st_size;
+    if(length_ < 2 * sizeof(Node) || length_ % sizeof(Node)) {
+        ::close(fd);
+        throw std::runtime_error("not a Kset file: " + path);
+    }
+    void* mem = ::mmap(nullptr, length_, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(mem == MAP_FAILED) {
+        throwErrno("cannot map", path);
+    }
+
+    const FileHeader* header = static_cast<const FileHeader*>(mem);
+    if(std::memcmp(header->magic, file_magic, sizeof(file_magic)) || header->version != file_version ||
+            header->recordSize != sizeof(Node) || header->capacity != Node::capacity ||
+            header->numRecords != length_ / sizeof(Node)) {
+        ::munmap(mem, length_);
+        throw std::runtime_error("not a Kset file (or written by an incompatible version): " + path);
+    }
+    records_ = static_cast<const Node*>(mem);
+    numRecords_ = header->numRecords;
+}
+
+MappedKset::~MappedKset() {
+    ::munmap(const_cast<Node*>(records_), length_);
+}
+
+bool MappedKset::find(val_t val) const {
+    const Node* node = record(root_record);
+    while(node) {
+        NodeIdx_t idx{invalid_idx};
+        bool found{false};
+        std::tie(idx,found) = node->find(val);
+        if(found) {
+            return node->isLive(idx);
+        }
+        node = child(node, idx);
+    }
+    return false;
+}
+
+std::tuple<val_t, bool> MappedKset::next_geq(val_t val) const {
+    return next_geq(record(root_record), val);
+}
+
+std::tuple<val_t, bool> MappedKset::successor(val_t val) const {
+    if(val == std::numeric_limits<val_t>::max()) {
+        return std::make_tuple(val_t{-1}, false);
+    }
+    return next_geq(record(root_record), val + 1);
+}
+
+std::tuple<val_t, bool> MappedKset::next_geq(const Node* node, val_t val) const {
+    NodeIdx_t idx{invalid_idx};
+    bool found{false};
+    std::tie(idx,found) = node->find(val);
+    if(found && node->isLive(idx)) {
+        return std::make_tuple(val, true);
+    }
+
+    //In order, what follows val is (the rest of) the child at idx (or, if val is a tombstone at idx, the
+    //child after it) and then the values and children after that
+    std::tuple<val_t, bool> next{-1, false};
+    NodeIdx_t i = idx;
+    if(found) {
+        next = first_live(child(node, ++i));
+    } else if(const Node* c = child(node, idx)) {
+        next = next_geq(c, val);
+    }
+
+    for(; !std::get<1>(next) && i < node->numValues(); i++) {
+        if(node->isLive(i)) {
+            return std::make_tuple(node->at(i), true);
+        }
+        next = first_live(child(node, i + 1));
+    }
+    return next;
+}
+
+std::tuple<val_t, bool> MappedKset::first_live(const Node* node) const {
+    if(!node) {
+        return std::make_tuple(val_t{-1}, false);
+    }
+    for(NodeIdx_t i = 0; i <= node->numValues(); i++) {
+        auto first = first_live(child(node, i));
+        if(std::get<1>(first)) {
+            return first;
+        }
+        if(i < node->numValues() && node->isLive(i)) {
+            return std::make_tuple(node->at(i), true);
+        }
+    }
+    return std::make_tuple(val_t{-1}, false);
+}
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+#include <tuple>
+#include "kset_node.h"
+
+/**
+ * \ingroup Kset
+ */
+
+namespace Kset {
+
+/**
+ * @brief The MappedKset class
+ *
+ * A read only Kset that lives in a file written by save(). Rebuilding a large set with insert() at startup
+ * takes minutes, while mapping the file takes milliseconds: there is nothing to parse and nothing to allocate,
+ * and processes that map the same file share its pages in the page cache.
+ *
+ * The file is an array of 64 byte, cache line aligned records. Record 0 is a header and record 1 is the root.
+ * Every other record is a node laid out exactly like a Node (values, sentinels, numValues and tombstones in the
+ * same places), except that the children and parent ptrs are replaced by record numbers (see Node::writeRecord()).
+ * So the usual Node::find() kernels run on the records as they are, and a child block is 7 consecutive records.
+ * Blocks are laid out in depth first order, so that a subtree tends to share pages.
+ *
+ * The records are native (i.e. x86_64 little endian) and tied to Node::capacity, both of which the header checks.
+ */
+
+class MappedKset {
+  public:
+    ///Map the file at path. Throws std::runtime_error if it cannot be mapped or was not written by save()
+    explicit MappedKset(const std::string& path);
+    ~MappedKset();
+
+    MappedKset(const MappedKset&) = delete;
+    MappedKset& operator=(const MappedKset&) = delete;
+
+    bool find(val_t val) const;
+
+    ///Smallest value >= val. Returns {val, true} or {-1, false} if there is none
+    std::tuple<val_t, bool> next_geq(val_t val) const;
+
+    ///Smallest value > val. Returns {val, true} or {-1, false} if there is none
+    std::tuple<val_t, bool> successor(val_t val) const;
+
+    ///Number of node records in the file (excluding the header)
+    uint64_t numNodes() const {
+        return numRecords_ - 1;
+    }
+
+  private:
+    const Node* record(uint64_t num) const {
+        ASSERT(num > 0 && num < numRecords_);
+        return records_ + num;
+    }
+
+    ///The child of node at idx, or nullptr if node is a leaf
+    const Node* child(const Node* node, NodeIdx_t idx) const {
+        uint64_t childRecord = node->childRecord();
+        return childRecord ? record(childRecord + idx) : nullptr;
+    }
+
+    ///Smallest live value >= val in the subtree of node
+    std::tuple<val_t, bool> next_geq(const Node* node, val_t val) const;
+
+    ///Smallest live value in the subtree of node
+    std::tuple<val_t, bool> first_live(const Node* node) const;
+
+    const Node* records_{nullptr};
+    uint64_t numRecords_{0};
+    size_t length_{0};
+};
+
+///Write the tree under root to a file at path that MappedKset can map. Throws std::runtime_error on failure
+void save(const Node* root, const std::string& path);
+
+}
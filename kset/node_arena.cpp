@@ -0,0 +1,75 @@
+#include "node_arena.h"
+#include "kset_node.h"
+#include <sys/mman.h>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+
+namespace Kset {
+
+constexpr size_t NodeArena::huge_page_size;
+
+static constexpr size_t block_size = sizeof(Node) * Node::block_nodes;
+
+NodeArena::NodeArena(bool useHugePages, size_t slabSize, size_t trailerSize)
+    : useHugePages_(useHugePages),
+      slabSize_(slabSize),
+      blockSize_(block_size + trailerSize)
+{
+    ASSERT(trailerSize % alignof(Node) == 0);
+    ASSERT(slabSize_ >= blockSize_);
+    ASSERT(!useHugePages_ || slabSize_ % huge_page_size == 0);
+}
+
+NodeArena::~NodeArena() {
+    for(void* slab : slabs_) {
+        free(slab);
+    }
+}
+
+void NodeArena::newSlab() {
+    void* memptr = nullptr;
+    size_t alignment = useHugePages_ ? huge_page_size : alignof(Node);
+    if(int ret = posix_memalign(&memptr, alignment, slabSize_)) {
+        std::cerr << "posix_memalign failed due to : " << std::strerror(ret) << std::endl;
+        throw std::bad_alloc();
+    }
+
+    if(useHugePages_) {
+        //Only a hint. If THP is disabled we silently fall back to regular pages
+        madvise(memptr, slabSize_, MADV_HUGEPAGE);
+    }
+
+    slabs_.push_back(memptr);
+    cur_ = static_cast<char*>(memptr);
+    end_ = cur_ + slabSize_;
+}
+
+void* NodeArena::allocBlock() {
+    if(freeList_) {
+        void* block = freeList_;
+        freeList_ = *static_cast<void**>(block);
+        return block;
+    }
+    if(static_cast<size_t>(end_ - cur_) < blockSize_) {
+        newSlab();
+    }
+    void* block = cur_;
+    cur_ += blockSize_;
+    return block;
+}
+
+void NodeArena::absorb(NodeArena& other) {
+    ASSERT(other.blockSize_ == blockSize_ && other.slabSize_ == slabSize_);
+    slabs_.insert(slabs_.end(), other.slabs_.begin(), other.slabs_.end());
+    other.slabs_.clear();
+    other.cur_ = other.end_ = nullptr;
+    other.freeList_ = nullptr;
+}
+
+void NodeArena::freeBlock(void* block) {
+    *static_cast<void**>(block) = freeList_;
+    freeList_ = block;
+}
+
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * \ingroup Kset
+ */
+
+namespace Kset {
+
+class Node;
+
+/**
+ * @brief The NodeArena class
+ *
+ * Every Node::expand() needs a block of Node::capacity + 1 contiguous, cache line aligned Nodes. Getting
+ * each of these from posix_memalign means millions of mallocs for a large tree and child blocks that end up
+ * scattered all over the heap. Instead, a NodeArena carves the blocks out of large slabs. All slabs are released in
+ * one shot when the arena dies, which is what makes tearing down a large tree cheap (no recursive delete
+ * cascade). Blocks that a tree stops using (e.g. the old copies left behind by ConcurrentKset) can be
+ * handed back individually and are reused by later allocations.
+ *
+ * If useHugePages is set, the slabs are 2MB aligned and we ask the kernel to back them with transparent
+ * huge pages. This cuts down dTLB misses when descending a large tree.
+ *
+ * Every block can be followed by trailerSize bytes of raw memory for data that rides along with the block's
+ * nodes, at a fixed offset from them (see KMap). These are handed out and reused as part of the block.
+ */
+
+class NodeArena {
+  public:
+    static constexpr size_t huge_page_size = 2 * 1024 * 1024;
+
+    explicit NodeArena(bool useHugePages = false, size_t slabSize = huge_page_size, size_t trailerSize = 0);
+    ~NodeArena();
+
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+
+    ///Returns raw (unconstructed) cache line aligned memory for one block of child nodes (and its trailer)
+    void* allocBlock();
+
+    ///Give back a block for reuse. Its contents (and whatever its nodes point to) are not touched
+    void freeBlock(void* block);
+
+    ///Take over the slabs of other (which must carve out blocks of the same size), so that the blocks it
+    ///handed out live as long as we do. Its free blocks are not reused. This is how the subtrees that
+    ///parallel_bulk_load() builds in arenas of their own end up owned by the tree
+    void absorb(NodeArena& other);
+
+    ///Total bytes obtained from the system so far
+    size_t bytesReserved() const {
+        return slabs_.size() * slabSize_;
+    }
+
+    bool usesHugePages() const {
+        return useHugePages_;
+    }
+
+  private:
+    void newSlab();
+
+    bool useHugePages_;
+    size_t slabSize_;
+    size_t blockSize_;
+    std::vector<void*> slabs_;
+    char* cur_{nullptr};
+    char* end_{nullptr};
+
+    ///Blocks handed back by freeBlock(), linked through their first word
+    void* freeList_{nullptr};
+};
+
+}
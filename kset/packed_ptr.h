@@ -14,34 +14,74 @@ namespace Kset
  * @brief The PackedPtr class
  * In x86_64, top 16 bits of a 64 bit pointer are not used.
  * So we can steal these bits and store other data in them
+ *
+ * A ConcurrentKset reader loads these words while writers change them, so every access is atomic (plain
+ * movs on x86_64): the reader sees either the old or the new word, and never a mix of the two
  */
 
 class PackedPtr {
     std::uint64_t packedWord_{0};
 public:
+    PackedPtr() = default;
+
+    ///Copying a node (e.g. ConcurrentKset cloning a block) may race with a writer that changes the word
+    PackedPtr(const PackedPtr& other)
+        : packedWord_(other.packedWord())
+    {}
+
+    PackedPtr& operator=(const PackedPtr& other) {
+        __atomic_store_n(&packedWord_, other.packedWord(), __ATOMIC_RELAXED);
+        return *this;
+    }
+
+    ///With acquire semantics, so that whatever was written to *ptr before publishPtr(ptr) is visible
     template<class T>
     T* getPtr() const {
-        return reinterpret_cast<T *>(packedWord_ & std::uint64_t(0x0000FFFFFFFFFFFF));
+        return reinterpret_cast<T *>(loadWord() & std::uint64_t(0x0000FFFFFFFFFFFF));
     }
 
     template<class T>
     void setPtr(T* ptr) {
         ASSERT(!((reinterpret_cast<uint64_t>(ptr)) >> 48));
-        packedWord_ &= uint64_t(0xFFFF000000000000);
-        packedWord_ |= reinterpret_cast<uint64_t>(ptr);
+        uint64_t word = (packedWord() & uint64_t(0xFFFF000000000000)) | reinterpret_cast<uint64_t>(ptr);
+        __atomic_store_n(&packedWord_, word, __ATOMIC_RELAXED);
     }
 
     std::uint16_t getData() const {
-        return packedWord_ >> 48;
+        return packedWord() >> 48;
     }
 
     void setData(std::uint16_t val) {
-        packedWord_ &= uint64_t(0x0000FFFFFFFFFFFF);
-        packedWord_ |= (uint64_t(val) << 48);
+        uint64_t word = (packedWord() & uint64_t(0x0000FFFFFFFFFFFF)) | (uint64_t(val) << 48);
+        __atomic_store_n(&packedWord_, word, __ATOMIC_RELAXED);
+    }
+
+    ///Same as setPtr(), but with release semantics, so that everything written to *ptr
+    ///before is visible to a reader that sees ptr
+    template<class T>
+    void publishPtr(T* ptr) {
+        ASSERT(!((reinterpret_cast<uint64_t>(ptr)) >> 48));
+        uint64_t word = (packedWord() & uint64_t(0xFFFF000000000000)) | reinterpret_cast<uint64_t>(ptr);
+        __atomic_store_n(&packedWord_, word, __ATOMIC_RELEASE);
+    }
+
+    ///Same as setData(), but with release semantics
+    void publishData(std::uint16_t val) {
+        uint64_t word = (packedWord() & uint64_t(0x0000FFFFFFFFFFFF)) | (uint64_t(val) << 48);
+        __atomic_store_n(&packedWord_, word, __ATOMIC_RELEASE);
+    }
+
+    std::uint64_t loadWord() const {
+        return __atomic_load_n(&packedWord_, __ATOMIC_ACQUIRE);
+    }
+
+    ///Replace the whole word with desired if it still is expected
+    bool compareExchangeWord(std::uint64_t expected, std::uint64_t desired) {
+        return __atomic_compare_exchange_n(&packedWord_, &expected, desired, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
     }
 
     std::uint64_t packedWord() const {
-        return packedWord_;
+        return __atomic_load_n(&packedWord_, __ATOMIC_RELAXED);
     }
 };
 
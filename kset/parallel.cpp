@@ -0,0 +1,68 @@
+#include "parallel.h"
+
+namespace Kset {
+
+std::vector<TreePiece> split_tree(Node* root, val_t first, val_t last, size_t target) {
+    //A piece along with the open range (after, before) its values lie in. Open, so that neither end
+    //has to step past the min or max int64 that the values may include
+    struct Bounded {
+        TreePiece piece;
+        val_t after;
+        val_t before;
+        bool hasAfter;
+        bool hasBefore;
+    };
+
+    std::vector<Bounded> pieces{{{root, invalid_idx}, 0, 0, false, false}};
+    std::vector<Bounded> next;
+    size_t numSubtrees{1};
+    bool split{true};
+    //A level at a time, so that the pieces stay about the same size in a balanced tree
+    while(split && numSubtrees < target) {
+        split = false;
+        numSubtrees = 0;
+        next.clear();
+        for(const Bounded& b : pieces) {
+            Node* node = b.piece.node;
+            Node* children = node->children();
+            if(b.piece.idx != invalid_idx || !children) {
+                next.push_back(b);
+                numSubtrees += b.piece.idx == invalid_idx;
+                continue;
+            }
+            split = true;
+            const NodeIdx_t n = node->numValues();
+            for(NodeIdx_t i = 0; i <= n; i++) {
+                //Everything in child i is above value i-1 and below value i
+                Node* child = children + i;
+                Bounded c{{child, invalid_idx}, b.after, b.before, b.hasAfter, b.hasBefore};
+                if(i) {
+                    c.after = node->at(i-1);
+                    c.hasAfter = true;
+                }
+                if(i < n) {
+                    c.before = node->at(i);
+                    c.hasBefore = true;
+                }
+                bool overlaps = (!c.hasAfter || c.after < last) && (!c.hasBefore || first < c.before);
+                if(overlaps && (child->numValues() || child->children())) {
+                    next.push_back(c);
+                    numSubtrees++;
+                }
+                if(i < n && node->at(i) >= first && node->at(i) <= last) {
+                    next.push_back({{node, i}, 0, 0, false, false});
+                }
+            }
+        }
+        pieces.swap(next);
+    }
+
+    std::vector<TreePiece> result;
+    result.reserve(pieces.size());
+    for(const Bounded& b : pieces) {
+        result.push_back(b.piece);
+    }
+    return result;
+}
+
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <limits>
+#include <utility>
+#include <vector>
+#include "kset_node.h"
+#include "kset_iterator.h"
+#include "work_stealing.h"
+
+/**
+ * \ingroup Kset
+ */
+
+namespace Kset {
+
+/**
+ * Passes over all the values of a tree (or those in a key range) on several threads: checksums, exports,
+ * filtering into new sets ...
+ *
+ * A child block holds the subtrees of all the children of a node side by side, so the top of the tree
+ * splits naturally into independent pieces. The top levels are split block by block into the subtrees
+ * below them (and the few values in between) till there are enough pieces to go around, and every piece
+ * becomes a task for a WorkStealing pool. Trees built by plain insert() can be lopsided, so a few pieces
+ * per thread are made and the threads steal what the others have not got to yet.
+ *
+ * Within a piece, values are visited in increasing order with an Iterator, but pieces run concurrently,
+ * so fn must be safe to call from several threads at once. The tree must not be changed meanwhile.
+ * numThreads 0 means one per hardware thread
+ */
+
+///A piece of a tree for one task: the whole subtree of node or, if idx is valid, just the value at idx
+struct TreePiece {
+    Node* node;
+    NodeIdx_t idx;
+};
+
+///Split the tree rooted at root into pieces, in increasing order of their values, till there are at least
+///target subtrees (or nothing left to split). Pieces that cannot hold a value in [first, last] are left out
+std::vector<TreePiece> split_tree(Node* root, val_t first, val_t last, size_t target);
+
+///Call fn(val) for every live value of piece in [first, last], in increasing order
+template<class Fn>
+void for_each_in_piece(const TreePiece& piece, val_t first, val_t last, Fn& fn) {
+    if(piece.idx != invalid_idx) {
+        val_t val = piece.node->at(piece.idx);
+        if(piece.node->isLive(piece.idx) && val >= first && val <= last) {
+            fn(val);
+        }
+        return;
+    }
+    for(Iterator itr = lower_bound(piece.node, first); itr != end(piece.node); ++itr) {
+        val_t val = *itr;
+        if(val > last) {
+            break;
+        }
+        fn(val);
+    }
+}
+
+///Pieces of the tree per thread, so that stealing can even out differences in their size
+static constexpr size_t pieces_per_thread = 8;
+
+///Call fn(val) for every live value in [first, last]. Unlike a half open range, this can take in max int64
+template<class Fn>
+void parallel_for_each_between(Node* root, val_t first, val_t last, Fn fn, unsigned numThreads = 0) {
+    WorkStealing pool(numThreads);
+    const std::vector<TreePiece> pieces = split_tree(root, first, last, pool.numWorkers() * pieces_per_thread);
+    for(size_t i = 0; i < pieces.size(); i++) {
+        pool.spawn(i % pool.numWorkers(), [&pieces, i, first, last, &fn](unsigned) {
+            for_each_in_piece(pieces[i], first, last, fn);
+        });
+    }
+    pool.run();
+}
+
+///Call fn(val) for every live value in [lo, hi)
+template<class Fn>
+void parallel_for_each_in_range(Node* root, val_t lo, val_t hi, Fn fn, unsigned numThreads = 0) {
+    if(lo < hi) {
+        parallel_for_each_between(root, lo, hi - 1, fn, numThreads);
+    }
+}
+
+///Call fn(val) for every live value of the tree
+template<class Fn>
+void parallel_for_each(Node* root, Fn fn, unsigned numThreads = 0) {
+    parallel_for_each_between(root, std::numeric_limits<val_t>::min(), std::numeric_limits<val_t>::max(), fn, numThreads);
+}
+
+///Fold the live values in [first, last] into a T. Every piece is folded on its own, starting from init, with
+///acc = op(acc, val) in increasing order of val. The results of the pieces are then folded, left to right,
+///with result = combine(result, piece), starting from init. So init must be an identity of combine (e.g.
+///0 for a sum) and combine must be associative, but neither has to be commutative
+template<class T, class Op, class Combine>
+T parallel_reduce_between(Node* root, val_t first, val_t last, T init, Op op, Combine combine, unsigned numThreads = 0) {
+    WorkStealing pool(numThreads);
+    const std::vector<TreePiece> pieces = split_tree(root, first, last, pool.numWorkers() * pieces_per_thread);
+    std::vector<T> partials(pieces.size(), init);
+    for(size_t i = 0; i < pieces.size(); i++) {
+        pool.spawn(i % pool.numWorkers(), [&pieces, &partials, i, first, last, &op](unsigned) {
+            T acc = std::move(partials[i]);
+            auto fold = [&acc, &op](val_t val) {
+                acc = op(std::move(acc), val);
+            };
+            for_each_in_piece(pieces[i], first, last, fold);
+            partials[i] = std::move(acc);
+        });
+    }
+    pool.run();
+
+    T result = init;
+    for(const T& partial : partials) {
+        result = combine(std::move(result), partial);
+    }
+    return result;
+}
+
+///Same, over the live values in [lo, hi)
+template<class T, class Op, class Combine>
+T parallel_reduce_in_range(Node* root, val_t lo, val_t hi, T init, Op op, Combine combine, unsigned numThreads = 0) {
+    if(lo >= hi) {
+        return init;
+    }
+    return parallel_reduce_between(root, lo, hi - 1, init, op, combine, numThreads);
+}
+
+template<class T, class Op, class Combine>
+T parallel_reduce(Node* root, T init, Op op, Combine combine, unsigned numThreads = 0) {
+    return parallel_reduce_between(root, std::numeric_limits<val_t>::min(), std::numeric_limits<val_t>::max(),
+                                   init, op, combine, numThreads);
+}
+
+///For a T that values fold into with the same op that combines two Ts (sums, xors, max ...)
+template<class T, class Op>
+T parallel_reduce(Node* root, T init, Op op) {
+    return parallel_reduce(root, init, op, op);
+}
+
+}
@@ -0,0 +1,31 @@
+#include "set_ops.h"
+#include "kset.h"
+#include <vector>
+
+namespace Kset {
+
+namespace {
+
+///bulk_load() needs to know the size up front, so the result is collected first
+template<class Op>
+Node* build(Op op, bool useHugePages) {
+    std::vector<val_t> vals;
+    op([&vals](val_t val) { vals.push_back(val); });
+    return bulk_load(vals.data(), vals.data() + vals.size(), useHugePages);
+}
+
+}
+
+Node* set_union(Node* a, Node* b, bool useHugePages) {
+    return build([a, b](auto fn) { set_union(a, b, fn); }, useHugePages);
+}
+
+Node* set_intersection(Node* a, Node* b, bool useHugePages) {
+    return build([a, b](auto fn) { set_intersection(a, b, fn); }, useHugePages);
+}
+
+Node* set_difference(Node* a, Node* b, bool useHugePages) {
+    return build([a, b](auto fn) { set_difference(a, b, fn); }, useHugePages);
+}
+
+}
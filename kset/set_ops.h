@@ -0,0 +1,94 @@
+#pragma once
+
+#include "kset_node.h"
+#include "kset_iterator.h"
+
+/**
+ * \ingroup Kset
+ */
+
+namespace Kset {
+
+/**
+ * Set algebra over two trees, by merging their sorted streams of live values rather than doing a find()
+ * in one tree for every value of the other.
+ *
+ * Each operation comes in two flavours. The first calls fn(val) for every value of the result, in increasing
+ * order. The second bulk builds the result into a new, packed tree (see bulk_load()) that the caller owns.
+ *
+ * set_intersection() and set_difference() gallop: rather than stepping through a stretch of one tree that has
+ * no counterpart in the other, they Iterator::seek() past it, which only costs the log of the distance skipped.
+ * So intersecting a small set with a large one costs about as much as looking up the small one in the large one,
+ * while two similar sets are merged at the cost of iterating them.
+ */
+
+template<class Fn>
+void set_union(Node* a, Node* b, Fn fn) {
+    Iterator ia = begin(a), ib = begin(b);
+    const Iterator last = end(a);
+    while(ia != last && ib != last) {
+        val_t va = *ia, vb = *ib;
+        if(va <= vb) {
+            fn(va);
+            ++ia;
+            if(va == vb) {
+                ++ib;
+            }
+        } else {
+            fn(vb);
+            ++ib;
+        }
+    }
+    for(; ia != last; ++ia) {
+        fn(*ia);
+    }
+    for(; ib != last; ++ib) {
+        fn(*ib);
+    }
+}
+
+template<class Fn>
+void set_intersection(Node* a, Node* b, Fn fn) {
+    Iterator ia = begin(a), ib = begin(b);
+    const Iterator last = end(a);
+    while(ia != last && ib != last) {
+        val_t va = *ia, vb = *ib;
+        if(va == vb) {
+            fn(va);
+            ++ia;
+            ++ib;
+        } else if(va < vb) {
+            ia.seek(vb);
+        } else {
+            ib.seek(va);
+        }
+    }
+}
+
+///Values of a that are not in b
+template<class Fn>
+void set_difference(Node* a, Node* b, Fn fn) {
+    Iterator ia = begin(a), ib = begin(b);
+    const Iterator last = end(a);
+    for(; ia != last; ++ia) {
+        val_t va = *ia;
+        if(ib != last && *ib < va) {
+            ib.seek(va);
+        }
+        if(ib == last) {
+            break;
+        }
+        if(*ib != va) {
+            fn(va);
+        }
+    }
+    for(; ia != last; ++ia) {
+        fn(*ia);
+    }
+}
+
+Node* set_union(Node* a, Node* b, bool useHugePages = false);
+Node* set_intersection(Node* a, Node* b, bool useHugePages = false);
+Node* set_difference(Node* a, Node* b, bool useHugePages = false);
+
+}
@@ -0,0 +1,236 @@
+#include "sharded_kset.h"
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace Kset {
+
+namespace {
+
+///Below this many keys for a shard, sorting them for insert_batch() costs more than the sweep saves
+constexpr size_t small_batch = 64;
+
+///Orders Iterators for a min heap by their current values
+struct LaterValue {
+    bool operator()(const Iterator& a, const Iterator& b) const {
+        return *a > *b;
+    }
+};
+
+}
+
+void ShardedKset::SpinLock::lock() {
+    for(unsigned spins = 0;; spins++) {
+        if(!locked_.load(std::memory_order_relaxed) && !locked_.exchange(true, std::memory_order_acquire)) {
+            return;
+        }
+        if(spins < 64) {
+            __builtin_ia32_pause();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void* ShardedKset::Shard::operator new(size_t size) {
+    void* memptr = nullptr;
+    if(posix_memalign(&memptr, alignof(Shard), size) != 0) {
+        throw std::bad_alloc();
+    }
+    return memptr;
+}
+
+void ShardedKset::Shard::operator delete(void* p) {
+    free(p);
+}
+
+ShardedKset::ShardedKset(unsigned shardBits, Partition partition, bool useHugePages)
+    : shardBits_(shardBits),
+      partition_(partition) {
+    if(shardBits > max_shard_bits) {
+        throw std::invalid_argument("too many shard bits: " + std::to_string(shardBits));
+    }
+    for(unsigned i = 0; i < (1u << shardBits); i++) {
+        shards_.emplace_back(new Shard);
+        shards_.back()->root.reset(make_tree(useHugePages));
+    }
+}
+
+bool ShardedKset::insert(val_t val) {
+    Shard& shard = *shards_[shardOf(val)];
+    std::lock_guard<SpinLock> lock(shard.lock);
+    bool inserted = std::get<2>(insert_balanced(shard.root.get(), val));
+    shard.size += inserted;
+    return inserted;
+}
+
+bool ShardedKset::erase(val_t val) {
+    Shard& shard = *shards_[shardOf(val)];
+    std::lock_guard<SpinLock> lock(shard.lock);
+    bool erased = Kset::erase(shard.root.get(), val);
+    shard.size -= erased;
+    return erased;
+}
+
+bool ShardedKset::contains(val_t val) const {
+    const Shard& shard = *shards_[shardOf(val)];
+    std::lock_guard<SpinLock> lock(shard.lock);
+    return std::get<2>(Kset::find(shard.root.get(), val));
+}
+
+std::vector<size_t> ShardedKset::groupByShard(const val_t* keys, size_t n, val_t* sorted, size_t* positions) const {
+    //A counting sort by shard
+    std::vector<size_t> offsets(numShards() + 1, 0);
+    for(size_t i = 0; i < n; i++) {
+        offsets[shardOf(keys[i]) + 1]++;
+    }
+    for(unsigned s = 0; s < numShards(); s++) {
+        offsets[s + 1] += offsets[s];
+    }
+    std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+    for(size_t i = 0; i < n; i++) {
+        size_t at = next[shardOf(keys[i])]++;
+        sorted[at] = keys[i];
+        if(positions) {
+            positions[at] = i;
+        }
+    }
+    return offsets;
+}
+
+size_t ShardedKset::insert_batch(const val_t* keys, size_t n) {
+    std::vector<val_t> sorted(n);
+    const std::vector<size_t> offsets = groupByShard(keys, n, sorted.data(), nullptr);
+    size_t inserted{0};
+    for(unsigned s = 0; s < numShards(); s++) {
+        if(offsets[s] == offsets[s + 1]) {
+            continue;
+        }
+        Shard& shard = *shards_[s];
+        std::lock_guard<SpinLock> lock(shard.lock);
+        size_t added{0};
+        if(offsets[s + 1] - offsets[s] < small_batch) {
+            for(size_t i = offsets[s]; i < offsets[s + 1]; i++) {
+                added += std::get<2>(insert_balanced(shard.root.get(), sorted[i]));
+            }
+        } else {
+            added = Kset::insert_batch(shard.root.get(), sorted.data() + offsets[s], offsets[s + 1] - offsets[s]);
+        }
+        shard.size += added;
+        inserted += added;
+    }
+    return inserted;
+}
+
+size_t ShardedKset::erase_batch(const val_t* keys, size_t n) {
+    std::vector<val_t> sorted(n);
+    const std::vector<size_t> offsets = groupByShard(keys, n, sorted.data(), nullptr);
+    size_t erased{0};
+    for(unsigned s = 0; s < numShards(); s++) {
+        if(offsets[s] == offsets[s + 1]) {
+            continue;
+        }
+        Shard& shard = *shards_[s];
+        std::lock_guard<SpinLock> lock(shard.lock);
+        for(size_t i = offsets[s]; i < offsets[s + 1]; i++) {
+            if(Kset::erase(shard.root.get(), sorted[i])) {
+                shard.size--;
+                erased++;
+            }
+        }
+    }
+    return erased;
+}
+
+void ShardedKset::contains_batch(const val_t* keys, size_t n, bool* found) const {
+    std::vector<val_t> sorted(n);
+    std::vector<size_t> positions(n);
+    const std::vector<size_t> offsets = groupByShard(keys, n, sorted.data(), positions.data());
+    std::vector<FindResult> results;
+    for(unsigned s = 0; s < numShards(); s++) {
+        const size_t count = offsets[s + 1] - offsets[s];
+        if(!count) {
+            continue;
+        }
+        results.resize(count);
+        {
+            const Shard& shard = *shards_[s];
+            std::lock_guard<SpinLock> lock(shard.lock);
+            find_batch(shard.root.get(), sorted.data() + offsets[s], count, results.data());
+        }
+        for(size_t i = 0; i < count; i++) {
+            found[positions[offsets[s] + i]] = std::get<2>(results[i]);
+        }
+    }
+}
+
+size_t ShardedKset::size() const {
+    size_t total{0};
+    for(const std::unique_ptr<Shard>& shard : shards_) {
+        std::lock_guard<SpinLock> lock(shard->lock);
+        total += shard->size;
+    }
+    return total;
+}
+
+void ShardedKset::Iterator::push(Kset::Iterator itr) {
+    if(itr != Kset::Iterator()) {
+        heap_.push_back(itr);
+        std::push_heap(heap_.begin(), heap_.end(), LaterValue());
+    }
+}
+
+void ShardedKset::Iterator::refill() {
+    if(set_->partition_ != Partition::high_bits) {
+        return;
+    }
+    while(heap_.empty() && nextShard_ < set_->numShards()) {
+        push(Kset::begin(set_->shardRoot(nextShard_++)));
+    }
+}
+
+ShardedKset::Iterator& ShardedKset::Iterator::operator++() {
+    std::pop_heap(heap_.begin(), heap_.end(), LaterValue());
+    Kset::Iterator next = heap_.back();
+    heap_.pop_back();
+    push(++next);
+    refill();
+    return *this;
+}
+
+ShardedKset::Iterator ShardedKset::begin() const {
+    Iterator itr;
+    itr.set_ = this;
+    if(partition_ == Partition::hash) {
+        for(unsigned s = 0; s < numShards(); s++) {
+            itr.push(Kset::begin(shardRoot(s)));
+        }
+        itr.nextShard_ = numShards();
+    }
+    itr.refill();
+    return itr;
+}
+
+ShardedKset::Iterator ShardedKset::lower_bound(val_t val) const {
+    Iterator itr;
+    itr.set_ = this;
+    if(partition_ == Partition::hash) {
+        for(unsigned s = 0; s < numShards(); s++) {
+            itr.push(Kset::lower_bound(shardRoot(s), val));
+        }
+        itr.nextShard_ = numShards();
+    } else {
+        //The shards below val's hold only smaller values
+        unsigned s = shardOf(val);
+        itr.push(Kset::lower_bound(shardRoot(s), val));
+        itr.nextShard_ = s + 1;
+    }
+    itr.refill();
+    return itr;
+}
+
+}
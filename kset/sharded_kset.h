@@ -0,0 +1,176 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "kset.h"
+
+/**
+ * \ingroup Kset
+ */
+
+namespace Kset {
+
+/**
+ * @brief The ShardedKset class
+ *
+ * A set for many writers made of 2^shardBits independent trees (shards), each behind a lock of its own.
+ * Unlike ConcurrentKset, nothing changes inside a tree: every shard is a plain make_tree() tree, so
+ * lookups and inserts within a shard take the single threaded paths, and writers that pick different
+ * shards never touch the same cache lines. Since the shard is locked anyway, single values go in with
+ * insert_balanced(), so sequential IDs (all of which land in the same shard under Partition::high_bits)
+ * do not turn a shard into a chain the way insert() would.
+ *
+ * Values go to a shard either
+ * - by their high bits (Partition::high_bits), so every shard holds one contiguous key range. The shards
+ *   are then in key order and iterating over them is just visiting one after the other. But skewed keys
+ *   (e.g. timestamps, or only positive values) pile up in a few shards
+ * - or by the high bits of a hash of the value (Partition::hash), which spreads any keys evenly. Ordered
+ *   iteration then has to merge all shards
+ *
+ * The batch operations group their keys by shard first, so each shard is locked only once per batch and
+ * its keys are handled together while it is (with find_batch(), and with insert_batch() once a shard gets
+ * enough of them to be worth sorting).
+ *
+ * Iterators take no locks, so no writer may be active while iterating.
+ */
+
+class ShardedKset {
+  public:
+    enum class Partition { high_bits, hash };
+
+    ///At most max_shard_bits, i.e. 2^16 shards
+    static constexpr unsigned max_shard_bits = 16;
+
+    explicit ShardedKset(unsigned shardBits, Partition partition = Partition::hash, bool useHugePages = false);
+
+    ShardedKset(const ShardedKset&) = delete;
+    ShardedKset& operator=(const ShardedKset&) = delete;
+
+    unsigned numShards() const {
+        return static_cast<unsigned>(shards_.size());
+    }
+
+    ///The shard val lives in
+    unsigned shardOf(val_t val) const {
+        if(!shardBits_) {
+            return 0;
+        }
+        uint64_t key = partition_ == Partition::high_bits
+                           ? uint64_t(val) ^ (uint64_t{1} << 63)      //Negative values first
+                           : uint64_t(val) * 0x9E3779B97F4A7C15ull;   //Fibonacci hashing
+        return static_cast<unsigned>(key >> (64 - shardBits_));
+    }
+
+    ///Return true if val was inserted (erased), or for contains() if it is present
+    bool insert(val_t val);
+    bool erase(val_t val);
+    bool contains(val_t val) const;
+
+    ///Insert (erase) the n values in keys, in any order and with duplicates. Returns how many were inserted (erased)
+    size_t insert_batch(const val_t* keys, size_t n);
+    size_t erase_batch(const val_t* keys, size_t n);
+
+    ///Set found[i] to whether keys[i] is present
+    void contains_batch(const val_t* keys, size_t n, bool* found) const;
+
+    ///Number of values in the set
+    size_t size() const;
+
+    ///The root of a shard's tree, e.g. for parallel_for_each() over it. No writer may be active
+    Node* shardRoot(unsigned shard) const {
+        return shards_[shard]->root.get();
+    }
+
+    /**
+     * @brief The Iterator class
+     * Visits the values of all shards in increasing order. It keeps an Iterator into every shard that still
+     * has values to go (only the current shard for Partition::high_bits) in a min heap by their values
+     */
+    class Iterator {
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = val_t;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const val_t*;
+        using reference = val_t;
+
+        Iterator() = default;
+
+        val_t operator*() const {
+            return *heap_.front();
+        }
+
+        Iterator& operator++();
+
+        bool operator==(const Iterator& other) const {
+            return atEnd() == other.atEnd() && (atEnd() || **this == *other);
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return !(*this == other);
+        }
+
+      private:
+        friend class ShardedKset;
+
+        bool atEnd() const {
+            return heap_.empty();
+        }
+
+        ///Push itr unless it is done
+        void push(Kset::Iterator itr);
+
+        ///Once the heap runs dry, move on to the next shard that has values (Partition::high_bits only)
+        void refill();
+
+        const ShardedKset* set_{nullptr};
+        std::vector<Kset::Iterator> heap_;
+        unsigned nextShard_{0};
+    };
+
+    Iterator begin() const;
+
+    Iterator end() const {
+        return Iterator();
+    }
+
+    ///The first value >= val
+    Iterator lower_bound(val_t val) const;
+
+  private:
+    ///Test and test-and-set. A shard is only held for one operation or one batch's worth of keys, so waiters
+    ///spin for a while before they give up their time slice
+    class SpinLock {
+      public:
+        void lock();
+
+        void unlock() {
+            locked_.store(false, std::memory_order_release);
+        }
+
+      private:
+        std::atomic<bool> locked_{false};
+    };
+
+    ///A cache line (or more) each, so that writers on different shards do not slow each other down
+    struct alignas(64) Shard {
+        mutable SpinLock lock;
+        std::unique_ptr<Node> root;
+        size_t size{0};
+
+        ///As of C++14, plain new need not honor alignas(64) (see Node)
+        void* operator new(size_t size);
+        void operator delete(void* p);
+    };
+
+    ///Order keys[0..n) by shard into sorted[0..n), along with their positions in keys if positions is not null.
+    ///Returns the offsets of the shards' keys in sorted, with an end offset at the back
+    std::vector<size_t> groupByShard(const val_t* keys, size_t n, val_t* sorted, size_t* positions) const;
+
+    const unsigned shardBits_;
+    const Partition partition_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+}
@@ -0,0 +1,111 @@
+#include "work_stealing.h"
+#include "errors.h"
+#include <thread>
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace Kset {
+
+unsigned WorkStealing::workersFor(unsigned numWorkers) {
+    return numWorkers ? numWorkers : std::max(1u, std::thread::hardware_concurrency());
+}
+
+WorkStealing::WorkStealing(unsigned numWorkers)
+    : numWorkers_(workersFor(numWorkers)) {
+    void* memptr = nullptr;
+    if(posix_memalign(&memptr, alignof(Deque), numWorkers_ * sizeof(Deque)) != 0) {
+        throw std::bad_alloc();
+    }
+    deques_ = static_cast<Deque*>(memptr);
+    unsigned built{0};
+    try {
+        for(; built < numWorkers_; built++) {
+            new(deques_ + built) Deque();
+        }
+    } catch(...) {
+        while(built) {
+            deques_[--built].~Deque();
+        }
+        free(memptr);
+        throw;
+    }
+}
+
+WorkStealing::~WorkStealing() {
+    for(unsigned i = 0; i < numWorkers_; i++) {
+        deques_[i].~Deque();
+    }
+    free(deques_);
+}
+
+void WorkStealing::spawn(unsigned worker, Task task) {
+    ASSERT(worker < numWorkers());
+    pending_.fetch_add(1);
+    Deque& deque = deques_[worker];
+    std::lock_guard<std::mutex> lock(deque.mutex);
+    deque.tasks.push_back(std::move(task));
+}
+
+void WorkStealing::run() {
+    std::vector<std::thread> threads;
+    for(unsigned worker = 1; worker < numWorkers(); worker++) {
+        threads.emplace_back([this, worker]() { work(worker); });
+    }
+    work(0);
+    for(std::thread& thread : threads) {
+        thread.join();
+    }
+
+    std::exception_ptr error;
+    std::swap(error, error_);
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void WorkStealing::work(unsigned worker) {
+    Task task;
+    while(pending_.load()) {
+        if(!take(worker, task)) {
+            //Whatever is left is running elsewhere, and may still spawn more
+            std::this_thread::yield();
+            continue;
+        }
+        try {
+            task(worker);
+        } catch(...) {
+            std::lock_guard<std::mutex> lock(errorMutex_);
+            if(!error_) {
+                error_ = std::current_exception();
+            }
+        }
+        task = nullptr;
+        pending_.fetch_sub(1);
+    }
+}
+
+bool WorkStealing::take(unsigned worker, Task& task) {
+    {
+        Deque& own = deques_[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if(!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for(unsigned i = 1; i < numWorkers(); i++) {
+        Deque& victim = deques_[(worker + i) % numWorkers()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if(!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+}
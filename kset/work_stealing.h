@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+
+/**
+ * \ingroup Kset
+ */
+
+namespace Kset {
+
+/**
+ * @brief The WorkStealing class
+ *
+ * Runs a set of tasks on a number of worker threads, for the operations that split a tree (or its input)
+ * into independent pieces: parallel_bulk_load(), parallel_build(), parallel_for_each() ...
+ *
+ * Each worker has a deque of tasks. It takes its own tasks from the back (the most recently spawned, whose
+ * data is most likely still in its cache) and, once it runs out, steals from the front of the others' (the
+ * oldest, which for recursive splitting are the biggest pieces). Tasks may spawn more tasks onto the worker
+ * that runs them. run() returns once every task, including those spawned along the way, is done.
+ *
+ * The threads only live for the duration of run(), so nothing is left running between operations. The
+ * caller works as worker 0
+ */
+
+class WorkStealing {
+  public:
+    ///A task is told which worker runs it, e.g. to pick that worker's NodeArena
+    using Task = std::function<void(unsigned worker)>;
+
+    ///0 workers means one per hardware thread
+    explicit WorkStealing(unsigned numWorkers = 0);
+    ~WorkStealing();
+
+    WorkStealing(const WorkStealing&) = delete;
+    WorkStealing& operator=(const WorkStealing&) = delete;
+
+    ///The number of workers that WorkStealing(numWorkers) runs with
+    static unsigned workersFor(unsigned numWorkers);
+
+    unsigned numWorkers() const {
+        return numWorkers_;
+    }
+
+    ///Queue task for worker. Before run(), spread the tasks over the workers. From within a task, pass
+    ///the worker running it
+    void spawn(unsigned worker, Task task);
+
+    ///Run all the tasks. If a task throws, the remaining ones still run and the first exception is
+    ///rethrown once they are done
+    void run();
+
+  private:
+    ///A cache line (or more) each, so that workers busy with their own deques do not slow each other down
+    struct alignas(64) Deque {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void work(unsigned worker);
+
+    ///Take a task from the back of our own deque, or else from the front of someone else's
+    bool take(unsigned worker, Task& task);
+
+    ///One array of numWorkers_ deques. As of C++14, plain new need not honor alignas(64) (see Node), so it is
+    ///allocated with posix_memalign() and the deques are constructed in place
+    const unsigned numWorkers_;
+    Deque* deques_;
+
+    ///Tasks spawned and not yet finished
+    std::atomic<size_t> pending_{0};
+
+    std::mutex errorMutex_;
+    std::exception_ptr error_;
+};
+
+}
@@ -0,0 +1,131 @@
+#include "gtest/gtest.h"
+#include <kset/kset.h>
+#include <kset/kset_stats.h>
+#include <kset/compact.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace Kset {
+
+/////////////////////////////////////////////////////////////////////////////////////
+/// \brief Tests for Compactor and compact()
+/////////////////////////////////////////////////////////////////////////////////////
+
+static std::vector<int64_t> values(Node* root) {
+    return std::vector<int64_t>(begin(root), end(root));
+}
+
+///A tree the way a long run of random inserts and erases leaves it
+static Node* aged_tree(int size, std::vector<int64_t>& live) {
+    Node* root = make_tree();
+    //Distinct values in random order, since an odd multiplier is a bijection mod 2^40
+    std::vector<int64_t> all;
+    for(uint64_t i = 0; i < uint64_t(size); i++) {
+        all.push_back((i * 0x9E3779B97F4A7C15ull) & ((uint64_t{1} << 40) - 1));
+        insert(root, all.back());
+    }
+    for(size_t i = 0; i < all.size(); i++) {
+        if(i % 3 == 0) {
+            erase(root, all[i]);
+        } else {
+            live.push_back(all[i]);
+        }
+    }
+    std::sort(live.begin(), live.end());
+    return root;
+}
+
+GTEST_TEST(CompactTest, same_values_as_bulk_load) {
+    std::vector<int64_t> live;
+    std::unique_ptr<Node> aged{aged_tree(50000, live)};
+    std::unique_ptr<Node> compacted{compact(aged.get())};
+    ASSERT_EQ(values(compacted.get()), live);
+    ASSERT_EQ(values(aged.get()), live);
+
+    for(int64_t val : live) {
+        ASSERT_TRUE(std::get<2>(find(compacted.get(), val)));
+    }
+
+    //Nothing is left of the tombstones and the empty nodes, and the shape is that of bulk_load()
+    TreeStats before = stats(aged.get());
+    TreeStats after = stats(compacted.get());
+    std::unique_ptr<Node> packed{bulk_load(live.data(), live.data() + live.size())};
+    TreeStats expected = stats(packed.get());
+    ASSERT_GT(before.numTombstones, 0);
+    ASSERT_EQ(after.numTombstones, 0);
+    ASSERT_EQ(after.numValues, live.size());
+    ASSERT_EQ(after.numBlocks, expected.numBlocks);
+    ASSERT_EQ(after.depth(), expected.depth());
+    if(Node::node_lines == 4) {
+        //50k values make for a shallow tree either way
+        ASSERT_LE(after.depth(), before.depth());
+    } else {
+        ASSERT_LT(after.depth(), before.depth());
+    }
+    ASSERT_LT(after.allocatedBytes, before.allocatedBytes);
+    ASSERT_GT(after.fill(), 0.9);
+
+#ifdef USE_ORDER_STATS
+    ASSERT_EQ(size(compacted.get()), live.size());
+    for(size_t k = 0; k < live.size(); k += 97) {
+        ASSERT_EQ(std::get<2>(select(compacted.get(), k)), live[k]);
+        ASSERT_EQ(rank(compacted.get(), live[k]), k);
+    }
+#endif
+}
+
+GTEST_TEST(CompactTest, incremental) {
+    std::vector<int64_t> live;
+    std::unique_ptr<Node> aged{aged_tree(20000, live)};
+
+    Compactor compactor(aged.get());
+    ASSERT_FALSE(compactor.done());
+    int steps{0};
+    while(!compactor.step(100)) {
+        steps++;
+        //The old tree keeps serving lookups in between
+        ASSERT_TRUE(std::get<2>(find(aged.get(), live[steps % live.size()])));
+    }
+    //Each value is copied out and then placed in the new tree, about a hundred at a time
+    ASSERT_GT(steps, int(live.size() / 100));
+    ASSERT_TRUE(compactor.done());
+
+    std::unique_ptr<Node> compacted{compactor.release()};
+    std::unique_ptr<Node> inOneGo{compact(aged.get())};
+    ASSERT_EQ(values(compacted.get()), live);
+    ASSERT_EQ(stats(compacted.get()).numBlocks, stats(inOneGo.get()).numBlocks);
+
+    //The new tree takes inserts like any other
+    insert(compacted.get(), -1);
+    ASSERT_TRUE(std::get<2>(find(compacted.get(), -1)));
+}
+
+GTEST_TEST(CompactTest, empty) {
+    std::unique_ptr<Node> un{make_tree()};
+    std::unique_ptr<Node> compacted{compact(un.get())};
+    ASSERT_TRUE(values(compacted.get()).empty());
+
+    //A tree whose values have all been erased compacts to an empty one
+    for(int64_t i = 0; i < 1000; i++) {
+        insert(un.get(), i);
+    }
+    for(int64_t i = 0; i < 1000; i++) {
+        erase(un.get(), i);
+    }
+    compacted.reset(compact(un.get()));
+    TreeStats s = stats(compacted.get());
+    ASSERT_EQ(s.numNodes, 1);
+    ASSERT_EQ(s.numValues, 0);
+
+    ASSERT_TRUE(Compactor(compacted.get()).step(1));
+
+    //A Compactor that is dropped half way deletes what it has built so far
+    for(int64_t i = 0; i < 1000; i++) {
+        insert(un.get(), i);
+    }
+    Compactor compactor(un.get());
+    ASSERT_FALSE(compactor.step(1500));
+}
+
+}
@@ -0,0 +1,146 @@
+#include "gtest/gtest.h"
+#include <kset/kset.h>
+#include <kset/compressed_kset.h>
+#include <boost/scope_exit.hpp>
+#include <memory>
+#include <set>
+#include <vector>
+#include <limits>
+
+namespace Kset {
+
+/////////////////////////////////////////////////////////////////////////////////////
+/// \brief Tests for compress()/CompressedKset
+/////////////////////////////////////////////////////////////////////////////////////
+
+static void check_compressed(const CompressedKset& compressed, const std::set<int64_t>& vals,
+                             const std::vector<int64_t>& probes) {
+    ASSERT_EQ(compressed.size(), vals.size());
+    std::vector<int64_t> got;
+    compressed.for_each([&got](int64_t val) { got.push_back(val); });
+    ASSERT_EQ(got, std::vector<int64_t>(vals.begin(), vals.end()));
+
+    for(int64_t i : probes) {
+        ASSERT_EQ(compressed.find(i), vals.count(i) == 1) << i;
+
+        int64_t next{0};
+        bool found{false};
+        std::tie(next,found) = compressed.next_geq(i);
+        auto expected = vals.lower_bound(i);
+        ASSERT_EQ(found, expected != vals.end());
+        if(found) {
+            ASSERT_EQ(next, *expected);
+        }
+
+        std::tie(next,found) = compressed.successor(i);
+        expected = vals.upper_bound(i);
+        ASSERT_EQ(found, expected != vals.end());
+        if(found) {
+            ASSERT_EQ(next, *expected);
+        }
+    }
+}
+
+///Every value, its neighbours and a few random values
+static std::vector<int64_t> probes_for(const std::set<int64_t>& vals) {
+    std::vector<int64_t> probes{std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max(), 0};
+    for(int64_t val : vals) {
+        probes.push_back(val);
+        if(val != std::numeric_limits<int64_t>::min()) {
+            probes.push_back(val - 1);
+        }
+        if(val != std::numeric_limits<int64_t>::max()) {
+            probes.push_back(val + 1);
+        }
+    }
+    for(int i = 0; i < 1000; i++) {
+        probes.push_back((int64_t(std::rand()) << 32) ^ std::rand());
+    }
+    return probes;
+}
+
+static CompressedKset compress_set(const std::set<int64_t>& vals) {
+    std::vector<int64_t> sorted(vals.begin(), vals.end());
+    return compress(sorted.data(), sorted.data() + sorted.size());
+}
+
+GTEST_TEST(CompressedTest, encodings) {
+    //Gaps that fit 16 bit deltas, 32 bit deltas and neither
+    for(int64_t gap : {int64_t{1}, int64_t{1000}, int64_t{100000}, int64_t{1} << 40}) {
+        for(int size : {0, 1, 7, 14, 27, 28, 29, 1000}) {
+            std::set<int64_t> vals;
+            for(int i = 0; i < size; i++) {
+                vals.insert(i * gap);
+            }
+            CompressedKset compressed = compress_set(vals);
+            check_compressed(compressed, vals, probes_for(vals));
+        }
+    }
+
+    std::set<int64_t> vals;
+    for(int i = 0; i < 2800; i++) {
+        vals.insert(i * 3);
+    }
+    CompressedKset compressed = compress_set(vals);
+    ASSERT_EQ(compressed.numLines(), 100);
+    ASSERT_EQ(compressed.numLines(CompressedKset::Encoding::delta16), 100);
+}
+
+GTEST_TEST(CompressedTest, clustered) {
+    //Runs of nearby values far from each other, as an ID allocator would hand them out
+    std::set<int64_t> vals;
+    int64_t start = 12345;
+    for(int run = 0; run < 500; run++) {
+        int64_t val = start;
+        for(int i = 0, n = std::rand() % 100; i < n; i++) {
+            val += 1 + std::rand() % 300;
+            vals.insert(val);
+        }
+        start += (int64_t(std::rand() % 1000000) << (run % 24)) + 1;
+    }
+    CompressedKset compressed = compress_set(vals);
+    check_compressed(compressed, vals, probes_for(vals));
+    ASSERT_LT(compressed.bytes(), vals.size() * sizeof(int64_t) / 2);
+}
+
+GTEST_TEST(CompressedTest, from_tree_and_extremes) {
+    std::unique_ptr<Node> root(make_tree());
+    const int64_t lo = std::numeric_limits<int64_t>::min();
+    const int64_t hi = std::numeric_limits<int64_t>::max();
+    //Lines that straddle 0 and the ends of the range
+    std::set<int64_t> vals{lo, lo + 1, hi - 1, hi};
+    for(int i = -50; i < 50; i++) {
+        vals.insert(i * 7);
+    }
+    for(int64_t val : vals) {
+        insert(root.get(), val);
+    }
+    erase(root.get(), 7);
+    vals.erase(7);
+
+    CompressedKset compressed = compress(root.get());
+    check_compressed(compressed, vals, probes_for(vals));
+}
+
+GTEST_TEST(CompressedTest, kernels) {
+    const Node::FindKernel original = Node::findKernel();
+    BOOST_SCOPE_EXIT_ALL(original) {
+        Node::setFindKernel(original);
+    };
+
+    std::set<int64_t> vals;
+    for(int i = 0; i < 3000; i++) {
+        //A mix of all three encodings
+        vals.insert(int64_t(std::rand() % 20000) << (i % 3 ? 0 : 20));
+    }
+    CompressedKset compressed = compress_set(vals);
+    const std::vector<int64_t> probes = probes_for(vals);
+    for(Node::FindKernel kernel : {Node::FindKernel::scalar, Node::FindKernel::avx2, Node::FindKernel::avx512}) {
+        if(Node::supports(kernel)) {
+            Node::setFindKernel(kernel);
+            check_compressed(compressed, vals, probes);
+        }
+    }
+}
+
+}
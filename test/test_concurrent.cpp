@@ -0,0 +1,288 @@
+#include "gtest/gtest.h"
+#include <kset/concurrent_kset.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <random>
+#include <limits>
+
+namespace Kset {
+
+/////////////////////////////////////////////////////////////////////////////////////
+/// \brief Tests for ConcurrentKset and EpochManager
+/////////////////////////////////////////////////////////////////////////////////////
+
+GTEST_TEST(EpochTest, reclaim_waits_for_pinned_readers) {
+    std::vector<void*> freed;
+    EpochManager epoch([&freed](void* p) { freed.push_back(p); });
+    int a{0}, b{0};
+
+    unsigned slot = epoch.registerReader();
+    epoch.pin(slot);
+    epoch.retire(slot, &a);
+    epoch.reclaim(slot);
+    ASSERT_TRUE(freed.empty());
+
+    //A reader that pins after the retire cannot see a
+    epoch.unpin(slot);
+    epoch.pin(slot);
+    epoch.retire(slot, &b);
+    epoch.reclaim(slot);
+    ASSERT_EQ(freed, std::vector<void*>{&a});
+
+    epoch.unpin(slot);
+    epoch.reclaim(slot);
+    ASSERT_EQ(freed, (std::vector<void*>{&a, &b}));
+    ASSERT_EQ(epoch.numRetired(slot), 0u);
+    epoch.unregisterReader(slot);
+}
+
+GTEST_TEST(EpochTest, unregistered_slot_leaves_retired_behind) {
+    std::vector<void*> freed;
+    EpochManager epoch([&freed](void* p) { freed.push_back(p); });
+    int a{0};
+
+    unsigned writer = epoch.registerReader();
+    unsigned reader = epoch.registerReader();
+    epoch.pin(reader);
+    epoch.retire(writer, &a);
+    epoch.unregisterReader(writer);
+
+    //Whoever reclaims next frees a, but only once the reader is done
+    epoch.reclaim(reader);
+    ASSERT_TRUE(freed.empty());
+    epoch.unpin(reader);
+    epoch.reclaim(reader);
+    ASSERT_EQ(freed, std::vector<void*>{&a});
+    epoch.unregisterReader(reader);
+}
+
+GTEST_TEST(ConcurrentKsetTest, single_thread) {
+    ConcurrentKset set;
+    ConcurrentKset::Reader reader(set);
+    std::set<int64_t> vals;
+
+    const int size = 50000;
+    for(int i = 0; i < size * 2; i++) {
+        int64_t val = std::rand() % size;
+        if(std::rand() % 3) {
+            ASSERT_EQ(set.insert(val), vals.insert(val).second);
+        } else {
+            ASSERT_EQ(set.erase(val), vals.erase(val) == 1);
+        }
+    }
+
+    for(int i = -1; i <= size; i++) {
+        ASSERT_EQ(reader.find(i), vals.count(i) == 1);
+
+        int64_t next{0};
+        bool found{false};
+        std::tie(next,found) = reader.successor(i);
+        auto expected = vals.upper_bound(i);
+        ASSERT_EQ(found, expected != vals.end());
+        if(found) {
+            ASSERT_EQ(next, *expected);
+        }
+
+        std::tie(next,found) = reader.next_geq(i);
+        expected = vals.lower_bound(i);
+        ASSERT_EQ(found, expected != vals.end());
+        if(found) {
+            ASSERT_EQ(next, *expected);
+        }
+    }
+
+    std::vector<int64_t> inRange;
+    reader.for_each_in_range(100, 1000, [&inRange](int64_t val) { inRange.push_back(val); });
+    ASSERT_EQ(inRange, std::vector<int64_t>(vals.lower_bound(100), vals.lower_bound(1000)));
+}
+
+GTEST_TEST(ConcurrentKsetTest, readers_and_writer) {
+    ConcurrentKset set;
+
+    //The writer inserts the even values in random order and then erases a prefix of them. Readers
+    //check that whatever the writer is known to have finished is visible and that odd values never are
+    const int size = 200000;
+    std::vector<int64_t> vals;
+    for(int i = 0; i < size; i++) {
+        vals.push_back(i * 2);
+    }
+    std::shuffle(vals.begin(), vals.end(), std::mt19937{42});
+    const int numErased = size / 4;
+
+    std::atomic<int> inserted{0};
+    std::atomic<int> erased{0};
+    std::atomic<bool> failed{false};
+
+    std::vector<std::thread> readers;
+    for(int t = 0; t < 4; t++) {
+        readers.emplace_back([&, t]() {
+            ConcurrentKset::Reader reader(set);
+            std::mt19937 gen(t);
+            while(erased.load() < numErased && !failed.load()) {
+                int doneInserting = inserted.load();
+                int doneErasing = erased.load();
+                if(doneInserting > doneErasing) {
+                    int j = doneErasing + gen() % (doneInserting - doneErasing);
+                    //The writer may have erased it in the meantime, and erases vals[erased] before it counts it
+                    if(!reader.find(vals[j]) && j > erased.load()) {
+                        failed = true;
+                    }
+                }
+                if(doneErasing > 0 && reader.find(vals[gen() % doneErasing])) {
+                    failed = true;
+                }
+                int64_t odd = (gen() % size) * 2 + 1;
+                int64_t next{0};
+                bool found{false};
+                std::tie(next,found) = reader.successor(odd - 1);
+                if(reader.find(odd) || (found && next % 2)) {
+                    failed = true;
+                }
+            }
+        });
+    }
+
+    for(int i = 0; i < size; i++) {
+        set.insert(vals[i]);
+        inserted.store(i + 1);
+    }
+    for(int i = 0; i < numErased; i++) {
+        set.erase(vals[i]);
+        erased.store(i + 1);
+    }
+    for(auto& reader : readers) {
+        reader.join();
+    }
+    ASSERT_FALSE(failed.load());
+
+    ConcurrentKset::Reader reader(set);
+    for(int i = 0; i < size; i++) {
+        ASSERT_EQ(reader.find(vals[i]), i >= numErased);
+    }
+}
+
+GTEST_TEST(ConcurrentKsetTest, writer_between_reader_steps) {
+    //Inserting in decreasing order makes a chain down the leftmost children, far deeper than
+    //Iterator::max_depth, so a walk has to climb back up through every node to get to its values.
+    //Between every two steps of the reader, from within its fn, the writer inserts an odd value just
+    //ahead of it, into an empty sibling of the node the reader is in, which copies that node's block
+    ConcurrentKset set;
+    const int64_t size = 20000;
+    for(int64_t v = size - 2; v >= 0; v -= 2) {
+        set.insert(v);
+    }
+    ConcurrentKset::Reader reader(set);
+    ConcurrentKset::Writer writer(set);
+
+    std::vector<int64_t> even;
+    int64_t prev{-1};
+    bool ordered{true};
+    reader.for_each_in_range(0, size, [&](int64_t v) {
+        ordered = ordered && v > prev;
+        prev = v;
+        if(v % 2 == 0) {
+            even.push_back(v);
+            writer.insert(v + 13);
+        }
+    });
+    ASSERT_TRUE(ordered);
+    ASSERT_EQ(even.size(), size_t(size / 2));
+    for(size_t i = 0; i < even.size(); i++) {
+        ASSERT_EQ(even[i], 2 * int64_t(i));
+    }
+
+    //successor() of a value whose block was just copied
+    for(int64_t v = 1; v < size; v += 4) {
+        int64_t next{0};
+        bool found{false};
+        ASSERT_TRUE(std::get<1>(reader.next_geq(v + 1)));
+        writer.insert(v + 2);
+        std::tie(next,found) = reader.successor(v + 1);
+        ASSERT_TRUE(found);
+        ASSERT_EQ(next, v + 2);
+    }
+    ASSERT_FALSE(std::get<1>(reader.successor(std::numeric_limits<int64_t>::max())));
+}
+
+GTEST_TEST(ConcurrentKsetTest, writers_and_readers) {
+    ConcurrentKset set;
+
+    //Each writer inserts its own residue class mod numWriters (in random order), then erases
+    //the first quarter of what it inserted. Readers run alongside and check that odd values never
+    //show up. The final contents must be exactly what is left
+    const int numWriters = 4;
+    const int perWriter = 50000;
+    std::atomic<int> writersDone{0};
+    std::atomic<bool> failed{false};
+
+    std::vector<std::thread> threads;
+    for(int t = 0; t < numWriters; t++) {
+        threads.emplace_back([&, t]() {
+            ConcurrentKset::Writer writer(set);
+            std::vector<int64_t> vals;
+            for(int i = 0; i < perWriter; i++) {
+                vals.push_back(int64_t(i * numWriters + t) * 2);
+            }
+            std::shuffle(vals.begin(), vals.end(), std::mt19937{static_cast<unsigned>(t)});
+            for(int64_t val : vals) {
+                if(!writer.insert(val) || writer.insert(val)) {
+                    failed = true;
+                }
+            }
+            for(int i = 0; i < perWriter / 4; i++) {
+                if(!writer.erase(vals[i]) || writer.erase(vals[i])) {
+                    failed = true;
+                }
+            }
+            //Revive some of them
+            for(int i = 0; i < perWriter / 8; i++) {
+                if(!writer.insert(vals[i])) {
+                    failed = true;
+                }
+            }
+            writersDone++;
+        });
+    }
+    for(int t = 0; t < 2; t++) {
+        threads.emplace_back([&, t]() {
+            ConcurrentKset::Reader reader(set);
+            std::mt19937 gen(t);
+            while(writersDone.load() < numWriters && !failed.load()) {
+                int64_t odd = (gen() % (perWriter * numWriters)) * 2 + 1;
+                int64_t next{0};
+                bool found{false};
+                std::tie(next,found) = reader.next_geq(odd);
+                if(reader.find(odd) || (found && next % 2)) {
+                    failed = true;
+                }
+            }
+        });
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+    ASSERT_FALSE(failed.load());
+
+    std::vector<int64_t> expected;
+    for(int t = 0; t < numWriters; t++) {
+        std::vector<int64_t> vals;
+        for(int i = 0; i < perWriter; i++) {
+            vals.push_back(int64_t(i * numWriters + t) * 2);
+        }
+        std::shuffle(vals.begin(), vals.end(), std::mt19937{static_cast<unsigned>(t)});
+        expected.insert(expected.end(), vals.begin(), vals.begin() + perWriter / 8);
+        expected.insert(expected.end(), vals.begin() + perWriter / 4, vals.end());
+    }
+    std::sort(expected.begin(), expected.end());
+
+    ConcurrentKset::Reader reader(set);
+    std::vector<int64_t> contents;
+    reader.for_each_in_range(std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max(),
+                             [&contents](int64_t val) { contents.push_back(val); });
+    ASSERT_EQ(contents, expected);
+}
+
+}
@@ -0,0 +1,124 @@
+#include "gtest/gtest.h"
+#include <kset/kset.h>
+#include <kset/frozen_kset.h>
+#include <boost/scope_exit.hpp>
+#include <memory>
+#include <set>
+#include <vector>
+#include <limits>
+
+namespace Kset {
+
+/////////////////////////////////////////////////////////////////////////////////////
+/// \brief Tests for freeze()/FrozenKset
+/////////////////////////////////////////////////////////////////////////////////////
+
+static void check_frozen(const FrozenKset& frozen, const std::set<int64_t>& vals, int64_t maxProbe) {
+    ASSERT_EQ(frozen.size(), vals.size());
+    ASSERT_EQ(std::vector<int64_t>(frozen.values(), frozen.values() + frozen.size()),
+              std::vector<int64_t>(vals.begin(), vals.end()));
+
+    for(int64_t i = -1; i <= maxProbe + 1; i++) {
+        ASSERT_EQ(frozen.find(i), vals.count(i) == 1);
+
+        int64_t next{0};
+        bool found{false};
+        std::tie(next,found) = frozen.next_geq(i);
+        auto expected = vals.lower_bound(i);
+        ASSERT_EQ(found, expected != vals.end());
+        if(found) {
+            ASSERT_EQ(next, *expected);
+        }
+
+        std::tie(next,found) = frozen.successor(i);
+        expected = vals.upper_bound(i);
+        ASSERT_EQ(found, expected != vals.end());
+        if(found) {
+            ASSERT_EQ(next, *expected);
+        }
+    }
+}
+
+GTEST_TEST(FrozenTest, sizes) {
+    //Around the boundaries of full nodes and of full layers
+    for(int size : {0, 1, 7, 8, 9, 71, 72, 73, 80, 81, 647, 648, 649, 5832, 5833, 60000}) {
+        std::unique_ptr<Node> root(make_tree());
+        std::set<int64_t> vals;
+        for(int i = 0; i < size; i++) {
+            insert_balanced(root.get(), i * 3);
+            vals.insert(i * 3);
+        }
+        FrozenKset frozen = freeze(root.get());
+        check_frozen(frozen, vals, size * 3);
+    }
+}
+
+GTEST_TEST(FrozenTest, random_with_erase) {
+    const int64_t size = 50000;
+    std::unique_ptr<Node> root(make_tree());
+    std::set<int64_t> vals;
+    for(int i = 0; i < size; i++) {
+        int64_t val = std::rand() % size;
+        insert(root.get(), val);
+        vals.insert(val);
+    }
+    for(int i = 0; i < size / 3; i++) {
+        int64_t val = std::rand() % size;
+        erase(root.get(), val);
+        vals.erase(val);
+    }
+
+    FrozenKset frozen = freeze(root.get());
+    check_frozen(frozen, vals, size);
+    ASSERT_LT(frozen.bytes(), vals.size() * sizeof(int64_t) * 10 / 8 + 128);
+}
+
+GTEST_TEST(FrozenTest, extremes) {
+    std::unique_ptr<Node> root(make_tree());
+    const int64_t lo = std::numeric_limits<int64_t>::min();
+    const int64_t hi = std::numeric_limits<int64_t>::max();
+    std::set<int64_t> vals{lo, hi};
+    for(int i = 0; i < 100; i++) {
+        vals.insert(i * 7);
+    }
+    for(int64_t val : vals) {
+        insert_balanced(root.get(), val);
+    }
+
+    FrozenKset frozen = freeze(root.get());
+    ASSERT_TRUE(frozen.find(lo));
+    ASSERT_TRUE(frozen.find(hi));
+    ASSERT_FALSE(frozen.find(hi - 1));
+    bool found{false};
+    int64_t next{0};
+    std::tie(next,found) = frozen.successor(hi - 1);
+    ASSERT_TRUE(found);
+    ASSERT_EQ(next, hi);
+    std::tie(std::ignore,found) = frozen.successor(hi);
+    ASSERT_FALSE(found);
+    check_frozen(frozen, vals, 700);
+}
+
+GTEST_TEST(FrozenTest, kernels) {
+    const Node::FindKernel original = Node::findKernel();
+    BOOST_SCOPE_EXIT_ALL(original) {
+        Node::setFindKernel(original);
+    };
+
+    std::unique_ptr<Node> root(make_tree());
+    std::set<int64_t> vals;
+    for(int i = 0; i < 3000; i++) {
+        int64_t val = std::rand() % 10000;
+        insert(root.get(), val);
+        vals.insert(val);
+    }
+    FrozenKset frozen = freeze(root.get());
+    for(Node::FindKernel kernel : {Node::FindKernel::scalar, Node::FindKernel::avx2, Node::FindKernel::avx512}) {
+        if(Node::supports(kernel)) {
+            Node::setFindKernel(kernel);
+            check_frozen(frozen, vals, 10000);
+        }
+    }
+}
+
+}
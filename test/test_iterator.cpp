@@ -0,0 +1,139 @@
+#include "gtest/gtest.h"
+#include <kset/kset.h>
+#include <memory>
+#include <set>
+#include <vector>
+#include <algorithm>
+
+namespace Kset {
+
+/////////////////////////////////////////////////////////////////////////////////////
+/// \brief Tests for Iterator/lower_bound/upper_bound/for_each_in_range
+/////////////////////////////////////////////////////////////////////////////////////
+
+static void check_iteration(Node* n, const std::set<int64_t>& vals, int64_t maxProbe) {
+    std::vector<int64_t> walked(begin(n), end(n));
+    ASSERT_EQ(walked, std::vector<int64_t>(vals.begin(), vals.end()));
+
+    for(int i = 0; i < 2000; i++) {
+        int64_t probe = std::rand() % (maxProbe + 2) - 1;
+
+        Iterator itr = lower_bound(n, probe);
+        auto expected = vals.lower_bound(probe);
+        if(expected == vals.end()) {
+            ASSERT_EQ(itr, end(n));
+        } else {
+            ASSERT_NE(itr, end(n));
+            ASSERT_EQ(*itr, *expected);
+            Node* node{nullptr};
+            bool found{false};
+            std::tie(node,std::ignore,found) = find(n, *expected);
+            ASSERT_TRUE(found);
+            ASSERT_EQ(itr.node(), node);
+        }
+
+        itr = upper_bound(n, probe);
+        expected = vals.upper_bound(probe);
+        ASSERT_EQ(itr == end(n), expected == vals.end());
+        if(expected != vals.end()) {
+            ASSERT_EQ(*itr, *expected);
+        }
+
+        //Seek forward by random distances, small and large
+        itr = lower_bound(n, probe);
+        int64_t target = probe;
+        for(int step = 0; step < 5 && itr != end(n); step++) {
+            target += std::rand() % (step % 2 ? maxProbe / 4 + 1 : 20);
+            itr.seek(target);
+            expected = vals.lower_bound(std::max(target, probe));
+            ASSERT_EQ(itr == end(n), expected == vals.end());
+            if(expected != vals.end()) {
+                ASSERT_EQ(*itr, *expected);
+            }
+        }
+
+        int64_t hi = probe + std::rand() % 100;
+        std::vector<int64_t> inRange;
+        for_each_in_range(n, probe, hi, [&inRange](int64_t val) { inRange.push_back(val); });
+        ASSERT_EQ(inRange, std::vector<int64_t>(vals.lower_bound(probe), vals.lower_bound(hi)));
+    }
+}
+
+GTEST_TEST(IteratorTest, empty) {
+    auto un = std::make_unique<Kset::Node>();
+    Kset::Node* n = un.get();
+    ASSERT_EQ(begin(n), end(n));
+    ASSERT_EQ(lower_bound(n, 0), end(n));
+
+    insert(n, 5);
+    erase(n, 5);
+    ASSERT_EQ(begin(n), end(n));
+}
+
+GTEST_TEST(IteratorTest, random_with_erase) {
+    auto un = std::make_unique<Kset::Node>();
+    Kset::Node* n = un.get();
+    std::set<int64_t> vals;
+
+    const int size = 20000;
+    for(int i = 0; i < size; i++) {
+        int64_t val = std::rand() % size;
+        insert(n, val);
+        vals.insert(val);
+    }
+    for(int i = 0; i < size / 2; i++) {
+        int64_t val = std::rand() % size;
+        erase(n, val);
+        vals.erase(val);
+    }
+    check_iteration(n, vals, size);
+}
+
+GTEST_TEST(IteratorTest, balanced) {
+    auto un = std::make_unique<Kset::Node>();
+    Kset::Node* n = un.get();
+    std::set<int64_t> vals;
+
+    const int size = 20000;
+    for(int i = 0; i < size; i++) {
+        int64_t val = std::rand() % size;
+        insert_balanced(n, val);
+        vals.insert(val);
+    }
+    check_iteration(n, vals, size);
+}
+
+GTEST_TEST(IteratorTest, deeper_than_stack) {
+    //Sorted inserts with plain insert() build a chain that is far deeper than Iterator::max_depth
+    auto un = std::make_unique<Kset::Node>();
+    Kset::Node* n = un.get();
+    std::set<int64_t> vals;
+
+    const int size = 3000;
+    for(int i = 0; i < size; i++) {
+        insert(n, i);
+        insert(n, -i);
+        vals.insert(i);
+        vals.insert(-i);
+    }
+    for(int i = 0; i < size; i += 3) {
+        erase(n, i);
+        vals.erase(i);
+    }
+    std::vector<int64_t> walked(begin(n), end(n));
+    ASSERT_EQ(walked, std::vector<int64_t>(vals.begin(), vals.end()));
+
+    Iterator itr = lower_bound(n, size / 2);
+    for(auto expected = vals.lower_bound(size / 2); expected != vals.end(); ++expected, ++itr) {
+        ASSERT_EQ(*itr, *expected);
+    }
+    ASSERT_EQ(itr, end(n));
+
+    itr = begin(n);
+    for(int64_t target = -size; target <= size; target += 97) {
+        itr.seek(target);
+        ASSERT_EQ(*itr, *vals.lower_bound(target));
+    }
+}
+
+}
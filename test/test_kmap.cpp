@@ -0,0 +1,111 @@
+#include "gtest/gtest.h"
+#include <kset/kset.h>
+#include <kset/kset_stats.h>
+#include <kset/kmap.h>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace Kset {
+
+/////////////////////////////////////////////////////////////////////////////////////
+/// \brief Tests for KMap
+/////////////////////////////////////////////////////////////////////////////////////
+
+static void check_map(const KMap& kmap, const std::map<int64_t, int64_t>& expected) {
+    ASSERT_EQ(kmap.size(), expected.size());
+    auto e = expected.begin();
+    for(KMap::Iterator itr = kmap.begin(); itr != kmap.end(); ++itr, ++e) {
+        ASSERT_TRUE(e != expected.end());
+        ASSERT_EQ(itr.key(), e->first);
+        ASSERT_EQ(itr.payload(), e->second);
+    }
+    ASSERT_TRUE(e == expected.end());
+}
+
+GTEST_TEST(KMapTest, insert_or_assign) {
+    KMap kmap;
+    std::map<int64_t, int64_t> expected;
+    ASSERT_EQ(kmap.find(1), std::make_tuple(int64_t{-1}, false));
+
+    std::mt19937_64 gen(7);
+    std::uniform_int_distribution<int64_t> dis(0, 20000);
+    for(int i = 0; i < 20000; i++) {
+        int64_t key = dis(gen);
+        //Every node shifts its keys around on insert, and the payloads must follow
+        ASSERT_EQ(kmap.insert_or_assign(key, i), expected.count(key) == 0);
+        expected[key] = i;
+    }
+    check_map(kmap, expected);
+
+    for(int64_t key = -1; key <= 20001; key++) {
+        auto e = expected.find(key);
+        if(e == expected.end()) {
+            ASSERT_EQ(kmap.find(key), std::make_tuple(int64_t{-1}, false));
+        } else {
+            ASSERT_EQ(kmap.find(key), std::make_tuple(e->second, true));
+        }
+    }
+
+    //The keys form a tree like any other
+    ASSERT_EQ(stats(kmap.root()).numValues, expected.size());
+}
+
+GTEST_TEST(KMapTest, erase) {
+    KMap kmap;
+    std::map<int64_t, int64_t> expected;
+    for(int64_t key = 0; key < 5000; key++) {
+        int64_t scattered = (key * 7919) % 5000;
+        kmap.insert_or_assign(scattered, -scattered);
+        expected[scattered] = -scattered;
+    }
+
+    for(int64_t key = 0; key < 5000; key += 3) {
+        ASSERT_TRUE(kmap.erase(key));
+        ASSERT_FALSE(kmap.erase(key));
+        expected.erase(key);
+    }
+    check_map(kmap, expected);
+
+    //Bring back some of the erased keys in their old slots, and fill up leaves with tombstones in them
+    //with new keys, which reuses the tombstone slots
+    for(int64_t key = 0; key < 5000; key += 6) {
+        ASSERT_TRUE(kmap.insert_or_assign(key, key * 2));
+        expected[key] = key * 2;
+    }
+    for(int64_t key = 5000; key < 20000; key += 5) {
+        int64_t scattered = (key * 7919) % 20000;
+        ASSERT_EQ(kmap.insert_or_assign(scattered, scattered + 1), expected.count(scattered) == 0);
+        expected[scattered] = scattered + 1;
+    }
+    check_map(kmap, expected);
+}
+
+GTEST_TEST(KMapTest, range) {
+    KMap kmap;
+    for(int64_t key = 0; key < 1000; key++) {
+        kmap.insert_or_assign((key * 389) % 1000 * 10, key);
+    }
+
+    KMap::Iterator itr = kmap.lower_bound(4995);
+    ASSERT_EQ(itr.key(), 5000);
+    ASSERT_TRUE(kmap.lower_bound(9991) == kmap.end());
+
+    std::vector<int64_t> keys;
+    int64_t sum{0};
+    kmap.for_each_in_range(100, 200, [&keys, &sum](int64_t key, int64_t payload) {
+        keys.push_back(key);
+        sum += payload;
+    });
+    ASSERT_EQ(keys, std::vector<int64_t>({100, 110, 120, 130, 140, 150, 160, 170, 180, 190}));
+    int64_t expected{0};
+    for(int64_t key = 0; key < 1000; key++) {
+        int64_t k = (key * 389) % 1000 * 10;
+        if(k >= 100 && k < 200) {
+            expected += key;
+        }
+    }
+    ASSERT_EQ(sum, expected);
+}
+
+}
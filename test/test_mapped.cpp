@@ -0,0 +1,107 @@
+#include "gtest/gtest.h"
+#include <kset/kset.h>
+#include <kset/mapped_kset.h>
+#include <memory>
+#include <set>
+#include <string>
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+
+namespace Kset {
+
+/////////////////////////////////////////////////////////////////////////////////////
+/// \brief Tests for save()/MappedKset
+/////////////////////////////////////////////////////////////////////////////////////
+
+static std::string temp_path(const char* name) {
+    return "/tmp/kset_test_" + std::to_string(::getpid()) + "_" + name;
+}
+
+static void check_mapped(const MappedKset& mapped, const std::set<int64_t>& vals, int64_t maxProbe) {
+    for(int64_t i = -1; i <= maxProbe + 1; i++) {
+        ASSERT_EQ(mapped.find(i), vals.count(i) == 1);
+
+        int64_t next{0};
+        bool found{false};
+        std::tie(next,found) = mapped.next_geq(i);
+        auto expected = vals.lower_bound(i);
+        ASSERT_EQ(found, expected != vals.end());
+        if(found) {
+            ASSERT_EQ(next, *expected);
+        }
+
+        std::tie(next,found) = mapped.successor(i);
+        expected = vals.upper_bound(i);
+        ASSERT_EQ(found, expected != vals.end());
+        if(found) {
+            ASSERT_EQ(next, *expected);
+        }
+    }
+}
+
+GTEST_TEST(MappedTest, round_trip) {
+    const std::string path = temp_path("round_trip");
+    const int64_t size = 20000;
+
+    for(bool balanced : {false, true}) {
+        std::unique_ptr<Node> root(make_tree());
+        std::set<int64_t> vals;
+        for(int i = 0; i < size; i++) {
+            int64_t val = std::rand() % size;
+            if(balanced) {
+                insert_balanced(root.get(), val);
+            } else {
+                insert(root.get(), val);
+            }
+            vals.insert(val);
+        }
+        //Leave tombstones, including long runs of them
+        for(int64_t i = 0; i < size; i++) {
+            if(std::rand() % 4 == 0 || (i > size / 2 && i < size / 2 + 500)) {
+                erase(root.get(), i);
+                vals.erase(i);
+            }
+        }
+
+        save(root.get(), path);
+        MappedKset mapped(path);
+        check_mapped(mapped, vals, size);
+    }
+    std::remove(path.c_str());
+}
+
+GTEST_TEST(MappedTest, empty_and_tiny) {
+    const std::string path = temp_path("tiny");
+    std::unique_ptr<Node> root(make_tree());
+    save(root.get(), path);
+    {
+        MappedKset mapped(path);
+        ASSERT_EQ(mapped.numNodes(), 1u);
+        check_mapped(mapped, {}, 10);
+    }
+
+    insert(root.get(), 5);
+    insert(root.get(), std::numeric_limits<int64_t>::max());
+    save(root.get(), path);
+    MappedKset mapped(path);
+    ASSERT_TRUE(mapped.find(std::numeric_limits<int64_t>::max()));
+    bool found{false};
+    std::tie(std::ignore,found) = mapped.successor(std::numeric_limits<int64_t>::max());
+    ASSERT_FALSE(found);
+    check_mapped(mapped, {5, std::numeric_limits<int64_t>::max()}, 10);
+    std::remove(path.c_str());
+}
+
+GTEST_TEST(MappedTest, rejects_other_files) {
+    const std::string path = temp_path("garbage");
+    ASSERT_THROW(MappedKset{path}, std::runtime_error);
+
+    std::ofstream out(path, std::ios::binary);
+    out << std::string(256, 'x');
+    out.close();
+    ASSERT_THROW(MappedKset{path}, std::runtime_error);
+    std::remove(path.c_str());
+}
+
+}
@@ -1,8 +1,14 @@
 #include "gtest/gtest.h"
 #include <kset/kset.h>
 #include <kset/packed_ptr.h>
+#include <kset/node_arena.h>
+#include <kset/kset_stats.h>
 #include <boost/scope_exit.hpp>
 #include <memory>
+#include <algorithm>
+#include <numeric>
+#include <set>
+#include <vector>
 
 namespace Kset {
 
@@ -16,16 +22,14 @@ static const unsigned max_values_in_node = Kset::Node::capacity;
 GTEST_TEST(NodeTest, construction) {
     auto un = std::make_unique<Kset::Node>();
     Kset::Node* n = un.get();
-    ASSERT_EQ(sizeof(Node), 64);
+    ASSERT_EQ(sizeof(Node), 64 * Node::node_lines);
     ASSERT_EQ(n->children(), nullptr);
     ASSERT_EQ(n->numValues(), 0);
     ASSERT_EQ((int64_t)n % 64, 0);
 
-#ifdef USE_AVX2
     for(unsigned i = 0; i < max_values_in_node; i++) {
         ASSERT_EQ(n->at(i) , std::numeric_limits<int64_t>::max());
     }
-#endif
 
 }
 
@@ -63,7 +67,7 @@ GTEST_TEST(NodeTest, local_insertion) {
     int idx{0};
     bool inserted{true};
 
-    std::tie(idx,inserted) = n->insert(1000);
+    std::tie(idx,inserted) = n->insert(max_values_in_node * 100);
 
     ASSERT_EQ(inserted,false);
 
@@ -84,6 +88,48 @@ GTEST_TEST(NodeTest, local_insertion) {
 
 }
 
+GTEST_TEST(NodeTest, find_kernels) {
+    const Node::FindKernel best = Node::bestFindKernel();
+    ASSERT_EQ(Node::findKernel(), best);
+    BOOST_SCOPE_EXIT_ALL(best) {
+        Node::setFindKernel(best);
+    };
+
+    const int64_t maxint64 = std::numeric_limits<int64_t>::max();
+    const int64_t minint64 = std::numeric_limits<int64_t>::min();
+
+    for(Node::FindKernel kernel : {Node::FindKernel::scalar, Node::FindKernel::avx2, Node::FindKernel::avx512}) {
+        if(!Node::supports(kernel)) {
+            continue;
+        }
+        Node::setFindKernel(kernel);
+        ASSERT_EQ(Node::findKernel(), kernel);
+
+        //Compare against a plain linear search for nodes of every size, including the extremes
+        for(unsigned size = 0; size <= max_values_in_node; size++) {
+            for(bool withMax : {false, true}) {
+                auto un = std::make_unique<Kset::Node>();
+                Kset::Node* n = un.get();
+                std::vector<int64_t> vals;
+                for(unsigned i = 0; i < size; i++) {
+                    vals.push_back(withMax && i == size - 1 ? maxint64 : int64_t(i) * 10 - 20);
+                    n->insert(vals.back());
+                }
+                for(int64_t probe : {minint64, int64_t(-25), int64_t(-20), int64_t(-5), int64_t(0), int64_t(15),
+                                     int64_t(30), int64_t(35), int64_t(1000), maxint64 - 1, maxint64}) {
+                    unsigned expectedIdx = std::lower_bound(vals.begin(), vals.end(), probe) - vals.begin();
+                    bool expectedFound = expectedIdx < vals.size() && vals[expectedIdx] == probe;
+                    int idx{-1};
+                    bool found{false};
+                    std::tie(idx,found) = n->find(probe);
+                    ASSERT_EQ(found, expectedFound) << "size " << size << " probe " << probe;
+                    ASSERT_EQ(idx, (int)expectedIdx) << "size " << size << " probe " << probe;
+                }
+            }
+        }
+    }
+}
+
 /////////////////////////////////////////////////////////////////////////////////////
 /// \brief Tests for Kset insertion/find/find_min/successor
 /////////////////////////////////////////////////////////////////////////////////////
@@ -168,6 +214,31 @@ GTEST_TEST(KsetTest, insertion_find) {
     }
 }
 
+GTEST_TEST(KsetTest, find_batch) {
+    auto un = std::make_unique<Kset::Node>();
+    Kset::Node* n = un.get();
+
+    const int size = 100000;
+    for(int i = 0; i < size; i++) {
+        insert(n, std::rand() % size);
+    }
+    for(int i = 0; i < size; i += 7) {
+        erase(n, i);
+    }
+
+    for(size_t batch : {0, 1, 5, 16, 17, 1000}) {
+        std::vector<int64_t> keys;
+        for(size_t i = 0; i < batch; i++) {
+            keys.push_back(std::rand() % (size + 100));
+        }
+        std::vector<FindResult> results(batch);
+        find_batch(n, keys.data(), keys.size(), results.data());
+        for(size_t i = 0; i < batch; i++) {
+            ASSERT_EQ(results[i], find(n, keys[i]));
+        }
+    }
+}
+
 GTEST_TEST(KsetTest, find_min) {
 
     auto un = std::make_unique<Kset::Node>();
@@ -238,13 +309,12 @@ GTEST_TEST(KsetTest, successor) {
     ASSERT_EQ(loc,3);
 
     //successor is in grandparent node
-    insert(n,260);
-    insert(n,265);
-    insert(n,270);
-    insert(n,275);
+    for(int64_t v = 260; !dest->isFull(); v++) {
+        insert(n,v);
+    }
 
     //next insert will cause 3rd node to be added
-    std::tie(dest,std::ignore, std::ignore) = insert(n,280);
+    std::tie(dest,std::ignore, std::ignore) = insert(n,299);
 
     std::tie(d,loc,val) = successor(dest,0);
     ASSERT_EQ(val,300);
@@ -252,6 +322,583 @@ GTEST_TEST(KsetTest, successor) {
     ASSERT_EQ(loc,3);
 }
 
+GTEST_TEST(KsetTest, erase) {
+    auto un = std::make_unique<Kset::Node>();
+    Kset::Node* n = un.get();
+
+    for(unsigned i = 0; i < max_values_in_node; i++) {
+        n->insert(i * 100);
+    }
+    insert(n, 250);
+
+    ASSERT_TRUE(erase(n, 200));
+    ASSERT_FALSE(erase(n, 200));
+    ASSERT_FALSE(erase(n, 201));
+    ASSERT_FALSE(n->isLive(2));
+    ASSERT_EQ(n->at(2), 200);
+
+    bool found{true};
+    std::tie(std::ignore,std::ignore,found) = find(n,200);
+    ASSERT_FALSE(found);
+    std::tie(std::ignore,std::ignore,found) = find(n,250);
+    ASSERT_TRUE(found);
+
+    //successor skips the tombstone
+    Node* dest{nullptr};
+    int loc{-1};
+    int64_t val{-1};
+    std::tie(dest,loc,val) = successor(n,1);
+    ASSERT_EQ(val, 250);
+    std::tie(dest,loc,val) = successor(dest,loc);
+    ASSERT_EQ(val, 300);
+
+    //find_min skips the tombstone
+    ASSERT_TRUE(erase(n, 0));
+    std::tie(dest,loc,val) = find_min(n);
+    ASSERT_EQ(val, 100);
+
+    //reinsertion reuses the same slot
+    bool inserted{false};
+    std::tie(dest,loc,inserted) = insert(n, 200);
+    ASSERT_TRUE(inserted);
+    ASSERT_EQ(dest, n);
+    ASSERT_EQ(loc, 2);
+    ASSERT_TRUE(n->isLive(2));
+}
+
+GTEST_TEST(KsetTest, erase_reuses_leaf_slots) {
+    auto un = std::make_unique<Kset::Node>();
+    Kset::Node* n = un.get();
+
+    for(unsigned i = 0; i < max_values_in_node; i++) {
+        n->insert(i * 100);
+    }
+    erase(n, 100);
+    erase(n, 400);
+
+    //A full leaf with tombstones makes room instead of expanding
+    Node* dest{nullptr};
+    int loc{-1};
+    bool inserted{false};
+    std::tie(dest,loc,inserted) = insert(n, 350);
+    ASSERT_TRUE(inserted);
+    ASSERT_EQ(dest, n);
+    ASSERT_EQ(n->children(), nullptr);
+    ASSERT_FALSE(n->hasTombstones());
+    ASSERT_EQ(n->numValues(), max_values_in_node - 1);
+
+    std::vector<int64_t> expected{0, 200, 300, 350, 500};
+    for(unsigned i = 0; i < expected.size(); i++) {
+        ASSERT_EQ(n->at(i), expected[i]);
+    }
+}
+
+GTEST_TEST(KsetTest, erase_random) {
+    auto un = std::make_unique<Kset::Node>();
+    Kset::Node* n = un.get();
+    std::set<int64_t> vals;
+
+    const int size = 100000;
+    for(int round = 0; round < 4; round++) {
+        for(int i = 0; i < size; i++) {
+            int64_t val = std::rand() % size;
+            if(std::rand() % 2) {
+                insert(n, val);
+                vals.insert(val);
+            } else {
+                ASSERT_EQ(erase(n, val), vals.erase(val) == 1);
+            }
+        }
+
+        bool found{false};
+        for(int i = 0; i < size; i++) {
+            std::tie(std::ignore,std::ignore,found) = find(n,i);
+            ASSERT_EQ(vals.count(i) == 1, found);
+        }
+
+        Node* node{nullptr};
+        NodeIdx_t loc{invalid_idx};
+        int64_t val{0};
+        std::tie(node,loc,val) = find_min(n);
+        for(int64_t expected : vals) {
+            ASSERT_NE(node, nullptr);
+            ASSERT_EQ(val, expected);
+            std::tie(node,loc,val) = successor(node,loc);
+        }
+        ASSERT_EQ(node, nullptr);
+    }
+}
+
+GTEST_TEST(KsetTest, next_geq_prev_leq) {
+    for(bool balanced : {false, true}) {
+        auto un = std::make_unique<Kset::Node>();
+        Kset::Node* n = un.get();
+        std::set<int64_t> vals;
+
+        const int size = 20000;
+        for(int i = 0; i < size; i++) {
+            int64_t val = (std::rand() % size) * 4;
+            balanced ? insert_balanced(n, val) : insert(n, val);
+            vals.insert(val);
+        }
+
+        for(int round = 0; round < 2; round++) {
+            for(int i = -10; i < size * 4 + 10; i++) {
+                Node* node{nullptr};
+                NodeIdx_t loc{invalid_idx};
+                int64_t val{0};
+
+                std::tie(node,loc,val) = next_geq(n, i);
+                auto expected = vals.lower_bound(i);
+                if(expected == vals.end()) {
+                    ASSERT_EQ(node, nullptr);
+                } else {
+                    ASSERT_NE(node, nullptr);
+                    ASSERT_EQ(val, *expected);
+                    ASSERT_EQ(node->at(loc), val);
+                }
+
+                std::tie(node,loc,val) = prev_leq(n, i);
+                expected = vals.upper_bound(i);
+                if(expected == vals.begin()) {
+                    ASSERT_EQ(node, nullptr);
+                } else {
+                    ASSERT_NE(node, nullptr);
+                    ASSERT_EQ(val, *std::prev(expected));
+                    ASSERT_EQ(node->at(loc), val);
+                }
+            }
+
+            //Now again with tombstones in the way
+            for(int i = 0; i < size; i++) {
+                int64_t val = (std::rand() % size) * 4;
+                erase(n, val);
+                vals.erase(val);
+            }
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+/// \brief Tests for balanced insertion
+/////////////////////////////////////////////////////////////////////////////////////
+
+///Checks that all leaves are at the same depth and returns that depth
+static int leaf_depth(Node* node) {
+    if(!node->children()) {
+        return 1;
+    }
+    int depth = leaf_depth(node->children());
+    for(unsigned i = 1; i <= node->numValues(); i++) {
+        EXPECT_EQ(leaf_depth(node->children() + i), depth);
+    }
+    return depth + 1;
+}
+
+static void check_contents(Node* n, const std::set<int64_t>& vals) {
+    Node* node{nullptr};
+    NodeIdx_t loc{invalid_idx};
+    int64_t val{0};
+    std::tie(node,loc,val) = find_min(n);
+    for(int64_t expected : vals) {
+        ASSERT_NE(node, nullptr);
+        ASSERT_EQ(val, expected);
+        bool found{false};
+        std::tie(std::ignore,std::ignore,found) = find(n,expected);
+        ASSERT_TRUE(found);
+        std::tie(node,loc,val) = successor(node,loc);
+    }
+    ASSERT_EQ(node, nullptr);
+}
+
+GTEST_TEST(BalancedTest, split_root) {
+    auto un = std::make_unique<Kset::Node>();
+    Kset::Node* n = un.get();
+
+    for(unsigned i = 0; i < max_values_in_node; i++) {
+        insert_balanced(n, i * 100);
+    }
+    ASSERT_EQ(n->children(), nullptr);
+
+    Node* dest{nullptr};
+    int idx{-1};
+    bool inserted{false};
+    std::tie(dest,idx,inserted) = insert_balanced(n, 250);
+    //The full root splits around its middle value, and 250 goes to the left half
+    const unsigned mid = max_values_in_node / 2;
+    ASSERT_TRUE(inserted);
+    ASSERT_EQ(n->numValues(), 1);
+    ASSERT_EQ(n->at(0), mid * 100);
+    ASSERT_EQ(n->children()->numValues(), mid + 1);
+    ASSERT_EQ(n->children()->parent(), n);
+    ASSERT_EQ(dest, n->children());
+    ASSERT_EQ((n->children()+1)->numValues(), max_values_in_node - mid - 1);
+    ASSERT_EQ((n->children()+1)->parent(), n);
+
+    std::tie(dest,idx,inserted) = insert_balanced(n, 250);
+    ASSERT_FALSE(inserted);
+}
+
+GTEST_TEST(BalancedTest, sequential) {
+    for(bool useArena : {false, true}) {
+        std::unique_ptr<Node> un{useArena ? make_tree() : new Node{}};
+        Node* n = un.get();
+        std::set<int64_t> vals;
+
+        const int size = 100000;
+        for(int i = 0; i < size; i++) {
+            insert_balanced(n, i);
+            vals.insert(i);
+        }
+        //Sorted inserts fill the nodes up almost completely, so 7 levels hold well over 100k values
+        ASSERT_LE(leaf_depth(n), 7);
+        check_contents(n, vals);
+
+        for(int i = 0; i < size; i++) {
+            insert_balanced(n, -i);
+            vals.insert(-i);
+        }
+        ASSERT_LE(leaf_depth(n), 8);
+        check_contents(n, vals);
+    }
+}
+
+GTEST_TEST(BalancedTest, random_with_erase) {
+    auto un = std::make_unique<Kset::Node>();
+    Kset::Node* n = un.get();
+    std::set<int64_t> vals;
+
+    const int size = 100000;
+    for(int i = 0; i < size * 2; i++) {
+        int64_t val = std::rand() % size;
+        if(std::rand() % 4) {
+            insert_balanced(n, val);
+            vals.insert(val);
+        } else {
+            ASSERT_EQ(erase(n, val), vals.erase(val) == 1);
+        }
+    }
+    ASSERT_LE(leaf_depth(n), 10);
+    check_contents(n, vals);
+
+    bool found{false};
+    for(int i = 0; i < size; i++) {
+        std::tie(std::ignore,std::ignore,found) = find(n,i);
+        ASSERT_EQ(vals.count(i) == 1, found);
+    }
+}
+
+GTEST_TEST(BalancedTest, bulk_load) {
+    for(int size : {0, 1, 6, 7, 48, 49, 342, 343, 1000, 100000}) {
+        std::vector<int64_t> input;
+        for(int i = 0; i < size; i++) {
+            input.push_back(i * 3);
+        }
+        std::unique_ptr<Node> un{bulk_load(input.data(), input.data() + input.size())};
+        Node* n = un.get();
+        ASSERT_TRUE(n->ownsArena());
+
+        std::set<int64_t> vals(input.begin(), input.end());
+        if(size) {
+            check_contents(n, vals);
+        }
+        bool found{false};
+        for(int i = 0; i < size * 3; i++) {
+            std::tie(std::ignore,std::ignore,found) = find(n,i);
+            ASSERT_EQ(vals.count(i) == 1, found);
+        }
+    }
+
+    //7^3 - 1 values fill a tree of height 3 completely
+    const unsigned fanout = Node::capacity + 1;
+    std::vector<int64_t> input(fanout * fanout * fanout - 1);
+    std::iota(input.begin(), input.end(), 0);
+    std::unique_ptr<Node> un{bulk_load(input.data(), input.data() + input.size())};
+    ASSERT_EQ(leaf_depth(un.get()), 3);
+    ASSERT_TRUE(un->children()[Node::capacity].children()[Node::capacity].isFull());
+
+    //A loaded tree can keep growing
+    std::set<int64_t> vals(input.begin(), input.end());
+    for(int i = 0; i < 1000; i++) {
+        int64_t val = std::rand() % 2000;
+        if(i % 2) {
+            insert_balanced(un.get(), val);
+            vals.insert(val);
+        } else {
+            erase(un.get(), val);
+            vals.erase(val);
+        }
+    }
+    check_contents(un.get(), vals);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+/// \brief Tests for insert_batch
+/////////////////////////////////////////////////////////////////////////////////////
+
+GTEST_TEST(BatchTest, random_batches) {
+    std::unique_ptr<Node> un{make_tree()};
+    Node* n = un.get();
+    std::set<int64_t> vals;
+
+    ASSERT_EQ(insert_batch(n, nullptr, 0), 0);
+
+    //Batches of all sizes, with duplicates within a batch, values already in the tree and negative values
+    for(size_t batch : {1, 5, 100, 255, 256, 1000, 20000}) {
+        std::vector<int64_t> keys;
+        size_t added = 0;
+        for(size_t i = 0; i < batch; i++) {
+            keys.push_back(std::rand() % 100000 - 50000);
+        }
+        for(int64_t key : std::set<int64_t>(keys.begin(), keys.end())) {
+            added += vals.count(key) == 0;
+        }
+        ASSERT_EQ(insert_batch(n, keys.data(), keys.size()), added);
+        vals.insert(keys.begin(), keys.end());
+        check_contents(n, vals);
+    }
+
+    //Erased values come back, and leaves that are full of tombstones make room
+    for(int i = 0; i < 20000; i++) {
+        int64_t val = std::rand() % 100000 - 50000;
+        erase(n, val);
+        vals.erase(val);
+    }
+    std::vector<int64_t> keys;
+    for(int i = 0; i < 20000; i++) {
+        keys.push_back(std::rand() % 100000 - 50000);
+    }
+    insert_batch(n, keys.data(), keys.size());
+    vals.insert(keys.begin(), keys.end());
+    check_contents(n, vals);
+}
+
+GTEST_TEST(BatchTest, sorted_runs_stay_shallow) {
+    //One value at a time, a sorted run builds a chain. As a batch it becomes a packed subtree
+    std::unique_ptr<Node> un{make_tree()};
+    std::vector<int64_t> keys(100000);
+    std::iota(keys.begin(), keys.end(), 0);
+    std::reverse(keys.begin(), keys.end());
+    ASSERT_EQ(insert_batch(un.get(), keys.data(), keys.size()), keys.size());
+    std::set<int64_t> vals(keys.begin(), keys.end());
+    check_contents(un.get(), vals);
+    ASSERT_LE(stats(un.get()).depth(), 9);
+
+    //A second run that falls in between the values of the first
+    for(int64_t& key : keys) {
+        key = key * 2 + 1;
+    }
+    keys.resize(20000);
+    insert_batch(un.get(), keys.data(), keys.size());
+    vals.insert(keys.begin(), keys.end());
+    check_contents(un.get(), vals);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+/// \brief Tests for NodeArena backed trees
+/////////////////////////////////////////////////////////////////////////////////////
+
+GTEST_TEST(ArenaTest, blocks_are_aligned_and_contiguous) {
+    NodeArena arena;
+    const size_t blockSize = sizeof(Node) * Node::block_nodes;
+
+    char* prev = static_cast<char*>(arena.allocBlock());
+    ASSERT_EQ((int64_t)prev % 64, 0);
+    for(int i = 0; i < 100; i++) {
+        char* block = static_cast<char*>(arena.allocBlock());
+        ASSERT_EQ((int64_t)block % 64, 0);
+        ASSERT_EQ(block, prev + blockSize);
+        prev = block;
+    }
+    ASSERT_EQ(arena.bytesReserved(), NodeArena::huge_page_size);
+}
+
+GTEST_TEST(ArenaTest, make_tree) {
+    std::unique_ptr<Node> un{make_tree()};
+    Node* n = un.get();
+    ASSERT_TRUE(n->ownsArena());
+    ASSERT_NE(n->arena(), nullptr);
+    ASSERT_EQ(n->parent(), nullptr);
+    ASSERT_EQ(n->numValues(), 0);
+
+    for(unsigned i = 0; i <= max_values_in_node; i++) {
+        insert(n, i * 100);
+    }
+    ASSERT_EQ(n->numValues(), max_values_in_node);
+    ASSERT_NE(n->children(), nullptr);
+    ASSERT_EQ(n->children()->parent(), n);
+    ASSERT_EQ((int64_t)n->children() % 64, 0);
+}
+
+GTEST_TEST(ArenaTest, insertion_find_successor) {
+    for(bool hugePages : {false, true}) {
+        std::unique_ptr<Node> un{make_tree(hugePages)};
+        Node* n = un.get();
+        ASSERT_EQ(n->arena()->usesHugePages(), hugePages);
+        std::set<int64_t> insertedVals;
+
+        const int size = 200000;
+        for(int i = 0; i < size; i++) {
+            int64_t val = std::rand() % (size * 4);
+            insert(n, val);
+            insertedVals.insert(val);
+        }
+        ASSERT_GT(n->arena()->bytesReserved(), NodeArena::huge_page_size);
+
+        bool found{false};
+        for(int i = 0; i < size * 4; i++) {
+            std::tie(std::ignore,std::ignore,found) = find(n,i);
+            ASSERT_EQ(insertedVals.count(i) == 1, found);
+        }
+
+        Node* node{nullptr};
+        NodeIdx_t loc{invalid_idx};
+        int64_t val{0};
+        std::tie(node,loc,val) = find_min(n);
+        for(int64_t expected : insertedVals) {
+            ASSERT_NE(node, nullptr);
+            ASSERT_EQ(val, expected);
+            std::tie(node,loc,val) = successor(node,loc);
+        }
+        ASSERT_EQ(node, nullptr);
+    }
+}
+
+#ifdef USE_ORDER_STATS
+
+/////////////////////////////////////////////////////////////////////////////////////
+/// \brief Tests for rank/select/count_range
+/////////////////////////////////////////////////////////////////////////////////////
+
+///Recount every subtree and compare with the counts that the tree keeps. Returns the count of node
+static uint64_t check_counts(const Node* node) {
+    uint64_t count = node->numLive();
+    if(node->children()) {
+        for(NodeIdx_t i = 0; i <= Node::capacity; i++) {
+            uint64_t childCount = check_counts(node->children() + i);
+            EXPECT_EQ(node->childCounts()[i], childCount);
+            count += childCount;
+        }
+    }
+    return count;
+}
+
+static void check_order_stats(Node* n, const std::set<int64_t>& vals, int64_t maxProbe) {
+    ASSERT_EQ(check_counts(n), vals.size());
+    ASSERT_EQ(size(n), vals.size());
+
+    std::vector<int64_t> sorted(vals.begin(), vals.end());
+    for(uint64_t k = 0; k <= sorted.size(); k++) {
+        Node* node{nullptr};
+        int64_t val{0};
+        std::tie(node,std::ignore,val) = select(n, k);
+        if(k == sorted.size()) {
+            ASSERT_EQ(node, nullptr);
+        } else {
+            ASSERT_NE(node, nullptr);
+            ASSERT_EQ(val, sorted[k]);
+        }
+    }
+
+    for(int i = 0; i < 2000; i++) {
+        int64_t lo = std::rand() % (maxProbe + 2) - 1;
+        int64_t hi = lo + std::rand() % 200;
+        uint64_t expectedRank = std::lower_bound(sorted.begin(), sorted.end(), lo) - sorted.begin();
+        ASSERT_EQ(rank(n, lo), expectedRank);
+        uint64_t expectedCount = std::lower_bound(sorted.begin(), sorted.end(), hi) - sorted.begin() - expectedRank;
+        ASSERT_EQ(count_range(n, lo, hi), expectedCount);
+    }
+}
+
+GTEST_TEST(OrderStatsTest, insert_and_erase) {
+    std::unique_ptr<Node> un{make_tree()};
+    Node* n = un.get();
+    std::set<int64_t> vals;
+    check_order_stats(n, vals, 10);
+
+    const int size = 20000;
+    for(int i = 0; i < size; i++) {
+        int64_t val = std::rand() % size;
+        insert(n, val);
+        vals.insert(val);
+    }
+    check_order_stats(n, vals, size);
+
+    //Tombstones, revived tombstones and leaves that purge their tombstones
+    for(int i = 0; i < size; i++) {
+        int64_t val = std::rand() % size;
+        if(i % 2) {
+            erase(n, val);
+            vals.erase(val);
+        } else {
+            insert(n, val);
+            vals.insert(val);
+        }
+    }
+    check_order_stats(n, vals, size);
+}
+
+GTEST_TEST(OrderStatsTest, balanced) {
+    //Splits move values and whole subtrees between nodes
+    for(bool sorted : {false, true}) {
+        std::unique_ptr<Node> un{make_tree()};
+        Node* n = un.get();
+        std::set<int64_t> vals;
+        const int size = 20000;
+        for(int i = 0; i < size; i++) {
+            int64_t val = sorted ? i : std::rand() % size;
+            insert_balanced(n, val);
+            vals.insert(val);
+            if(i % 3 == 0) {
+                val = std::rand() % size;
+                erase(n, val);
+                vals.erase(val);
+            }
+        }
+        check_order_stats(n, vals, size);
+    }
+}
+
+GTEST_TEST(OrderStatsTest, insert_batch) {
+    std::unique_ptr<Node> un{make_tree()};
+    Node* n = un.get();
+    std::set<int64_t> vals;
+    const int size = 20000;
+    for(int round = 0; round < 4; round++) {
+        std::vector<int64_t> keys;
+        for(int i = 0; i < size / 2; i++) {
+            keys.push_back(round == 1 ? size + i : std::rand() % size);
+        }
+        insert_batch(n, keys.data(), keys.size());
+        vals.insert(keys.begin(), keys.end());
+        for(int i = 0; i < size / 10; i++) {
+            int64_t val = std::rand() % size;
+            erase(n, val);
+            vals.erase(val);
+        }
+        check_order_stats(n, vals, size * 2);
+    }
+}
+
+GTEST_TEST(OrderStatsTest, bulk_load) {
+    for(int size : {0, 6, 7, 48, 49, 20000}) {
+        std::vector<int64_t> sorted(size);
+        std::iota(sorted.begin(), sorted.end(), 0);
+        std::unique_ptr<Node> un{bulk_load(sorted.data(), sorted.data() + size)};
+        Node* n = un.get();
+        std::set<int64_t> vals(sorted.begin(), sorted.end());
+        check_order_stats(n, vals, size);
+
+        for(int i = 0; i < size / 2; i++) {
+            insert_balanced(n, size + i);
+            vals.insert(size + i);
+        }
+        check_order_stats(n, vals, size * 2);
+    }
+}
+
+#endif
+
 /////////////////////////////////////////////////////////////////////////////////////
 /// \brief Tests for PackedPtr
 /////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,222 @@
+#include "gtest/gtest.h"
+#include <kset/kset.h>
+#include <kset/kset_stats.h>
+#include <kset/parallel.h>
+#include <kset/work_stealing.h>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+namespace Kset {
+
+/////////////////////////////////////////////////////////////////////////////////////
+/// \brief Tests for WorkStealing, parallel_bulk_load(), parallel_build(), parallel_for_each() and parallel_reduce()
+/////////////////////////////////////////////////////////////////////////////////////
+
+static std::vector<int64_t> values(Node* root) {
+    return std::vector<int64_t>(begin(root), end(root));
+}
+
+GTEST_TEST(WorkStealingTest, spawned_tasks) {
+    //Every task splits its range in two till it is small, so most of the work is spawned from within tasks
+    for(unsigned workers : {1u, 2u, 4u, 8u}) {
+        WorkStealing pool(workers);
+        ASSERT_EQ(pool.numWorkers(), workers);
+        std::atomic<uint64_t> sum{0};
+        std::function<void(unsigned, uint64_t, uint64_t)> split = [&](unsigned worker, uint64_t lo, uint64_t hi) {
+            if(hi - lo <= 100) {
+                uint64_t local = 0;
+                for(uint64_t i = lo; i < hi; i++) {
+                    local += i;
+                }
+                sum += local;
+                return;
+            }
+            uint64_t mid = lo + (hi - lo) / 2;
+            pool.spawn(worker, [&split, lo, mid](unsigned w) { split(w, lo, mid); });
+            split(worker, mid, hi);
+        };
+        pool.spawn(0, [&split](unsigned w) { split(w, 0, 100000); });
+        pool.run();
+        ASSERT_EQ(sum.load(), uint64_t{100000} * 99999 / 2);
+    }
+
+    //A throwing task does not stop the others
+    WorkStealing pool(4);
+    std::atomic<int> ran{0};
+    for(int i = 0; i < 100; i++) {
+        pool.spawn(i % 4, [i, &ran](unsigned) {
+            ran++;
+            if(i == 50) {
+                throw std::runtime_error("task failed");
+            }
+        });
+    }
+    ASSERT_THROW(pool.run(), std::runtime_error);
+    ASSERT_EQ(ran.load(), 100);
+}
+
+GTEST_TEST(ParallelBuildTest, same_tree_as_bulk_load) {
+    for(size_t size : {0, 1, 6, 7, 5000, 100000, 300000}) {
+        std::vector<int64_t> input(size);
+        std::iota(input.begin(), input.end(), -int64_t(size / 2));
+        std::unique_ptr<Node> expected{bulk_load(input.data(), input.data() + input.size())};
+        TreeStats e = stats(expected.get());
+        for(unsigned threads : {1u, 3u, 8u}) {
+            std::unique_ptr<Node> built{parallel_bulk_load(input.data(), input.data() + input.size(), threads)};
+            ASSERT_EQ(values(built.get()), input);
+            TreeStats b = stats(built.get());
+            ASSERT_EQ(b.numBlocks, e.numBlocks);
+            ASSERT_EQ(b.depth(), e.depth());
+            if(size) {
+                ASSERT_TRUE(std::get<2>(find(built.get(), input[size / 3])));
+                ASSERT_EQ(std::get<2>(successor(std::get<0>(find(built.get(), input[0])), 0)), size > 1 ? input[1] : -1);
+            }
+#ifdef USE_ORDER_STATS
+            ASSERT_EQ(Kset::size(built.get()), size);
+            for(size_t k = 0; k < size; k += 997) {
+                ASSERT_EQ(std::get<2>(select(built.get(), k)), input[k]);
+            }
+#endif
+            //The tree grows like any other
+            insert(built.get(), int64_t(size));
+            ASSERT_TRUE(std::get<2>(find(built.get(), int64_t(size))));
+        }
+    }
+}
+
+GTEST_TEST(ParallelBuildTest, unsorted_with_duplicates) {
+    std::mt19937_64 gen(11);
+    for(size_t size : {0, 10, 10000, 200000}) {
+        std::vector<int64_t> keys;
+        for(size_t i = 0; i < size; i++) {
+            //Negative values, clusters and plenty of duplicates
+            keys.push_back(int64_t(gen() % (size + 1)) - int64_t(size / 2));
+        }
+        std::set<int64_t> expected(keys.begin(), keys.end());
+        //Many more threads than the input has room for buckets too
+        for(unsigned threads : {1u, 4u, 100u}) {
+            std::unique_ptr<Node> built{parallel_build(keys.data(), keys.size(), threads)};
+            ASSERT_EQ(values(built.get()), std::vector<int64_t>(expected.begin(), expected.end()));
+        }
+    }
+}
+
+GTEST_TEST(ParallelPassTest, for_each_and_reduce) {
+    std::mt19937_64 gen(5);
+    std::vector<std::unique_ptr<Node>> trees;
+    std::vector<std::set<int64_t>> expected;
+
+    //Empty, a single node, packed and lopsided trees
+    trees.emplace_back(make_tree());
+    expected.emplace_back();
+    trees.emplace_back(make_tree());
+    expected.emplace_back();
+    for(int64_t v : {3, -1, 4}) {
+        insert(trees.back().get(), v);
+        expected.back().insert(v);
+    }
+    std::vector<int64_t> sorted(100000);
+    std::iota(sorted.begin(), sorted.end(), -50000);
+    trees.emplace_back(bulk_load(sorted.data(), sorted.data() + sorted.size()));
+    expected.emplace_back(sorted.begin(), sorted.end());
+    trees.emplace_back(make_tree());
+    expected.emplace_back();
+    for(int i = 0; i < 100000; i++) {
+        int64_t v = int64_t(gen() % 1000000) - 500000;
+        insert(trees.back().get(), v);
+        expected.back().insert(v);
+    }
+    trees.emplace_back(make_tree());
+    expected.emplace_back();
+    for(int64_t v = 0; v < 20000; v++) {
+        insert(trees.back().get(), v);
+        expected.back().insert(v);
+    }
+    //Tombstones are skipped
+    for(size_t t = 2; t < trees.size(); t++) {
+        for(int i = 0; i < 5000; i++) {
+            auto itr = expected[t].lower_bound(int64_t(gen() % 1000000) - 500000);
+            if(itr != expected[t].end()) {
+                ASSERT_TRUE(erase(trees[t].get(), *itr));
+                expected[t].erase(itr);
+            }
+        }
+    }
+
+    //The extremes of int64 are values like any other
+    for(size_t t = 1; t < trees.size(); t++) {
+        for(int64_t v : {std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max()}) {
+            insert(trees[t].get(), v);
+            expected[t].insert(v);
+        }
+    }
+
+    for(size_t t = 0; t < trees.size(); t++) {
+        Node* root = trees[t].get();
+        const std::vector<int64_t> all(expected[t].begin(), expected[t].end());
+        for(unsigned threads : {1u, 3u, 8u}) {
+            std::mutex mutex;
+            std::vector<int64_t> seen;
+            parallel_for_each(root, [&](int64_t v) {
+                std::lock_guard<std::mutex> lock(mutex);
+                seen.push_back(v);
+            }, threads);
+            std::sort(seen.begin(), seen.end());
+            ASSERT_EQ(seen, all);
+
+            //Concatenation only works out if the pieces are in order
+            auto append = [](std::vector<int64_t> acc, int64_t v) {
+                acc.push_back(v);
+                return acc;
+            };
+            auto concat = [](std::vector<int64_t> acc, const std::vector<int64_t>& piece) {
+                acc.insert(acc.end(), piece.begin(), piece.end());
+                return acc;
+            };
+            ASSERT_EQ(parallel_reduce(root, std::vector<int64_t>{}, append, concat, threads), all);
+
+            const int64_t min = std::numeric_limits<int64_t>::min();
+            const int64_t max = std::numeric_limits<int64_t>::max();
+            for(int64_t lo : {min, int64_t(-1), int64_t(12345), max}) {
+                for(int64_t hi : {min, int64_t(4), int64_t(15000), max}) {
+                    std::vector<int64_t> range(expected[t].lower_bound(lo), lo < hi ? expected[t].lower_bound(hi) : expected[t].lower_bound(lo));
+                    ASSERT_EQ(parallel_reduce_in_range(root, lo, hi, std::vector<int64_t>{}, append, concat, threads), range);
+                    std::atomic<size_t> count{0};
+                    parallel_for_each_in_range(root, lo, hi, [&count](int64_t) { count++; }, threads);
+                    ASSERT_EQ(count.load(), range.size());
+                }
+                //Up to and including max
+                std::vector<int64_t> tail(expected[t].lower_bound(lo), expected[t].end());
+                ASSERT_EQ(parallel_reduce_between(root, lo, max, std::vector<int64_t>{}, append, concat, threads), tail);
+                std::atomic<size_t> count{0};
+                parallel_for_each_between(root, lo, max, [&count](int64_t) { count++; }, threads);
+                ASSERT_EQ(count.load(), tail.size());
+            }
+        }
+        //Wrapping around, since the extremes are in there
+        ASSERT_EQ(parallel_reduce(root, uint64_t{0}, [](uint64_t acc, uint64_t v) { return acc + v; }),
+                  std::accumulate(all.begin(), all.end(), uint64_t{0}, [](uint64_t acc, int64_t v) { return acc + uint64_t(v); }));
+    }
+}
+
+GTEST_TEST(ParallelPassTest, split_tree) {
+    std::vector<int64_t> sorted(200000);
+    std::iota(sorted.begin(), sorted.end(), 0);
+    std::unique_ptr<Node> root{bulk_load(sorted.data(), sorted.data() + sorted.size())};
+    std::vector<TreePiece> pieces = split_tree(root.get(), std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max(), 64);
+    ASSERT_GE(size_t(std::count_if(pieces.begin(), pieces.end(), [](const TreePiece& p) { return p.idx == invalid_idx; })), 64u);
+
+    //Only the pieces that overlap the range are kept
+    std::vector<TreePiece> narrow = split_tree(root.get(), 1000, 1010, 64);
+    ASSERT_LT(narrow.size(), pieces.size() / 4);
+}
+
+}
@@ -0,0 +1,84 @@
+#include "gtest/gtest.h"
+#include <kset/kset.h>
+#include <kset/set_ops.h>
+#include <memory>
+#include <set>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+
+namespace Kset {
+
+/////////////////////////////////////////////////////////////////////////////////////
+/// \brief Tests for set_union/set_intersection/set_difference
+/////////////////////////////////////////////////////////////////////////////////////
+
+static void check_set_ops(Node* a, const std::set<int64_t>& aVals, Node* b, const std::set<int64_t>& bVals) {
+    std::vector<int64_t> expected, got;
+
+    std::set_union(aVals.begin(), aVals.end(), bVals.begin(), bVals.end(), std::back_inserter(expected));
+    set_union(a, b, [&got](int64_t val) { got.push_back(val); });
+    ASSERT_EQ(got, expected);
+    std::unique_ptr<Node> tree(set_union(a, b));
+    ASSERT_EQ(std::vector<int64_t>(begin(tree.get()), end(tree.get())), expected);
+
+    expected.clear();
+    got.clear();
+    std::set_intersection(aVals.begin(), aVals.end(), bVals.begin(), bVals.end(), std::back_inserter(expected));
+    set_intersection(a, b, [&got](int64_t val) { got.push_back(val); });
+    ASSERT_EQ(got, expected);
+    tree.reset(set_intersection(a, b));
+    ASSERT_EQ(std::vector<int64_t>(begin(tree.get()), end(tree.get())), expected);
+
+    expected.clear();
+    got.clear();
+    std::set_difference(aVals.begin(), aVals.end(), bVals.begin(), bVals.end(), std::back_inserter(expected));
+    set_difference(a, b, [&got](int64_t val) { got.push_back(val); });
+    ASSERT_EQ(got, expected);
+    tree.reset(set_difference(a, b));
+    ASSERT_EQ(std::vector<int64_t>(begin(tree.get()), end(tree.get())), expected);
+}
+
+static void fill(Node* root, std::set<int64_t>& vals, int count, int64_t range, int64_t offset) {
+    for(int i = 0; i < count; i++) {
+        int64_t val = offset + std::rand() % range;
+        insert(root, val);
+        vals.insert(val);
+    }
+}
+
+GTEST_TEST(SetOpsTest, random) {
+    //Similar sizes, one much smaller than the other, and disjoint ranges
+    struct Case { int aCount; int64_t aRange; int64_t aOffset; int bCount; int64_t bRange; int64_t bOffset; };
+    for(const Case& c : {Case{20000, 40000, 0, 20000, 40000, 0},
+                         Case{200, 100000, 0, 50000, 100000, 0},
+                         Case{50000, 100000, 0, 200, 100000, 0},
+                         Case{5000, 10000, 0, 5000, 10000, 20000},
+                         Case{5000, 10000, 5000, 5000, 10000, 0}}) {
+        std::unique_ptr<Node> a(make_tree()), b(make_tree());
+        std::set<int64_t> aVals, bVals;
+        fill(a.get(), aVals, c.aCount, c.aRange, c.aOffset);
+        fill(b.get(), bVals, c.bCount, c.bRange, c.bOffset);
+
+        //Tombstones must be skipped
+        for(int i = 0; i < c.aCount / 4; i++) {
+            int64_t val = c.aOffset + std::rand() % c.aRange;
+            erase(a.get(), val);
+            aVals.erase(val);
+        }
+        check_set_ops(a.get(), aVals, b.get(), bVals);
+    }
+}
+
+GTEST_TEST(SetOpsTest, empty) {
+    std::unique_ptr<Node> a(make_tree()), b(make_tree());
+    std::set<int64_t> aVals, bVals;
+    check_set_ops(a.get(), aVals, b.get(), bVals);
+
+    fill(a.get(), aVals, 1000, 5000, 0);
+    check_set_ops(a.get(), aVals, b.get(), bVals);
+    check_set_ops(b.get(), bVals, a.get(), aVals);
+    check_set_ops(a.get(), aVals, a.get(), aVals);
+}
+
+}
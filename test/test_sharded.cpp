@@ -0,0 +1,153 @@
+#include "gtest/gtest.h"
+#include <kset/sharded_kset.h>
+#include <kset/kset_stats.h>
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace Kset {
+
+/////////////////////////////////////////////////////////////////////////////////////
+/// \brief Tests for ShardedKset
+/////////////////////////////////////////////////////////////////////////////////////
+
+using Partition = ShardedKset::Partition;
+
+static std::vector<int64_t> values(const ShardedKset& set) {
+    return std::vector<int64_t>(set.begin(), set.end());
+}
+
+GTEST_TEST(ShardedKsetTest, matches_std_set) {
+    std::mt19937_64 gen(3);
+    for(Partition partition : {Partition::high_bits, Partition::hash}) {
+        for(unsigned bits : {0u, 1u, 4u, 8u}) {
+            ShardedKset set(bits, partition);
+            std::set<int64_t> expected;
+            ASSERT_EQ(set.begin(), set.end());
+            for(int i = 0; i < 20000; i++) {
+                //Values from all over the key space, and some clustered ones
+                int64_t v = i % 2 ? int64_t(gen()) : int64_t(gen() % 1000) - 500;
+                if(v == std::numeric_limits<int64_t>::max()) {
+                    continue;
+                }
+                ASSERT_EQ(set.insert(v), expected.insert(v).second);
+                if(i % 5 == 0) {
+                    int64_t e = int64_t(gen() % 1000) - 500;
+                    ASSERT_EQ(set.erase(e), expected.erase(e) == 1);
+                }
+            }
+            ASSERT_EQ(set.size(), expected.size());
+            ASSERT_EQ(values(set), std::vector<int64_t>(expected.begin(), expected.end()));
+            for(int64_t v : {int64_t(-501), int64_t(-3), int64_t(0), int64_t(499), int64_t(1) << 62}) {
+                ASSERT_EQ(set.contains(v), expected.count(v) == 1);
+                auto itr = set.lower_bound(v);
+                auto e = expected.lower_bound(v);
+                for(int steps = 0; steps < 50 && e != expected.end(); steps++, ++itr, ++e) {
+                    ASSERT_EQ(*itr, *e);
+                }
+                if(e == expected.end()) {
+                    ASSERT_EQ(itr, set.end());
+                }
+            }
+            ASSERT_EQ(set.lower_bound(std::numeric_limits<int64_t>::max()), set.end());
+        }
+    }
+    ASSERT_THROW(ShardedKset(ShardedKset::max_shard_bits + 1), std::invalid_argument);
+}
+
+GTEST_TEST(ShardedKsetTest, batches) {
+    std::mt19937_64 gen(7);
+    for(Partition partition : {Partition::high_bits, Partition::hash}) {
+        ShardedKset set(6, partition);
+        std::set<int64_t> expected;
+        for(int round = 0; round < 20; round++) {
+            std::vector<int64_t> keys;
+            for(int i = 0; i < 3000; i++) {
+                keys.push_back(int64_t(gen() % 100000) - 50000 + (int64_t(gen() % 4) << 60));
+            }
+            size_t added = 0;
+            for(int64_t k : keys) {
+                added += expected.insert(k).second;
+            }
+            ASSERT_EQ(set.insert_batch(keys.data(), keys.size()), added);
+
+            std::vector<int64_t> gone(keys.begin(), keys.begin() + 500);
+            gone.push_back(-1);
+            size_t erased = 0;
+            for(int64_t k : gone) {
+                erased += expected.erase(k);
+            }
+            ASSERT_EQ(set.erase_batch(gone.data(), gone.size()), erased);
+
+            std::vector<int64_t> probes(keys.begin(), keys.begin() + 1000);
+            probes.push_back(int64_t(1) << 62);
+            std::unique_ptr<bool[]> found(new bool[probes.size()]);
+            set.contains_batch(probes.data(), probes.size(), found.get());
+            for(size_t i = 0; i < probes.size(); i++) {
+                ASSERT_EQ(found[i], expected.count(probes[i]) == 1);
+            }
+        }
+        ASSERT_EQ(set.size(), expected.size());
+        ASSERT_EQ(values(set), std::vector<int64_t>(expected.begin(), expected.end()));
+    }
+}
+
+GTEST_TEST(ShardedKsetTest, sequential_ids_stay_shallow) {
+    //With Partition::high_bits all of them land in one shard, which must not become a chain
+    ShardedKset set(4, Partition::high_bits);
+    const int64_t size = 100000;
+    for(int64_t v = 0; v < size; v++) {
+        ASSERT_TRUE(set.insert(v));
+    }
+    size_t deepest{0};
+    for(unsigned s = 0; s < set.numShards(); s++) {
+        deepest = std::max(deepest, stats(set.shardRoot(s)).depth());
+    }
+    ASSERT_LE(deepest, 12u);
+    ASSERT_EQ(set.size(), size_t(size));
+    ASSERT_EQ(*set.lower_bound(size / 2), size / 2);
+}
+
+GTEST_TEST(ShardedKsetTest, concurrent_writers) {
+    for(Partition partition : {Partition::high_bits, Partition::hash}) {
+        ShardedKset set(4, partition);
+        const int numThreads = 4;
+        const int perThread = 50000;
+        std::vector<std::thread> threads;
+        for(int t = 0; t < numThreads; t++) {
+            threads.emplace_back([&set, t]() {
+                //Every thread inserts its own values, half of them one at a time
+                std::vector<int64_t> batch;
+                for(int64_t i = 0; i < perThread; i++) {
+                    int64_t v = (i * numThreads + t) * 7919 - 1000000;
+                    if(i % 2) {
+                        set.insert(v);
+                    } else {
+                        batch.push_back(v);
+                    }
+                    if(batch.size() == 1000) {
+                        set.insert_batch(batch.data(), batch.size());
+                        batch.clear();
+                    }
+                }
+                set.insert_batch(batch.data(), batch.size());
+            });
+        }
+        for(std::thread& thread : threads) {
+            thread.join();
+        }
+        ASSERT_EQ(set.size(), size_t(numThreads * perThread));
+        std::vector<int64_t> all = values(set);
+        ASSERT_EQ(all.size(), size_t(numThreads * perThread));
+        for(size_t i = 0; i < all.size(); i++) {
+            ASSERT_EQ(all[i], int64_t(i) * 7919 - 1000000);
+        }
+    }
+}
+
+}
@@ -0,0 +1,101 @@
+#include "gtest/gtest.h"
+#include <kset/kset.h>
+#include <kset/kset_stats.h>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+namespace Kset {
+
+/////////////////////////////////////////////////////////////////////////////////////
+/// \brief Tests for stats()
+/////////////////////////////////////////////////////////////////////////////////////
+
+///The totals must agree with the per level numbers
+static void check_totals(const TreeStats& s) {
+    uint64_t nodes{0}, values{0};
+    for(const LevelStats& level : s.levels) {
+        nodes += level.nodes;
+        values += level.values;
+    }
+    ASSERT_EQ(nodes, s.numNodes);
+    ASSERT_EQ(values, s.numValues + s.numTombstones);
+    ASSERT_EQ(s.numNodes, 1 + s.numBlocks * (Node::capacity + 1));
+    ASSERT_EQ(s.allocatedBytes, sizeof(Node) * (1 + s.numBlocks * Node::block_nodes));
+    ASSERT_GE(s.reservedBytes, s.allocatedBytes);
+}
+
+GTEST_TEST(StatsTest, empty_and_single_node) {
+    std::unique_ptr<Node> un{make_tree()};
+    TreeStats s = stats(un.get());
+    ASSERT_EQ(s.numValues, 0);
+    ASSERT_EQ(s.numNodes, 1);
+    ASSERT_EQ(s.depth(), 1);
+    ASSERT_EQ(s.levels[0].leaves, 0);
+    ASSERT_EQ(s.bytesPerValue(), 0);
+    check_totals(s);
+
+    for(int64_t i = 0; i < Node::capacity; i++) {
+        insert(un.get(), i);
+    }
+    s = stats(un.get());
+    ASSERT_EQ(s.numValues, uint64_t{Node::capacity});
+    ASSERT_EQ(s.depth(), 1);
+    ASSERT_EQ(s.levels[0].leaves, 1);
+    ASSERT_EQ(s.levels[0].fill(), 1.0);
+    ASSERT_EQ(s.numEmptyNodes, 0);
+    check_totals(s);
+
+    //One more value expands the root into a block with a single populated node
+    insert(un.get(), Node::capacity);
+    s = stats(un.get());
+    ASSERT_EQ(s.depth(), 2);
+    ASSERT_EQ(s.numBlocks, 1);
+    ASSERT_EQ(s.numEmptyNodes, uint64_t{Node::capacity});
+    ASSERT_EQ(s.levels[1].leaves, 1);
+    ASSERT_EQ(s.levels[0].leaves, 0);
+    check_totals(s);
+}
+
+GTEST_TEST(StatsTest, tombstones) {
+    std::unique_ptr<Node> un{make_tree()};
+    for(int64_t i = 0; i < 1000; i++) {
+        insert(un.get(), (i * 7919) % 1000);
+    }
+    for(int64_t i = 0; i < 1000; i += 3) {
+        erase(un.get(), i);
+    }
+    TreeStats s = stats(un.get());
+    ASSERT_EQ(s.numValues, 666);
+    ASSERT_EQ(s.numTombstones, 334);
+    check_totals(s);
+}
+
+GTEST_TEST(StatsTest, balanced_and_bulk_loaded) {
+    const int size = 100000;
+    std::unique_ptr<Node> balanced{make_tree()};
+    for(int64_t i = 0; i < size; i++) {
+        insert_balanced(balanced.get(), i);
+    }
+    std::vector<int64_t> sorted(size);
+    std::iota(sorted.begin(), sorted.end(), 0);
+    std::unique_ptr<Node> packed{bulk_load(sorted.data(), sorted.data() + size)};
+
+    for(Node* root : {balanced.get(), packed.get()}) {
+        TreeStats s = stats(root);
+        ASSERT_EQ(s.numValues, size);
+        check_totals(s);
+
+        //All leaves are on the last level
+        for(size_t l = 0; l + 1 < s.depth(); l++) {
+            ASSERT_EQ(s.levels[l].leaves, 0);
+        }
+        ASSERT_GT(s.levels.back().leaves, 0);
+    }
+
+    //bulk_load fills its nodes, so it takes less memory than splitting on the way
+    ASSERT_LT(stats(packed.get()).bytesPerValue(), stats(balanced.get()).bytesPerValue());
+    ASSERT_GT(stats(packed.get()).fill(), 0.9);
+}
+
+}